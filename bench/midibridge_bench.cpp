@@ -0,0 +1,1248 @@
+#include "library.hpp"
+#include "library_view.hpp"
+#include "parser.hpp"
+#include "router.hpp"
+#include "routing.hpp"
+#include "scheduler.hpp"
+#include "sysex.hpp"
+#include "transport.hpp"
+
+#include <imgui.h>
+
+#if defined(__linux__)
+#include <sys/prctl.h>
+#include <time.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+static std::atomic<std::uint64_t> allocation_count = 0;
+static std::atomic<std::uint64_t> allocation_bytes = 0;
+static std::size_t failure_count = 0; // checks that failed, the bench exits with 1 if any did
+
+struct bench_stream {
+    std::string name;
+    std::vector<unsigned char> bytes;
+};
+
+struct bench_result {
+    std::uint64_t messages = 0;
+    std::uint64_t bytes = 0;
+    double seconds = 0;
+    std::uint64_t allocations = 0;
+    std::uint64_t cycles = 0;
+    std::uint64_t lost = 0; // messages that never came out before the timeout
+};
+
+/// @brief Reports a failed check, the run goes on so every other figure is still printed
+static void report_failure(const std::string& reason)
+{
+    std::fprintf(stderr, "FAILED: %s\n", reason.c_str());
+    ++failure_count;
+}
+
+class null_output_transport : public midi_output_transport {
+public:
+    void send(const unsigned char* data, const std::size_t length) override
+    {
+        (void)data;
+        bytes += length;
+    }
+
+    [[nodiscard]] bool is_raw_byte_stream() const override
+    {
+        return true;
+    }
+
+    std::uint64_t bytes = 0;
+};
+
+class stamping_output_transport : public midi_output_transport {
+public:
+    explicit stamping_output_transport(std::vector<std::chrono::steady_clock::time_point>& stamps)
+        : _stamps(stamps)
+    {
+    }
+
+    void send(const unsigned char* data, const std::size_t length) override
+    {
+        (void)data;
+        (void)length;
+        _stamps.push_back(std::chrono::steady_clock::now());
+    }
+
+    [[nodiscard]] bool is_raw_byte_stream() const override
+    {
+        return true;
+    }
+
+private:
+    std::vector<std::chrono::steady_clock::time_point>& _stamps;
+};
+
+[[nodiscard]] static std::uint64_t read_cycles()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+[[nodiscard]] static output_pacing get_unlimited_pacing()
+{
+    output_pacing _pacing;
+    _pacing.bytes_per_millisecond = 1e12;
+    _pacing.burst_bytes = std::size_t(1) << 30;
+    _pacing.sysex_gap = std::chrono::microseconds(0);
+    _pacing.coalesce_latency = std::chrono::hours(1);
+    return _pacing;
+}
+
+[[nodiscard]] static bench_stream make_dense_notes()
+{
+    bench_stream _stream { "dense notes", {} };
+    for (int _index = 0; _index < 16384; ++_index) {
+        const unsigned char _channel = static_cast<unsigned char>(_index & 0x0F);
+        const unsigned char _note = static_cast<unsigned char>(36 + _index % 61);
+        _stream.bytes.insert(_stream.bytes.end(), { static_cast<unsigned char>(0x90 | _channel), _note, 100 });
+        _stream.bytes.insert(_stream.bytes.end(), { static_cast<unsigned char>(0x80 | _channel), _note, 0 });
+    }
+    return _stream;
+}
+
+[[nodiscard]] static bench_stream make_running_status_flood()
+{
+    bench_stream _stream { "running status CC flood", { 0xB0 } };
+    for (int _index = 0; _index < 32768; ++_index) {
+        _stream.bytes.insert(_stream.bytes.end(), { 1, static_cast<unsigned char>(_index & 0x7F) });
+    }
+    return _stream;
+}
+
+[[nodiscard]] static std::vector<unsigned char> make_bank_dump(const unsigned char seed)
+{
+    // F0 43 00 09 20 00 [4096 bytes] checksum F7
+    std::vector<unsigned char> _dump = { 0xF0, 0x43, 0x00, 0x09, 0x20, 0x00 };
+    unsigned int _sum = 0;
+    for (int _index = 0; _index < 4096; ++_index) {
+        const unsigned char _byte = static_cast<unsigned char>((_index * 31 + seed) & 0x7F);
+        _dump.push_back(_byte);
+        _sum += _byte;
+    }
+    _dump.push_back(static_cast<unsigned char>((128 - (_sum & 0x7F)) & 0x7F));
+    _dump.push_back(0xF7);
+    return _dump;
+}
+
+[[nodiscard]] static bench_stream make_bank_dumps()
+{
+    bench_stream _stream { "DX7 bank dumps", {} };
+    for (unsigned char _seed = 0; _seed < 32; ++_seed) {
+        const std::vector<unsigned char> _dump = make_bank_dump(_seed);
+        _stream.bytes.insert(_stream.bytes.end(), _dump.begin(), _dump.end());
+    }
+    return _stream;
+}
+
+[[nodiscard]] static bench_stream make_realtime_in_sysex()
+{
+    bench_stream _stream { "realtime inside SysEx", {} };
+    for (unsigned char _seed = 0; _seed < 32; ++_seed) {
+        const std::vector<unsigned char> _dump = make_bank_dump(_seed);
+        for (std::size_t _index = 0; _index < _dump.size(); ++_index) {
+            _stream.bytes.push_back(_dump[_index]);
+            if (_index % 64 == 63) {
+                _stream.bytes.push_back(0xF8);
+            }
+        }
+    }
+    return _stream;
+}
+
+[[nodiscard]] static bench_stream read_recorded_stream(const std::filesystem::path& path)
+{
+    bench_stream _stream { path.filename().string(), {} };
+    std::ifstream _fstream(path, std::ios::binary);
+    if (!_fstream) {
+        throw std::runtime_error("Cannot open recorded stream " + path.string());
+    }
+    _stream.bytes.assign(std::istreambuf_iterator<char>(_fstream), std::istreambuf_iterator<char>());
+    return _stream;
+}
+
+template <typename Function>
+[[nodiscard]] static bench_result measure(const std::size_t repeats, const std::size_t stream_size, Function&& function)
+{
+    bench_result _result;
+    const std::uint64_t _allocations = allocation_count.load();
+    const std::uint64_t _cycles = read_cycles();
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+    for (std::size_t _repeat = 0; _repeat < repeats; ++_repeat) {
+        _result.messages += function();
+    }
+    _result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    _result.cycles = read_cycles() - _cycles;
+    _result.allocations = allocation_count.load() - _allocations;
+    _result.bytes = static_cast<std::uint64_t>(repeats) * stream_size;
+    return _result;
+}
+
+static void print_result(const char* stage, const std::string& stream, const bench_result& result)
+{
+    const double _messages = static_cast<double>(result.messages ? result.messages : 1);
+    std::printf("%-10s %-26s %14.0f %14.0f %12.3f %10.2f\n",
+        stage,
+        stream.c_str(),
+        static_cast<double>(result.messages) / result.seconds,
+        static_cast<double>(result.bytes) / result.seconds,
+        static_cast<double>(result.allocations) / _messages,
+        result.bytes ? static_cast<double>(result.cycles) / static_cast<double>(result.bytes) : 0.0);
+    if (result.lost) {
+        report_failure(std::string(stage) + " on " + stream + " timed out with " + std::to_string(result.lost) + " messages lost");
+    }
+}
+
+static std::uint64_t split_and_send_messages = 0; // messages handed on by the split_and_send baseline
+
+/// @brief The receive path splitter the router used before midi_stream_parser, kept as the baseline of the parser
+/// @details Its state is function local so there is one stream per process, and SysEx grows a vector that is cleared
+/// after every message. Where it used to call RtMidi it only counts the messages.
+static void split_and_send(const std::vector<unsigned char>& data)
+{
+    static unsigned char _running_status = 0;
+    static std::vector<unsigned char> _sysex_accumulate;
+
+    std::size_t _index = 0;
+    while (_index < data.size()) {
+        const unsigned char _byte = data[_index];
+        if (is_midi_realtime(_byte)) {
+            ++split_and_send_messages;
+            ++_index;
+            continue;
+        }
+
+        if (_byte == 0xF0 || !_sysex_accumulate.empty()) {
+            if (_byte == 0xF0 && _sysex_accumulate.empty()) {
+                _sysex_accumulate.clear();
+                _sysex_accumulate.push_back(0xF0);
+                ++_index;
+            }
+            for (; _index < data.size(); ++_index) {
+                const unsigned char _char = data[_index];
+                if (is_midi_realtime(_char)) {
+                    ++split_and_send_messages;
+                    continue;
+                }
+                _sysex_accumulate.push_back(_char);
+                if (_char == 0xF7) {
+                    ++split_and_send_messages;
+                    _sysex_accumulate.clear();
+                    ++_index;
+                    break;
+                }
+            }
+            _running_status = 0;
+            continue;
+        }
+
+        if (is_midi_status(_byte)) {
+            const int _need = get_midi_data_count(_byte);
+            if (is_midi_system_common(_byte) && _byte != 0xF0) {
+                const std::size_t _have = data.size() - (_index + 1);
+                const std::size_t _take = (_need > 0 && _have >= static_cast<std::size_t>(_need)) ? static_cast<std::size_t>(_need) : 0;
+                ++split_and_send_messages;
+                _index += 1 + _take;
+                _running_status = 0;
+                continue;
+            }
+
+            if (_need >= 0) {
+                if (_index + 1 + _need <= data.size()) {
+                    ++split_and_send_messages;
+                    _running_status = _byte;
+                    _index += 1 + static_cast<std::size_t>(_need);
+                } else {
+                    _index = data.size();
+                }
+                continue;
+            }
+            ++_index;
+            continue;
+        }
+
+        if (_running_status) {
+            const int _need = get_midi_data_count(_running_status);
+            if (_need == 1) {
+                ++split_and_send_messages;
+                ++_index;
+            } else if (_need == 2) {
+                if (_index + 1 < data.size()) {
+                    ++split_and_send_messages;
+                    _index += 2;
+                } else {
+                    ++_index;
+                }
+            } else {
+                ++_index;
+            }
+            continue;
+        }
+
+        ++_index;
+    }
+}
+
+[[nodiscard]] static bench_result bench_split_and_send(const bench_stream& stream, const std::size_t repeats)
+{
+    return measure(repeats, stream.bytes.size(), [&] {
+        const std::uint64_t _messages = split_and_send_messages;
+        split_and_send(stream.bytes);
+        return split_and_send_messages - _messages;
+    });
+}
+
+[[nodiscard]] static bench_result bench_parser(const bench_stream& stream, const std::size_t repeats)
+{
+    midi_stream_parser _parser;
+    return measure(repeats, stream.bytes.size(), [&] {
+        std::uint64_t _messages = 0;
+        _parser.parse(stream.bytes.data(), stream.bytes.size(), [&](const unsigned char*, const std::size_t) {
+            ++_messages;
+        });
+        return _messages;
+    });
+}
+
+[[nodiscard]] static std::array<midi_channel_transform, 16> make_dx7_transforms()
+{
+    // every channel folded onto channel 1, an octave down and a softer velocity curve
+    std::array<midi_channel_transform, 16> _transforms;
+    for (midi_channel_transform& _transform : _transforms) {
+        _transform.channel = 0;
+        _transform.transpose = -12;
+        _transform.velocity_exponent = 0.6;
+        _transform.velocity_min = 16;
+    }
+    return _transforms;
+}
+
+[[nodiscard]] static bench_result bench_transform(const bench_stream& stream, const std::size_t repeats)
+{
+    // the parser stage with every message of at most 3 bytes going through the lookup tables of a route
+    midi_stream_parser _parser;
+    const midi_transform _transform(make_dx7_transforms());
+    std::uint64_t _checksum = 0;
+    const bench_result _result = measure(repeats, stream.bytes.size(), [&] {
+        std::uint64_t _messages = 0;
+        _parser.parse(stream.bytes.data(), stream.bytes.size(), [&](const unsigned char* data, const std::size_t length) {
+            unsigned char _bytes[3];
+            _checksum += length <= 3 ? _transform.apply(data, length, _bytes) : length;
+            ++_messages;
+        });
+        return _messages;
+    });
+    if (!_checksum) {
+        std::printf("unexpected empty transform\n");
+    }
+    return _result;
+}
+
+[[nodiscard]] static bench_result bench_scheduler(const bench_stream& stream, const std::size_t repeats)
+{
+    midi_stream_parser _parser;
+    output_scheduler _scheduler(get_unlimited_pacing());
+    null_output_transport _transport;
+    return measure(repeats, stream.bytes.size(), [&] {
+        const output_scheduler::clock::time_point _now = output_scheduler::clock::now();
+        std::uint64_t _messages = 0;
+        _parser.parse(stream.bytes.data(), stream.bytes.size(), [&](const unsigned char* data, const std::size_t length) {
+            _scheduler.push(data, length, _now);
+            ++_messages;
+        });
+        _scheduler.flush(_now, _transport);
+        return _messages;
+    });
+}
+
+[[nodiscard]] static std::uint64_t bench_wire_bytes(const bench_stream& stream, const bool use_running_status)
+{
+    // bytes the scheduler puts on a wire that accepts running status, with or without it
+    output_pacing _pacing = get_unlimited_pacing();
+    _pacing.use_running_status = use_running_status;
+    output_scheduler _scheduler(_pacing);
+    null_output_transport _transport;
+    midi_stream_parser _parser;
+    const output_scheduler::clock::time_point _now = output_scheduler::clock::now();
+    _parser.parse(stream.bytes.data(), stream.bytes.size(), [&](const unsigned char* data, const std::size_t length) {
+        _scheduler.push(data, length, _now);
+    });
+    _scheduler.flush(_now, _transport);
+    return _transport.bytes;
+}
+
+[[nodiscard]] static std::vector<std::vector<unsigned char>> split_packets(const bench_stream& stream)
+{
+    std::vector<std::vector<unsigned char>> _packets;
+    midi_stream_parser _parser;
+    _parser.parse(stream.bytes.data(), stream.bytes.size(), [&_packets](const unsigned char* data, const std::size_t length) {
+        _packets.emplace_back(data, data + length);
+    });
+    return _packets;
+}
+
+[[nodiscard]] static bench_result bench_vector_receive(const bench_stream& stream, const std::size_t repeats)
+{
+    // previous receive loop, a 64 KB vector resized to each packet and handed to a std::function, the driver wrote
+    // into it before the resize, which zero fills the bytes a longer packet adds, the same work in the other order
+    const std::vector<std::vector<unsigned char>> _packets = split_packets(stream);
+    std::uint64_t _checksum = 0;
+    const std::function<void(const std::vector<unsigned char>&)> _callback = [&_checksum](const std::vector<unsigned char>& data) {
+        _checksum += data.size() + data.back();
+    };
+    std::vector<unsigned char> _buffer(65536);
+    const bench_result _result = measure(repeats, stream.bytes.size(), [&] {
+        for (const std::vector<unsigned char>& _packet : _packets) {
+            _buffer.resize(_packet.size());
+            std::memcpy(_buffer.data(), _packet.data(), _packet.size());
+            _callback(_buffer);
+        }
+        return static_cast<std::uint64_t>(_packets.size());
+    });
+    if (!_checksum) {
+        std::printf("unexpected empty receive\n");
+    }
+    return _result;
+}
+
+[[nodiscard]] static bench_result bench_span_receive(const bench_stream& stream, const std::size_t repeats)
+{
+    const std::vector<std::vector<unsigned char>> _packets = split_packets(stream);
+    std::uint64_t _checksum = 0;
+    auto _receive = [&_checksum](const unsigned char* data, const std::size_t length) {
+        _checksum += length + data[length - 1];
+    };
+    const midi_receive_callback _callback = make_midi_receive_callback(_receive);
+    midi_receive_arena _arena;
+    const bench_result _result = measure(repeats, stream.bytes.size(), [&] {
+        for (const std::vector<unsigned char>& _packet : _packets) {
+            std::memcpy(_arena.data(), _packet.data(), _packet.size());
+            _callback(_arena.data(), _packet.size());
+        }
+        return static_cast<std::uint64_t>(_packets.size());
+    });
+    if (!_checksum) {
+        std::printf("unexpected empty receive\n");
+    }
+    return _result;
+}
+
+[[nodiscard]] static bench_result bench_router(const bench_stream& stream, const std::size_t repeats, const std::vector<midi_route>& routes = { midi_route() }, const bool is_return = false)
+{
+    // input loopback -> routes -> output thread -> output loopback, measured until the last message comes out
+    // the return direction goes from a hardware input to a virtual output from the receive thread without any queue
+    const std::size_t _packet_size = 256;
+    const std::size_t _packets_in_flight = 32; // keeps both loopbacks and the hardware ring from overflowing
+    std::atomic<std::uint64_t> _received = 0;
+    midi_loopback _input = create_loopback();
+    auto _receive = [&_received](const unsigned char*, const std::size_t) {
+        _received.fetch_add(1, std::memory_order_relaxed);
+    };
+    const midi_input_routes _compiled = routing_table(routes).get_input_routes(0);
+    midi_output_mask _outputs = 0;
+    for (const midi_output_mask _output_mask : _compiled.outputs) {
+        _outputs |= _output_mask;
+    }
+    std::vector<std::unique_ptr<midi_input_transport>> _output_inputs;
+    if (is_return) {
+        set_midi_return_routes(routes);
+    } else {
+        set_midi_routes(routes);
+    }
+    for (midi_output_mask _remaining = _outputs; _remaining; _remaining &= _remaining - 1) {
+        const std::size_t _output = get_lowest_output(_remaining);
+        midi_loopback _output_loopback = create_loopback();
+        _output_loopback.input->start(make_midi_receive_callback(_receive));
+        _output_inputs.push_back(std::move(_output_loopback.input));
+        if (is_return) {
+            open_virtual_output(_output, std::move(_output_loopback.output));
+        } else {
+            set_hardware_output_pacing(_output, get_unlimited_pacing());
+            open_hardware_output(_output, std::move(_output_loopback.output));
+        }
+    }
+    if (is_return) {
+        open_hardware_input(0, std::move(_input.input));
+    } else {
+        open_virtual_input(0, std::move(_input.input));
+    }
+
+    // messages received once each packet went through, counted on every output they reach and not dropped by a transform
+    std::vector<std::uint64_t> _packet_ends;
+    std::uint64_t _expected = 0;
+    midi_stream_parser _counter;
+    for (std::size_t _offset = 0; _offset < stream.bytes.size(); _offset += _packet_size) {
+        const std::size_t _end = std::min(stream.bytes.size(), _offset + _packet_size);
+        _counter.parse(stream.bytes.data() + _offset, _end - _offset, [&_expected, &_compiled](const unsigned char* message, const std::size_t length) {
+            for (midi_output_mask _remaining = _compiled.outputs[message[0]]; _remaining; _remaining &= _remaining - 1) {
+                const std::size_t _output = get_lowest_output(_remaining);
+                unsigned char _bytes[3];
+                if (!((_compiled.transformed_outputs >> _output) & 1) || length > 3 || _compiled.transforms[_output]->apply(message, length, _bytes)) {
+                    ++_expected;
+                }
+            }
+        });
+        _packet_ends.push_back(_expected);
+    }
+    std::uint64_t _lost = 0;
+    bench_result _result = measure(repeats, stream.bytes.size(), [&]() -> std::uint64_t {
+        if (_lost) {
+            // one timeout is enough, the next repeats would each wait for it again
+            return 0;
+        }
+        const std::uint64_t _base = _received.load();
+        const std::chrono::steady_clock::time_point _timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        for (std::size_t _packet = 0; _packet < _packet_ends.size(); ++_packet) {
+            if (_packet >= _packets_in_flight) {
+                while (_received.load() - _base < _packet_ends[_packet - _packets_in_flight] && std::chrono::steady_clock::now() < _timeout) {
+                    std::this_thread::yield();
+                }
+            }
+            const std::size_t _offset = _packet * _packet_size;
+            _input.output->send(stream.bytes.data() + _offset, std::min(_packet_size, stream.bytes.size() - _offset));
+        }
+        while (_received.load() - _base < _expected && std::chrono::steady_clock::now() < _timeout) {
+            std::this_thread::yield();
+        }
+        const std::uint64_t _delivered = std::min(_received.load() - _base, _expected);
+        _lost = _expected - _delivered;
+        return _delivered;
+    });
+    _result.lost = _lost;
+    close_virtual_input(0);
+    close_hardware_input(0);
+    for (midi_output_mask _remaining = _outputs; _remaining; _remaining &= _remaining - 1) {
+        close_hardware_output(get_lowest_output(_remaining));
+        close_virtual_output(get_lowest_output(_remaining));
+    }
+    for (const std::unique_ptr<midi_input_transport>& _output_input : _output_inputs) {
+        _output_input->stop();
+    }
+    return _result;
+}
+
+[[nodiscard]] static std::vector<midi_route> make_routes(const std::size_t count)
+{
+    // each route takes one channel to its own output, past 16 routes they start from other inputs so every message of
+    // input 0 still reaches exactly one output
+    std::vector<midi_route> _routes(count);
+    for (std::size_t _index = 0; _index < count; ++_index) {
+        _routes[_index].input = _index / 16;
+        _routes[_index].output = _index;
+        _routes[_index].channels = static_cast<std::uint16_t>(1 << (_index % 16));
+        _routes[_index].types = all_midi_message_types & ~static_cast<std::uint16_t>(midi_message_type::sysex);
+    }
+    return _routes;
+}
+
+[[nodiscard]] static double bench_dispatch(const std::vector<midi_route>& routes, const bool is_compiled, const std::vector<std::vector<unsigned char>>& messages)
+{
+    const routing_table _table(routes);
+    midi_output_mask _checksum = 0;
+    const std::size_t _repeats = 64;
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+    for (std::size_t _repeat = 0; _repeat < _repeats; ++_repeat) {
+        for (const std::vector<unsigned char>& _message : messages) {
+            midi_output_mask _outputs = 0;
+            if (is_compiled) {
+                _outputs = _table.get_outputs(0, _message[0]);
+            } else {
+                // rule list walked for every message, what the table replaces
+                const std::uint16_t _type = static_cast<std::uint16_t>(routing_table::get_message_type(_message[0]));
+                for (const midi_route& _route : routes) {
+                    if (_route.input == 0 && (_route.types & _type) && (_message[0] >= 0xF0 || (_route.channels & (1 << (_message[0] & 0x0F))))) {
+                        _outputs |= midi_output_mask(1) << _route.output;
+                    }
+                }
+            }
+            while (_outputs) {
+                _checksum += get_lowest_output(_outputs);
+                _outputs &= _outputs - 1;
+            }
+        }
+    }
+    const std::chrono::steady_clock::duration _elapsed = std::chrono::steady_clock::now() - _start;
+    if (_checksum == midi_output_mask(-1)) {
+        std::printf("unexpected checksum\n");
+    }
+    return std::chrono::duration<double, std::nano>(_elapsed).count() / static_cast<double>(_repeats * messages.size());
+}
+
+[[nodiscard]] static double bench_library_send(const bool is_blob, const std::size_t sends)
+{
+    // sender and output thread cost of sending bank dumps from the library, until the last one left the scheduler
+    const midi_message_blob _dump = std::make_shared<const std::vector<unsigned char>>(make_bank_dump(0));
+    set_hardware_output_pacing(0, get_unlimited_pacing());
+    open_hardware_output(0, std::make_unique<null_output_transport>());
+    const std::uint64_t _target = get_hardware_output_counters(0).sent_messages.load() + sends;
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+    for (std::size_t _send = 0; _send < sends;) {
+        const bool _is_sent = is_blob ? send_to_hardware_output(0, _dump) : send_to_hardware_output(0, *_dump);
+        if (_is_sent) {
+            ++_send;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    while (get_hardware_output_counters(0).sent_messages.load() < _target) {
+        std::this_thread::yield();
+    }
+    const std::chrono::steady_clock::duration _elapsed = std::chrono::steady_clock::now() - _start;
+    close_hardware_output(0);
+    return std::chrono::duration<double, std::nano>(_elapsed).count() / static_cast<double>(sends);
+}
+
+static void sleep_until_absolute(const std::chrono::steady_clock::time_point time)
+{
+#if defined(__linux__)
+    const std::chrono::nanoseconds _time = time.time_since_epoch();
+    timespec _deadline;
+    _deadline.tv_sec = static_cast<time_t>(std::chrono::duration_cast<std::chrono::seconds>(_time).count());
+    _deadline.tv_nsec = static_cast<long>((_time % std::chrono::seconds(1)).count());
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &_deadline, nullptr) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_until(time);
+#endif
+}
+
+struct scheduled_jitter {
+    latency_snapshot sends; // lateness of the sends of the output thread
+    latency_snapshot sleeps; // lateness of bare absolute sleeps of another thread at the same time, what the machine allows
+};
+
+[[nodiscard]] static scheduled_jitter bench_scheduled_jitter(const std::size_t messages, const std::chrono::microseconds interval)
+{
+    // notes sent ahead of time, the lateness of each send against its requested time
+    set_hardware_output_pacing(0, get_unlimited_pacing());
+    open_hardware_output(0, std::make_unique<null_output_transport>());
+    const latency_snapshot _before = get_latency_report(0)[static_cast<std::size_t>(latency_class::scheduled)];
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+    latency_histograms _sleeps;
+    std::thread _sleeper([&_sleeps, _start, messages, interval] {
+        // half an interval off the sends so both threads do not wake together, a stolen CPU delays both alike
+#if defined(__linux__)
+        prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif
+        for (std::size_t _index = 0; _index < messages; ++_index) {
+            const std::chrono::steady_clock::time_point _time = _start + interval * _index + interval / 2;
+            sleep_until_absolute(_time);
+            _sleeps.record(latency_class::scheduled, std::chrono::steady_clock::now() - _time);
+        }
+    });
+    for (std::size_t _index = 0; _index < messages; ++_index) {
+        const unsigned char _note[3] = { 0x90, static_cast<unsigned char>(36 + _index % 61), static_cast<unsigned char>(_index & 1 ? 0 : 100) };
+        while (!send_to_hardware_output_at(0, _start + interval * _index, _note, sizeof(_note))) {
+            std::this_thread::yield();
+        }
+    }
+    _sleeper.join();
+    std::this_thread::sleep_until(_start + interval * messages + std::chrono::milliseconds(50));
+    scheduled_jitter _jitter;
+    _jitter.sends = get_latency_report(0)[static_cast<std::size_t>(latency_class::scheduled)];
+    _jitter.sleeps = _sleeps.get_snapshot(latency_class::scheduled);
+    close_hardware_output(0);
+    for (std::size_t _bucket = 0; _bucket < _jitter.sends.counts.size(); ++_bucket) {
+        _jitter.sends.counts[_bucket] -= _before.counts[_bucket];
+    }
+    _jitter.sends.total -= _before.total;
+    return _jitter;
+}
+
+[[nodiscard]] static std::vector<double> bench_alignment(const bool is_automatic, const std::size_t notes, const std::chrono::microseconds interval)
+{
+    // one virtual input layered on a DX7 over DIN and a slower USB module, how far apart each note sounds on both
+    const std::array<output_pacing, 2> _pacings = { output_pacing(), get_unlimited_pacing() };
+    const std::array<output_compensation, 2> _compensations = { output_compensation { {}, std::chrono::milliseconds(1) }, output_compensation { {}, std::chrono::milliseconds(4) } };
+    std::array<std::vector<std::chrono::steady_clock::time_point>, 2> _stamps;
+    midi_loopback _input = create_loopback();
+    std::vector<midi_route> _routes(2);
+    _routes[1].output = 1;
+    set_midi_routes(_routes);
+    set_hardware_output_alignment(is_automatic, std::chrono::microseconds(250));
+    for (std::size_t _output = 0; _output < _stamps.size(); ++_output) {
+        _stamps[_output].reserve(notes * 2);
+        set_hardware_output_pacing(_output, _pacings[_output]);
+        set_hardware_output_compensation(_output, _compensations[_output]);
+        open_hardware_output(_output, std::make_unique<stamping_output_transport>(_stamps[_output]));
+    }
+    open_virtual_input(0, std::move(_input.input));
+    for (std::size_t _index = 0; _index < notes; ++_index) {
+        const unsigned char _note[3] = { 0x90, static_cast<unsigned char>(36 + _index % 61), static_cast<unsigned char>(_index & 1 ? 0 : 100) };
+        _input.output->send(_note, sizeof(_note));
+        std::this_thread::sleep_for(interval);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    close_virtual_input(0);
+    close_hardware_outputs();
+    set_hardware_output_alignment(false, std::chrono::steady_clock::duration::zero());
+    for (std::size_t _output = 0; _output < _stamps.size(); ++_output) {
+        set_hardware_output_pacing(_output, output_pacing());
+        set_hardware_output_compensation(_output, output_compensation());
+    }
+    set_midi_routes({ midi_route() });
+
+    std::vector<double> _skews;
+    for (std::size_t _index = 0; _index < std::min({ notes, _stamps[0].size(), _stamps[1].size() }); ++_index) {
+        std::array<double, 2> _sound_times = {};
+        for (std::size_t _output = 0; _output < _stamps.size(); ++_output) {
+            const double _wire_time = 3.0 / _pacings[_output].bytes_per_millisecond;
+            const double _device_latency = std::chrono::duration<double, std::milli>(_compensations[_output].device_latency).count();
+            _sound_times[_output] = std::chrono::duration<double, std::milli>(_stamps[_output][_index].time_since_epoch()).count() + _wire_time + _device_latency;
+        }
+        _skews.push_back(std::abs(_sound_times[0] - _sound_times[1]));
+    }
+    std::sort(_skews.begin(), _skews.end());
+    return _skews;
+}
+
+[[nodiscard]] static std::vector<double> bench_clock(const midi_clock_mode mode, const std::size_t ticks, const std::chrono::microseconds input_jitter)
+{
+    // 120 BPM clock arriving late by up to the input jitter, how far each interval between two ticks leaving the output is from 20.833 ms
+    const std::chrono::duration<double> _period(60.0 / (24.0 * 120.0));
+    std::vector<std::chrono::steady_clock::time_point> _stamps;
+    _stamps.reserve(ticks * 2);
+    midi_loopback _input = create_loopback();
+    set_midi_routes({ midi_route() });
+    set_hardware_output_pacing(0, get_unlimited_pacing());
+    open_hardware_output(0, std::make_unique<stamping_output_transport>(_stamps));
+    open_virtual_input(0, std::move(_input.input));
+    midi_clock_settings _settings;
+    _settings.mode = mode;
+    set_midi_clock(_settings);
+    std::mt19937 _random(7);
+    std::uniform_int_distribution<std::int64_t> _lateness(0, input_jitter.count());
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+    for (std::size_t _tick = 0; _tick < ticks; ++_tick) {
+        const std::chrono::steady_clock::time_point _time = _start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(_period * static_cast<double>(_tick));
+        std::this_thread::sleep_until(_time + std::chrono::microseconds(_lateness(_random)));
+        if (mode != midi_clock_mode::master) {
+            const unsigned char _clock = 0xF8;
+            _input.output->send(&_clock, 1);
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    set_midi_clock(midi_clock_settings());
+    close_virtual_input(0);
+    close_hardware_output(0);
+
+    std::vector<double> _errors;
+    const double _period_milliseconds = std::chrono::duration<double, std::milli>(_period).count();
+    for (std::size_t _index = 1; _index < std::min(_stamps.size(), ticks); ++_index) {
+        _errors.push_back(std::abs(std::chrono::duration<double, std::milli>(_stamps[_index] - _stamps[_index - 1]).count() - _period_milliseconds));
+    }
+    std::sort(_errors.begin(), _errors.end());
+    return _errors;
+}
+
+[[nodiscard]] static std::size_t bench_note_release(const std::size_t channels, const std::size_t notes_per_channel)
+{
+    // bytes sent to stop the held notes when the port goes away, on a raw byte transport with running status
+    output_scheduler _scheduler(get_unlimited_pacing());
+    null_output_transport _transport;
+    const output_scheduler::clock::time_point _now = output_scheduler::clock::now();
+    for (std::size_t _channel = 0; _channel < channels; ++_channel) {
+        for (std::size_t _note = 0; _note < notes_per_channel; ++_note) {
+            const unsigned char _message[3] = { static_cast<unsigned char>(0x90 | _channel), static_cast<unsigned char>(48 + _note * 2), 100 };
+            _scheduler.push(_message, sizeof(_message), _now);
+        }
+    }
+    _scheduler.flush(_now, _transport);
+    return _scheduler.release_notes(_now, _transport);
+}
+
+[[nodiscard]] static std::vector<unsigned char> make_single_voice(const std::size_t seed)
+{
+    // F0 43 00 00 01 1B [155 bytes, name last] checksum F7
+    std::vector<unsigned char> _voice = { 0xF0, 0x43, 0x00, 0x00, 0x01, 0x1B };
+    unsigned int _sum = 0;
+    for (std::size_t _index = 0; _index < 155; ++_index) {
+        const unsigned char _byte = _index < 145 ? static_cast<unsigned char>((_index * 7 + seed) % 100) : static_cast<unsigned char>('A' + (seed + _index) % 26);
+        _voice.push_back(_byte);
+        _sum += _byte;
+    }
+    _voice.push_back(static_cast<unsigned char>((128 - (_sum & 0x7F)) & 0x7F));
+    _voice.push_back(0xF7);
+    return _voice;
+}
+
+static void write_library_file(const std::filesystem::path& path, const std::size_t seed)
+{
+    // one file in four is a 32 voice bank, the others single voices
+    const std::vector<unsigned char> _bytes = seed % 4 == 0 ? make_bank_dump(static_cast<unsigned char>(seed)) : make_single_voice(seed);
+    std::ofstream _stream(path, std::ios::binary | std::ios::trunc);
+    _stream.write(reinterpret_cast<const char*>(_bytes.data()), static_cast<std::streamsize>(_bytes.size()));
+}
+
+[[nodiscard]] static std::filesystem::path get_library_file_path(const std::filesystem::path& root, const std::size_t file)
+{
+    return root / ("group" + std::to_string(file / 10000)) / ("folder" + std::to_string(file / 100)) / ("voice" + std::to_string(file) + ".syx");
+}
+
+[[nodiscard]] static std::filesystem::path make_library(const std::size_t files)
+{
+    // 100 files per folder and 100 folders per group, written once and reused by later runs
+    const std::filesystem::path _root = std::filesystem::temp_directory_path() / ("midibridge_bench_library_" + std::to_string(files));
+    if (std::filesystem::exists(_root / "complete")) {
+        return _root;
+    }
+    std::filesystem::remove_all(_root);
+    for (std::size_t _file = 0; _file < files; ++_file) {
+        const std::filesystem::path _path = get_library_file_path(_root, _file);
+        if (_file % 100 == 0) {
+            std::filesystem::create_directories(_path.parent_path());
+        }
+        write_library_file(_path, _file);
+    }
+    std::ofstream(_root / "complete").put('1');
+    return _root;
+}
+
+template <typename Function>
+[[nodiscard]] static double measure_milliseconds(Function&& function)
+{
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+}
+
+static void print_library_index(const char* stage, const double milliseconds, const library_index& index)
+{
+    std::printf("%-28s %10.1f %8zu %8zu %10zu %10zu %10zu\n", stage, milliseconds, index.banks.size(), index.patches.size(),
+        index.statistics.listed_directories, index.statistics.checked_files, index.statistics.parsed_banks);
+}
+
+static void bench_library(const std::size_t files)
+{
+    const std::filesystem::path _root = make_library(files);
+    const std::filesystem::path _index_path = _root.parent_path() / (_root.filename().string() + ".idx");
+    std::printf("%-28s %10s %8s %8s %10s %10s %10s\n", "library start", "ms", "banks", "patches", "listed", "checked", "parsed");
+
+    std::vector<std::filesystem::path> _banks;
+    const double _walk = measure_milliseconds([&] { _banks = load_sysex_banks_recursive(_root); });
+    std::printf("%-28s %10.1f %8zu %8s %10s %10s %10s\n", "walk (previous start)", _walk, _banks.size(), "-", "-", "-", "-");
+    std::size_t _patches = 0;
+    const double _parse = measure_milliseconds([&] {
+        for (const std::filesystem::path& _bank : load_sysex_banks_recursive(_root)) {
+            _patches += load_sysex_patches(_bank).size();
+        }
+    });
+    std::printf("%-28s %10.1f %8zu %8zu %10s %10s %10s\n", "walk and load every bank", _parse, _banks.size(), _patches, "-", "-", "-");
+
+    std::filesystem::remove(_index_path);
+    library_index _index;
+    print_library_index("index cold", measure_milliseconds([&] { _index = load_library_index(_root, _index_path); }), _index);
+    print_library_index("index warm", measure_milliseconds([&] { _index = load_library_index(_root, _index_path); }), _index);
+    for (std::size_t _file = 0; _file < files; _file += 100) {
+        // rewritten with other content, the folders keep their entries
+        write_library_file(get_library_file_path(_root, _file), _file + 1);
+    }
+    print_library_index("index warm, 1% rewritten", measure_milliseconds([&] { _index = load_library_index(_root, _index_path); }), _index);
+    for (std::size_t _file = 0; _file < files; _file += 100) {
+        write_library_file(get_library_file_path(_root, _file), _file);
+    }
+
+    // cold and warm scans over pool sizes, with the time until the first bank reached the feed
+    std::printf("\n%-10s %10s %10s %14s %10s\n", "threads", "cold ms", "warm ms", "first bank ms", "same index");
+    std::string _strings;
+    for (const std::size_t _threads : { 1, 2, 4, 8 }) {
+        std::filesystem::remove(_index_path);
+        library_scan_feed _feed;
+        std::atomic<bool> _is_done = false;
+        double _first = -1.0;
+        const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+        std::thread _watcher([&] {
+            while (!_is_done.load()) {
+                {
+                    std::lock_guard<std::mutex> _lock_guard(_feed.mutex);
+                    if (!_feed.banks.empty()) {
+                        _first = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+                        return;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+        library_index _cold = load_library_index(_root, _index_path, _threads, &_feed);
+        const double _cold_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+        _is_done.store(true);
+        _watcher.join();
+        if (_threads == 1) {
+            _strings = _cold.strings;
+        }
+        const double _warm_milliseconds = measure_milliseconds([&] { _index = load_library_index(_root, _index_path, _threads); });
+        std::printf("%-10zu %10.1f %10.1f %14.2f %10s\n", _threads, _cold_milliseconds, _warm_milliseconds, _first, _cold.strings == _strings ? "yes" : "no");
+    }
+    std::printf("hardware threads %u\n", std::thread::hardware_concurrency());
+
+    std::error_code _error;
+    std::printf("index file %.1f MB for %zu files\n", static_cast<double>(std::filesystem::file_size(_index_path, _error)) / (1024.0 * 1024.0), files);
+}
+
+
+[[nodiscard]] static double draw_headless_frame(const std::chrono::microseconds merge_budget)
+{
+    // the library window without a backend, what the frame costs on the CPU before it is presented
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+    ImGui::NewFrame();
+    ImGui::SetNextWindowPos(ImVec2(0, 0));
+    ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
+    if (ImGui::Begin("Library", nullptr, ImGuiWindowFlags_NoDecoration)) {
+        draw_library_view(merge_budget);
+    }
+    ImGui::End();
+    ImGui::Render();
+    const double _milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+    // the rest of a 60 Hz frame, as if waiting for the swap chain
+    std::this_thread::sleep_for(std::chrono::microseconds(16667) - std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start));
+    return _milliseconds;
+}
+
+/// @brief Fails the bench if a frame of a stage took longer than a 60 Hz frame
+static void check_frames(const char* stage, const std::vector<double>& frames)
+{
+    static constexpr double frame_budget_milliseconds = 16.0;
+    const double _slowest = frames.empty() ? 0.0 : *std::max_element(frames.begin(), frames.end());
+    if (_slowest > frame_budget_milliseconds) {
+        report_failure(std::string(stage) + " took " + std::to_string(_slowest) + " ms in a frame, over the 16 ms budget");
+    }
+}
+
+static void print_frames(const char* stage, std::vector<double> frames)
+{
+    std::sort(frames.begin(), frames.end());
+    std::printf("%-34s %8zu %10.2f %10.2f %10.2f\n", stage, frames.size(), frames[frames.size() / 2], frames[frames.size() * 99 / 100], frames.back());
+}
+
+static void bench_library_view(const std::size_t voices)
+{
+    // one compilation of 32 voice banks, each voice unpacked to a single voice message when the bank is opened
+    const std::filesystem::path _root = std::filesystem::temp_directory_path() / ("midibridge_bench_view_" + std::to_string(voices));
+    const std::filesystem::path _index_path = _root.parent_path() / (_root.filename().string() + ".idx");
+    std::filesystem::create_directories(_root);
+    {
+        std::ofstream _stream(_root / "compilation.syx", std::ios::binary | std::ios::trunc);
+        for (std::size_t _bank = 0; _bank < (voices + 31) / 32; ++_bank) {
+            const std::vector<unsigned char> _bytes = make_bank_dump(static_cast<unsigned char>(_bank));
+            _stream.write(reinterpret_cast<const char*>(_bytes.data()), static_cast<std::streamsize>(_bytes.size()));
+        }
+    }
+    std::filesystem::remove(_index_path);
+
+    ImGui::CreateContext();
+    ImGuiIO& _io = ImGui::GetIO();
+    _io.DisplaySize = ImVec2(1280, 800);
+    _io.DeltaTime = 1.f / 60.f;
+    _io.IniFilename = nullptr;
+    _io.Fonts->Build();
+
+    std::vector<double> _frames;
+    start_library_scan(_root, _index_path);
+    while (is_library_scanning()) {
+        _frames.push_back(draw_headless_frame(std::chrono::microseconds(2000)));
+    }
+    std::printf("%-34s %8s %10s %10s %10s\n", "library view frames", "frames", "p50 ms", "p99 ms", "max ms");
+    print_frames("scan", _frames);
+
+    library_index _index = load_library_index(_root, _index_path);
+    std::vector<sysex_patch> _patches;
+    const double _copied = measure_milliseconds([&] { _patches = load_sysex_patches(get_library_bank_path(_index, 0)); });
+    std::printf("%-34s %8s %10.2f %10s %10s\n", "copied load in the frame (previous)", "1", _copied, "-", "-");
+    _patches.clear();
+    sysex_bank _bank;
+    const double _mapped = measure_milliseconds([&] { _bank = load_library_bank(_index, 0); });
+    std::printf("%-34s %8s %10.2f %10s %10s\n", "mapped load in the frame", "1", _mapped, "-", "-");
+
+    _frames.clear();
+    select_library_bank(0);
+    for (int _frame = 0; _frame < 2; ++_frame) {
+        _frames.push_back(draw_headless_frame(std::chrono::microseconds(2000)));
+    }
+    select_library_bank(-1);
+    for (int _frame = 0; _frame < 4; ++_frame) {
+        _frames.push_back(draw_headless_frame(std::chrono::microseconds(2000)));
+    }
+    print_frames("open and cancel after 2 frames", _frames);
+    check_frames("open and cancel after 2 frames", _frames);
+
+    _frames.clear();
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+    select_library_bank(0);
+    while (!is_library_bank_loaded()) {
+        _frames.push_back(draw_headless_frame(std::chrono::microseconds(2000)));
+    }
+    const double _loaded = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+    print_frames("open bank in the background", _frames);
+    check_frames("open bank in the background", _frames);
+
+    _frames.clear();
+    for (int _frame = 0; _frame < 60; ++_frame) {
+        _frames.push_back(draw_headless_frame(std::chrono::microseconds(2000)));
+    }
+    print_frames("bank open", _frames);
+    std::printf("%zu voices in view after %.1f ms\n", _index.banks.empty() ? 0 : std::size_t(_index.banks[0].patch_count), _loaded);
+
+    select_library_bank(-1);
+    ImGui::DestroyContext();
+}
+
+[[nodiscard]] static double get_resident_megabytes(const char* field)
+{
+    // VmRSS or VmHWM of /proc/self/status, 0 where there is none
+    std::ifstream _stream("/proc/self/status");
+    std::string _line;
+    while (std::getline(_stream, _line)) {
+        if (_line.rfind(field, 0) == 0) {
+            return std::strtod(_line.c_str() + std::strlen(field) + 1, nullptr) / 1024.0;
+        }
+    }
+    return 0.0;
+}
+
+static void reset_peak_resident()
+{
+    // Linux 4.0 and later, the peak starts again from the current resident size
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+template <typename Load>
+static void print_bank_memory(const char* stage, Load&& load)
+{
+    reset_peak_resident();
+    const double _resident = get_resident_megabytes("VmRSS:");
+    const double _anonymous = get_resident_megabytes("RssAnon:");
+    const double _file = get_resident_megabytes("RssFile:");
+    const std::uint64_t _allocations = allocation_count.load();
+    const std::uint64_t _bytes = allocation_bytes.load();
+    const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+    const auto _loaded = load();
+    const double _milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+    std::printf("%-24s %8zu %8.1f %12llu %9.1f %9.1f %9.1f %9.1f\n", stage, _loaded.size(), _milliseconds,
+        static_cast<unsigned long long>(allocation_count.load() - _allocations),
+        static_cast<double>(allocation_bytes.load() - _bytes) / (1024.0 * 1024.0),
+        get_resident_megabytes("RssAnon:") - _anonymous,
+        get_resident_megabytes("RssFile:") - _file,
+        get_resident_megabytes("VmHWM:") - _resident);
+}
+
+static void bench_bank_memory(const std::size_t voices)
+{
+    // the same count of voices as 32 voice bank dumps and as single voice messages, loaded packed only, mapped as the
+    // library holds them and copied
+    const std::filesystem::path _root = std::filesystem::temp_directory_path() / ("midibridge_bench_memory_" + std::to_string(voices));
+    std::filesystem::create_directories(_root);
+    const std::filesystem::path _banks = _root / "banks.syx";
+    const std::filesystem::path _singles = _root / "singles.syx";
+    {
+        std::ofstream _stream(_banks, std::ios::binary | std::ios::trunc);
+        for (std::size_t _bank = 0; _bank < (voices + 31) / 32; ++_bank) {
+            const std::vector<unsigned char> _bytes = make_bank_dump(static_cast<unsigned char>(_bank));
+            _stream.write(reinterpret_cast<const char*>(_bytes.data()), static_cast<std::streamsize>(_bytes.size()));
+        }
+    }
+    {
+        std::ofstream _stream(_singles, std::ios::binary | std::ios::trunc);
+        for (std::size_t _voice = 0; _voice < voices; ++_voice) {
+            const std::vector<unsigned char> _bytes = make_single_voice(_voice);
+            _stream.write(reinterpret_cast<const char*>(_bytes.data()), static_cast<std::streamsize>(_bytes.size()));
+        }
+    }
+    std::printf("%-24s %8s %8s %12s %9s %9s %9s %9s\n", "bank memory", "patches", "ms", "allocations", "alloc MB", "anon MB", "file MB", "peak MB");
+    for (const std::filesystem::path& _path : { _banks, _singles }) {
+        // copied last, the heap it frees is kept by the allocator and would hide the growth of the next one
+        const std::string _name = _path.stem().string();
+        print_bank_memory((_name + ", packed").c_str(), [&] { return load_dx7_voice_bank(_path); });
+        print_bank_memory((_name + ", library").c_str(), [&] { return load_sysex_bank(_path); });
+        print_bank_memory((_name + ", copied").c_str(), [&] { return load_sysex_patches(_path); });
+    }
+    std::printf("anon and file are the resident growth while the bank is loaded, file pages are shared with the file cache\n");
+}
+}
+
+void* operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* _pointer = std::malloc(size ? size : 1)) {
+        return _pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+static void print_usage()
+{
+    std::printf("usage: midibridge_bench [recorded stream...]\n"
+                "       midibridge_bench --library [banks]\n"
+                "       midibridge_bench --memory [banks]\n"
+                "       midibridge_bench --view [banks]\n");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2 && (std::string(argv[1]) == "--help" || std::string(argv[1]) == "-h")) {
+        print_usage();
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--library") {
+        bench_library(argc >= 3 ? static_cast<std::size_t>(std::strtoull(argv[2], nullptr, 10)) : 100000);
+        return failure_count ? 1 : 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--memory") {
+        bench_bank_memory(argc >= 3 ? static_cast<std::size_t>(std::strtoull(argv[2], nullptr, 10)) : 100000);
+        return failure_count ? 1 : 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--view") {
+        bench_library_view(argc >= 3 ? static_cast<std::size_t>(std::strtoull(argv[2], nullptr, 10)) : 10000);
+        return failure_count ? 1 : 0;
+    }
+    std::vector<bench_stream> _streams = { make_dense_notes(), make_running_status_flood(), make_bank_dumps(), make_realtime_in_sysex() };
+    for (int _index = 1; _index < argc; ++_index) {
+        if (argv[_index][0] == '-') {
+            std::fprintf(stderr, "unknown option %s\n", argv[_index]);
+            print_usage();
+            return 2;
+        }
+        _streams.push_back(read_recorded_stream(argv[_index]));
+    }
+
+    std::printf("%-10s %-26s %14s %14s %12s %10s\n", "stage", "stream", "messages/s", "bytes/s", "allocs/msg", "cycles/B");
+    for (const bench_stream& _stream : _streams) {
+        const std::size_t _repeats = std::max<std::size_t>(1, (std::size_t(64) << 20) / std::max<std::size_t>(1, _stream.bytes.size()));
+        print_result("vector rx", _stream.name, bench_vector_receive(_stream, _repeats));
+        print_result("span rx", _stream.name, bench_span_receive(_stream, _repeats));
+        print_result("old split", _stream.name, bench_split_and_send(_stream, _repeats));
+        print_result("parser", _stream.name, bench_parser(_stream, _repeats));
+        print_result("transform", _stream.name, bench_transform(_stream, _repeats));
+        print_result("scheduler", _stream.name, bench_scheduler(_stream, _repeats));
+        print_result("router", _stream.name, bench_router(_stream, std::max<std::size_t>(1, _repeats / 16)));
+        midi_route _transformed_route;
+        _transformed_route.transforms = make_dx7_transforms();
+        print_result("router lut", _stream.name, bench_router(_stream, std::max<std::size_t>(1, _repeats / 16), { _transformed_route }));
+        // a plain and a transformed output on the same input, each keeps batching the messages of a packet
+        midi_route _mixed_route = _transformed_route;
+        _mixed_route.output = 1;
+        print_result("router mix", _stream.name, bench_router(_stream, std::max<std::size_t>(1, _repeats / 16), { midi_route(), _mixed_route }));
+        print_result("return", _stream.name, bench_router(_stream, std::max<std::size_t>(1, _repeats / 16), { midi_route() }, true));
+    }
+    std::printf("\n%-26s %14s %14s %10s %12s\n", "running status", "bytes before", "bytes after", "saved", "DIN ms saved");
+    for (const bench_stream& _stream : _streams) {
+        const std::uint64_t _before = bench_wire_bytes(_stream, false);
+        const std::uint64_t _after = bench_wire_bytes(_stream, true);
+        std::printf("%-26s %14llu %14llu %9.1f%% %12.1f\n",
+            _stream.name.c_str(),
+            static_cast<unsigned long long>(_before),
+            static_cast<unsigned long long>(_after),
+            _before ? 100.0 * static_cast<double>(_before - _after) / static_cast<double>(_before) : 0.0,
+            static_cast<double>(_before - _after) / output_pacing().bytes_per_millisecond);
+    }
+
+    std::printf("\nlibrary send of a %zu byte bank dump, end to end: %.0f ns as bytes, %.0f ns as a shared blob\n",
+        make_bank_dump(0).size(),
+        bench_library_send(false, 20000),
+        bench_library_send(true, 20000));
+
+    const scheduled_jitter _jitter = bench_scheduled_jitter(2000, std::chrono::microseconds(1000));
+    std::printf("\n%-34s %10s %10s %10s %10s\n", "lateness over 2000 notes 1 ms apart", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (const std::pair<const char*, const latency_snapshot*> _row : { std::make_pair("scheduled sends", &_jitter.sends), std::make_pair("bare absolute sleeps", &_jitter.sleeps) }) {
+        std::printf("%-34s %10.1f %10.1f %10.1f %10.1f\n",
+            _row.first,
+            _row.second->get_percentile(0.5) / 1000.0,
+            _row.second->get_percentile(0.99) / 1000.0,
+            _row.second->get_percentile(0.999) / 1000.0,
+            _row.second->max_nanoseconds / 1000.0);
+    }
+    // the output thread may add 200 us to what a bare sleep gets on this machine, a loaded or virtual CPU wakes late,
+    // and two buckets of the histograms when that is milliseconds
+    const std::uint64_t _sleep_p99 = _jitter.sleeps.get_percentile(0.99);
+    if (_jitter.sends.get_percentile(0.99) > _sleep_p99 + 200000 + _sleep_p99 / 8) {
+        report_failure("scheduled send lateness p99 is " + std::to_string(_jitter.sends.get_percentile(0.99) / 1000.0) + " us, over 200 us more than the "
+            + std::to_string(_sleep_p99 / 1000.0) + " us of a bare sleep");
+    }
+
+    std::printf("\n%-10s %14s %14s %14s\n", "alignment", "p50 skew ms", "p99 skew ms", "max skew ms");
+    for (const bool _is_automatic : { false, true }) {
+        const std::vector<double> _skews = bench_alignment(_is_automatic, 400, std::chrono::milliseconds(5));
+        if (!_skews.empty()) {
+            std::printf("%-10s %14.3f %14.3f %14.3f\n", _is_automatic ? "automatic" : "off", _skews[_skews.size() / 2], _skews[_skews.size() * 99 / 100], _skews.back());
+        }
+    }
+
+    std::printf("\n%-10s %14s %14s %14s\n", "clock", "p50 error ms", "p99 error ms", "max error ms");
+    std::array<double, 3> _clock_medians = {};
+    for (const auto& _mode : { std::pair<const char*, midi_clock_mode>("through", midi_clock_mode::through), { "follow", midi_clock_mode::follow }, { "master", midi_clock_mode::master } }) {
+        const std::vector<double> _errors = bench_clock(_mode.second, 240, std::chrono::microseconds(2000));
+        if (!_errors.empty()) {
+            std::printf("%-10s %14.3f %14.3f %14.3f\n", _mode.first, _errors[_errors.size() / 2], _errors[_errors.size() * 99 / 100], _errors.back());
+            _clock_medians[static_cast<std::size_t>(_mode.second)] = _errors[_errors.size() / 2];
+        }
+    }
+    // the median shows the input jitter the loop removes, the tail mostly how late the system wakes the threads
+    if (!(_clock_medians[static_cast<std::size_t>(midi_clock_mode::follow)] < _clock_medians[static_cast<std::size_t>(midi_clock_mode::through)])) {
+        report_failure("followed clock median error is " + std::to_string(_clock_medians[static_cast<std::size_t>(midi_clock_mode::follow)]) + " ms, not below the "
+            + std::to_string(_clock_medians[static_cast<std::size_t>(midi_clock_mode::through)]) + " ms of the clock passed through");
+    }
+
+    std::printf("\n%-8s %-8s %16s %16s %16s\n", "channels", "notes", "released bytes", "sweep bytes", "DIN ms saved");
+    for (const auto& _held : { std::pair<std::size_t, std::size_t>(1, 0), { 1, 1 }, { 1, 10 }, { 4, 10 }, { 16, 10 } }) {
+        const std::size_t _released = bench_note_release(_held.first, _held.second);
+        const double _saved = static_cast<double>(active_notes::full_sweep_bytes - _released) / output_pacing().bytes_per_millisecond;
+        std::printf("%-8zu %-8zu %16zu %16zu %16.1f\n", _held.first, _held.second, _released, active_notes::full_sweep_bytes, _saved);
+    }
+
+    const std::vector<std::vector<unsigned char>> _messages = split_packets(make_dense_notes());
+    std::printf("\n%-8s %16s %16s\n", "routes", "table ns/msg", "rule list ns/msg");
+    for (std::size_t _count = 1; _count <= routing_table::max_outputs; _count *= 2) {
+        const std::vector<midi_route> _routes = make_routes(_count);
+        std::printf("%-8zu %16.2f %16.2f\n", _count, bench_dispatch(_routes, true, _messages), bench_dispatch(_routes, false, _messages));
+    }
+    return failure_count ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+#include "clock.hpp"
+
+#include <cmath>
+
+midi_clock_tracker::midi_clock_tracker(const double bandwidth)
+{
+    // second order loop critically damped, as in Adriaensen's "Using a DLL to filter time"
+    const double _omega = 2.0 * 3.14159265358979323846 * bandwidth;
+    _b = std::sqrt(2.0) * _omega;
+    _c = _omega * _omega;
+}
+
+void midi_clock_tracker::receive(const clock::time_point time)
+{
+    const double _time = std::chrono::duration<double, std::nano>(time - _origin).count();
+    _last_received = time;
+    if (_received == 0 || _is_stopped || (_period > 0 && _time - _filtered > stall_periods * _period)) {
+        // first tick of a run is sent as soon as it comes in, the period is kept for the tempo until the next tick
+        _origin = time;
+        _filtered = 0;
+        _predicted = 0;
+        _sent = _received;
+        _received += 1;
+        _is_stopped = false;
+        _period = _received == 1 ? 0 : _period;
+        return;
+    }
+    if (_predicted == 0) {
+        _period = _time - _filtered;
+        _filtered = _time;
+        _predicted = _time + _period;
+        ++_received;
+        return;
+    }
+    const double _error = _time - _predicted;
+    _filtered = _predicted;
+    _predicted += _b * _error + _period;
+    _period += _c * _error;
+    ++_received;
+}
+
+bool midi_clock_tracker::has_next(const clock::time_point now) const
+{
+    if (_sent < _received) {
+        return true;
+    }
+    const double _silence = std::chrono::duration<double, std::nano>(now - _last_received).count();
+    return !_is_stopped && _sent == _received && _predicted > 0 && _silence <= prediction_periods * _period;
+}
+
+midi_clock_tracker::clock::time_point midi_clock_tracker::get_next_time() const
+{
+    // behind the received ticks only when a tick came in before the time predicted for it
+    const double _time = _sent < _received ? _filtered - static_cast<double>(_received - _sent - 1) * _period : _predicted;
+    return _origin + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::nano>(_time));
+}
+
+void midi_clock_tracker::send()
+{
+    ++_sent;
+}
+
+midi_clock_tracker::clock::duration midi_clock_tracker::get_period() const
+{
+    return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::nano>(_period));
+}
+
+void midi_clock_tracker::stop()
+{
+    _is_stopped = true;
+}
+
+void midi_clock_tracker::reset()
+{
+    _is_stopped = false;
+    _received = 0;
+    _sent = 0;
+    _filtered = 0;
+    _predicted = 0;
+    _period = 0;
+}
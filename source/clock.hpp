@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+/// @brief Follows incoming MIDI clock ticks with a delay-locked loop and tells when to send each regenerated tick
+/// @details Ticks are sent at the times the loop predicted for them, so the jitter of the thread receiving them is
+/// filtered out while the count of ticks sent stays locked to the count received. At most one tick is predicted
+/// ahead, never after stop() and never once the input has been silent for longer than a period and a half, so a
+/// stopped sequencer gets no stray tick. The loop starts over after a pause of a few ticks. Only used from one thread.
+class midi_clock_tracker {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /// @brief Creates a tracker with a loop bandwidth in cycles per tick, lower is smoother and slower to follow tempo changes
+    explicit midi_clock_tracker(const double bandwidth = 0.02);
+
+    /// @brief Follows one incoming tick received at the time
+    void receive(const clock::time_point time);
+
+    /// @brief Gets if a tick is waiting to be sent at the time, received or predicted
+    [[nodiscard]] bool has_next(const clock::time_point now) const;
+
+    /// @brief Gets when the next tick has to be sent, only valid if has_next returns true
+    [[nodiscard]] clock::time_point get_next_time() const;
+
+    /// @brief Counts the next tick as sent
+    void send();
+
+    /// @brief Gets the time between ticks the loop locked on, zero until two ticks came in
+    [[nodiscard]] clock::duration get_period() const;
+
+    /// @brief Drops the predicted tick, ticks received are still sent and the next one starts the loop over
+    void stop();
+
+    /// @brief Forgets every tick received
+    void reset();
+
+private:
+    static constexpr double stall_periods = 4.0; // pause after which the loop starts over
+    static constexpr double prediction_periods = 1.5; // silence of the input after which no tick is predicted
+
+    double _b = 0;
+    double _c = 0;
+    clock::time_point _origin = {};
+    clock::time_point _last_received = {};
+    std::uint64_t _received = 0;
+    std::uint64_t _sent = 0;
+    double _filtered = 0; // filtered time of the last tick received, in nanoseconds from the origin
+    double _predicted = 0; // predicted time of the next tick
+    double _period = 0;
+    bool _is_stopped = false;
+};
@@ -0,0 +1,138 @@
+#include "latency.hpp"
+
+#include <cereal/archives/json.hpp>
+#include <cereal/types/string.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+namespace {
+
+[[nodiscard]] static double to_microseconds(const std::uint64_t nanoseconds)
+{
+    return static_cast<double>(nanoseconds) / 1000.0;
+}
+
+[[nodiscard]] static std::size_t get_highest_bit(std::uint64_t value)
+{
+    std::size_t _bit = 0;
+    while (value >>= 1) {
+        ++_bit;
+    }
+    return _bit;
+}
+
+}
+
+void latency_snapshot::merge(const latency_snapshot& other)
+{
+    for (std::size_t _bucket = 0; _bucket < bucket_count; ++_bucket) {
+        counts[_bucket] += other.counts[_bucket];
+    }
+    total += other.total;
+    max_nanoseconds = std::max(max_nanoseconds, other.max_nanoseconds);
+}
+
+std::uint64_t latency_snapshot::get_percentile(const double fraction) const
+{
+    if (total == 0) {
+        return 0;
+    }
+    const std::uint64_t _rank = static_cast<std::uint64_t>(fraction * static_cast<double>(total - 1)) + 1;
+    std::uint64_t _count = 0;
+    for (std::size_t _bucket = 0; _bucket < bucket_count; ++_bucket) {
+        _count += counts[_bucket];
+        if (_count >= _rank) {
+            const std::uint64_t _floor = latency_histograms::get_bucket_floor(_bucket);
+            const std::uint64_t _ceiling = _bucket + 1 < bucket_count ? latency_histograms::get_bucket_floor(_bucket + 1) : _floor;
+            return std::min(_floor + (_ceiling - _floor) / 2, max_nanoseconds);
+        }
+    }
+    return max_nanoseconds;
+}
+
+void latency_histograms::record(const latency_class message_class, const std::chrono::steady_clock::duration latency)
+{
+    const std::uint64_t _nanoseconds = static_cast<std::uint64_t>(std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count()));
+    histogram& _histogram = _histograms[static_cast<std::size_t>(message_class)];
+    _histogram.counts[get_bucket(_nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    if (_nanoseconds > _histogram.max_nanoseconds.load(std::memory_order_relaxed)) {
+        _histogram.max_nanoseconds.store(_nanoseconds, std::memory_order_relaxed); // single writer
+    }
+}
+
+latency_snapshot latency_histograms::get_snapshot(const latency_class message_class) const
+{
+    const histogram& _histogram = _histograms[static_cast<std::size_t>(message_class)];
+    latency_snapshot _snapshot;
+    for (std::size_t _bucket = 0; _bucket < latency_snapshot::bucket_count; ++_bucket) {
+        _snapshot.counts[_bucket] = _histogram.counts[_bucket].load(std::memory_order_relaxed);
+        _snapshot.total += _snapshot.counts[_bucket];
+    }
+    _snapshot.max_nanoseconds = _histogram.max_nanoseconds.load(std::memory_order_relaxed);
+    return _snapshot;
+}
+
+std::size_t latency_histograms::get_bucket(const std::uint64_t nanoseconds)
+{
+    // values below 16 get their own bucket, above that every power of two is split in 16 linear sub buckets
+    if (nanoseconds < latency_snapshot::sub_bucket_count) {
+        return static_cast<std::size_t>(nanoseconds);
+    }
+    const std::size_t _exponent = get_highest_bit(nanoseconds);
+    const std::size_t _sub_bucket = static_cast<std::size_t>(nanoseconds >> (_exponent - latency_snapshot::sub_bucket_bits)) - latency_snapshot::sub_bucket_count;
+    return (_exponent - latency_snapshot::sub_bucket_bits + 1) * latency_snapshot::sub_bucket_count + _sub_bucket;
+}
+
+std::uint64_t latency_histograms::get_bucket_floor(const std::size_t bucket)
+{
+    if (bucket < latency_snapshot::sub_bucket_count) {
+        return bucket;
+    }
+    const std::size_t _exponent = bucket / latency_snapshot::sub_bucket_count + latency_snapshot::sub_bucket_bits - 1;
+    const std::uint64_t _sub_bucket = bucket % latency_snapshot::sub_bucket_count;
+    return (latency_snapshot::sub_bucket_count + _sub_bucket) << (_exponent - latency_snapshot::sub_bucket_bits);
+}
+
+const char* get_latency_class_name(const latency_class message_class)
+{
+    switch (message_class) {
+    case latency_class::realtime:
+        return "realtime";
+    case latency_class::voice:
+        return "voice";
+    case latency_class::sysex:
+        return "sysex";
+    case latency_class::scheduled:
+        return "scheduled";
+    default:
+        return "unknown";
+    }
+}
+
+void save_latency_report(const latency_report& report, const std::filesystem::path& path)
+{
+    std::ofstream _stream(path);
+    cereal::JSONOutputArchive _archive(_stream);
+    for (std::size_t _class = 0; _class < report.size(); ++_class) {
+        const latency_snapshot& _snapshot = report[_class];
+        _archive.setNextName(get_latency_class_name(static_cast<latency_class>(_class)));
+        _archive.startNode();
+        _archive(cereal::make_nvp("count", _snapshot.total));
+        _archive(cereal::make_nvp("p50_us", to_microseconds(_snapshot.get_percentile(0.5))));
+        _archive(cereal::make_nvp("p99_us", to_microseconds(_snapshot.get_percentile(0.99))));
+        _archive(cereal::make_nvp("p999_us", to_microseconds(_snapshot.get_percentile(0.999))));
+        _archive(cereal::make_nvp("max_us", to_microseconds(_snapshot.max_nanoseconds)));
+        _archive.setNextName("buckets");
+        _archive.startNode();
+        for (std::size_t _bucket = 0; _bucket < latency_snapshot::bucket_count; ++_bucket) {
+            if (_snapshot.counts[_bucket]) {
+                const std::string _floor = std::to_string(latency_histograms::get_bucket_floor(_bucket));
+                _archive(cereal::make_nvp(_floor.c_str(), _snapshot.counts[_bucket]));
+            }
+        }
+        _archive.finishNode();
+        _archive.finishNode();
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+/// @brief Message classes measured separately
+enum struct latency_class : std::size_t {
+    realtime,
+    voice,
+    sysex,
+    scheduled, // messages sent at a requested time, measured from that time instead of ingress
+    count
+};
+
+/// @brief Copy of a latency histogram that can be queried for percentiles
+struct latency_snapshot {
+    static constexpr std::size_t sub_bucket_bits = 4;
+    static constexpr std::size_t sub_bucket_count = std::size_t(1) << sub_bucket_bits;
+    static constexpr std::size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+    std::array<std::uint64_t, bucket_count> counts = {};
+    std::uint64_t total = 0;
+    std::uint64_t max_nanoseconds = 0;
+
+    /// @brief Adds another snapshot into this one
+    void merge(const latency_snapshot& other);
+
+    /// @brief Gets the latency below which the given fraction (0..1) of the messages fall, in nanoseconds
+    [[nodiscard]] std::uint64_t get_percentile(const double fraction) const;
+};
+
+/// @brief Log-linear histograms of message latencies per class with about 6% precision (HDR style)
+/// @details Each instance must be written by a single thread, counters are relaxed atomics so any thread can read.
+class latency_histograms {
+public:
+    /// @brief Records one latency for a message class
+    void record(const latency_class message_class, const std::chrono::steady_clock::duration latency);
+
+    /// @brief Copies the histogram of a message class
+    [[nodiscard]] latency_snapshot get_snapshot(const latency_class message_class) const;
+
+    /// @brief Gets the bucket holding a latency in nanoseconds
+    [[nodiscard]] static std::size_t get_bucket(const std::uint64_t nanoseconds);
+
+    /// @brief Gets the smallest latency in nanoseconds held by a bucket
+    [[nodiscard]] static std::uint64_t get_bucket_floor(const std::size_t bucket);
+
+private:
+    struct histogram {
+        std::array<std::atomic<std::uint64_t>, latency_snapshot::bucket_count> counts = {};
+        std::atomic<std::uint64_t> max_nanoseconds = 0;
+    };
+
+    std::array<histogram, static_cast<std::size_t>(latency_class::count)> _histograms;
+};
+
+/// @brief Latency snapshots of every message class
+using latency_report = std::array<latency_snapshot, static_cast<std::size_t>(latency_class::count)>;
+
+/// @brief Gets the display name of a message class
+[[nodiscard]] const char* get_latency_class_name(const latency_class message_class);
+
+/// @brief Writes percentiles and raw buckets of a report as JSON
+void save_latency_report(const latency_report& report, const std::filesystem::path& path);
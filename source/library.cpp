@@ -0,0 +1,638 @@
+#include "library.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+
+namespace {
+
+static constexpr char index_magic[8] = { 'D', 'X', '7', 'L', 'I', 'B', 'X', '\0' };
+static constexpr std::uint32_t index_version = 1;
+static constexpr std::uint32_t no_record = UINT32_MAX;
+static constexpr std::size_t banks_per_task = 16;
+
+/// @brief Start of an index file, followed by the root path, the directories, the banks, the patches and the strings
+struct library_index_header {
+    char magic[8] = {};
+    std::uint32_t version = 0;
+    std::uint32_t root_length = 0;
+    std::uint64_t directory_count = 0;
+    std::uint64_t bank_count = 0;
+    std::uint64_t patch_count = 0;
+    std::uint64_t strings_size = 0;
+};
+
+[[nodiscard]] static std::uint64_t hash_bytes(const unsigned char* data, const std::size_t length)
+{
+    std::uint64_t _hash = 14695981039346656037ull;
+    for (std::size_t _index = 0; _index < length; ++_index) {
+        _hash = (_hash ^ data[_index]) * 1099511628211ull;
+    }
+    return _hash;
+}
+
+/// @brief Size and last write time of a file or directory
+struct file_stamp {
+    std::uint64_t size = 0;
+    std::int64_t modified = 0;
+};
+
+[[nodiscard]] static bool get_file_stamp(const std::filesystem::path& path, file_stamp& stamp)
+{
+    // one system call, std::filesystem asks separately for the size and the time
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA _attributes;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &_attributes)) {
+        return false;
+    }
+    stamp.size = (std::uint64_t(_attributes.nFileSizeHigh) << 32) | _attributes.nFileSizeLow;
+    stamp.modified = static_cast<std::int64_t>((std::uint64_t(_attributes.ftLastWriteTime.dwHighDateTime) << 32) | _attributes.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat _status;
+    if (::stat(path.c_str(), &_status) != 0) {
+        return false;
+    }
+    stamp.size = static_cast<std::uint64_t>(_status.st_size);
+#if defined(__APPLE__)
+    stamp.modified = static_cast<std::int64_t>(_status.st_mtimespec.tv_sec) * 1000000000 + _status.st_mtimespec.tv_nsec;
+#else
+    stamp.modified = static_cast<std::int64_t>(_status.st_mtim.tv_sec) * 1000000000 + _status.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+/// @brief Bank found by a scan, filled by its own task
+struct scanned_bank {
+    std::string relative;
+    std::uint32_t previous = no_record;
+    bool is_found = false;
+    bool is_parsed = false; // new or changed, the entries hold its patches, otherwise they are copied from the previous index
+    file_stamp stamp;
+    std::uint64_t hash = 0;
+    std::vector<sysex_patch_entry> entries;
+};
+
+/// @brief Directory found by a scan, its task fills the banks and children before pushing their own tasks
+struct scanned_directory {
+    std::string relative;
+    std::uint32_t previous = no_record;
+    bool is_found = false;
+    bool is_listed = false;
+    file_stamp stamp;
+    std::vector<scanned_bank> banks;
+    std::vector<std::unique_ptr<scanned_directory>> children;
+};
+
+/// @brief State shared by the tasks of one scan
+struct library_scan {
+    library_scan(const library_index& previous_index, work_stealing_pool& scan_pool, library_scan_feed* scan_feed)
+        : previous(previous_index)
+        , pool(scan_pool)
+        , feed(scan_feed)
+    {
+    }
+
+    const library_index& previous;
+    work_stealing_pool& pool;
+    library_scan_feed* feed;
+    std::vector<std::vector<std::uint32_t>> previous_children; // directories of each previous directory
+    std::vector<std::vector<std::uint32_t>> previous_banks; // banks of each previous directory
+    std::once_flag previous_paths_flag; // the path maps are only built if a directory has to be listed
+    std::unordered_map<std::string_view, std::uint32_t> previous_directory_paths;
+    std::unordered_map<std::string_view, std::uint32_t> previous_bank_paths;
+    std::atomic<std::size_t> listed_directories = 0;
+    std::atomic<std::size_t> checked_files = 0;
+    std::atomic<std::size_t> parsed_banks = 0;
+};
+
+[[nodiscard]] static std::string_view get_string(const library_index& index, const std::uint32_t offset, const std::uint32_t length)
+{
+    return std::string_view(index.strings).substr(offset, length);
+}
+
+[[nodiscard]] static std::uint32_t add_string(library_index& index, const std::string_view value)
+{
+    const std::uint32_t _offset = static_cast<std::uint32_t>(index.strings.size());
+    index.strings.append(value);
+    return _offset;
+}
+
+[[nodiscard]] static std::filesystem::path get_full_path(const std::filesystem::path& root, const std::string_view relative)
+{
+    return relative.empty() ? root : root / std::filesystem::u8path(relative);
+}
+
+template <typename Record>
+[[nodiscard]] static bool read_records(const unsigned char*& cursor, const unsigned char* end, const std::uint64_t count, std::vector<Record>& records)
+{
+    if (count > static_cast<std::uint64_t>(end - cursor) / sizeof(Record)) {
+        return false;
+    }
+    records.resize(static_cast<std::size_t>(count));
+    std::memcpy(records.data(), cursor, records.size() * sizeof(Record));
+    cursor += records.size() * sizeof(Record);
+    return true;
+}
+
+template <typename Record>
+static void write_records(std::ofstream& stream, const std::vector<Record>& records)
+{
+    stream.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+}
+
+[[nodiscard]] static bool is_valid(const library_index& index)
+{
+    const std::uint64_t _strings_size = index.strings.size();
+    for (std::size_t _directory = 0; _directory < index.directories.size(); ++_directory) {
+        const library_directory_record& _record = index.directories[_directory];
+        if (std::uint64_t(_record.path_offset) + _record.path_length > _strings_size || (_directory > 0 && _record.parent >= _directory)) {
+            return false;
+        }
+    }
+    for (const library_bank_record& _record : index.banks) {
+        if (std::uint64_t(_record.path_offset) + _record.path_length > _strings_size || _record.directory >= index.directories.size()
+            || std::uint64_t(_record.first_patch) + _record.patch_count > index.patches.size()) {
+            return false;
+        }
+    }
+    for (const library_patch_record& _record : index.patches) {
+        if (std::uint64_t(_record.name_offset) + _record.name_length > _strings_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+[[nodiscard]] static bool read_index(const std::filesystem::path& index_path, const std::filesystem::path& root, library_index& index)
+{
+    // the index is replaced by a rename and never truncated in place, its mapping is read directly
+    const mapped_file _file(index_path);
+    library_index_header _header;
+    if (_file.size() < sizeof(_header)) {
+        return false;
+    }
+    std::memcpy(&_header, _file.data(), sizeof(_header));
+    const unsigned char* _cursor = _file.data() + sizeof(_header);
+    const unsigned char* _end = _file.data() + _file.size();
+    const std::string _root = root.generic_u8string();
+    if (std::memcmp(_header.magic, index_magic, sizeof(index_magic)) != 0 || _header.version != index_version || _header.root_length != _root.size()
+        || static_cast<std::size_t>(_end - _cursor) < _root.size() || std::memcmp(_cursor, _root.data(), _root.size()) != 0) {
+        return false;
+    }
+    _cursor += _root.size();
+    if (!read_records(_cursor, _end, _header.directory_count, index.directories) || !read_records(_cursor, _end, _header.bank_count, index.banks)
+        || !read_records(_cursor, _end, _header.patch_count, index.patches) || _header.strings_size != static_cast<std::uint64_t>(_end - _cursor)) {
+        return false;
+    }
+    index.strings.assign(reinterpret_cast<const char*>(_cursor), static_cast<std::size_t>(_header.strings_size));
+    return is_valid(index);
+}
+
+[[nodiscard]] static bool is_cancelled(const library_scan& scan)
+{
+    return scan.feed && scan.feed->is_cancelled.load(std::memory_order_relaxed);
+}
+
+static void scan_bank(library_scan& scan, scanned_bank& bank)
+{
+    if (is_cancelled(scan)) {
+        return;
+    }
+    const std::filesystem::path _path = get_full_path(scan.previous.root, bank.relative);
+    scan.checked_files.fetch_add(1, std::memory_order_relaxed);
+    bank.is_found = get_file_stamp(_path, bank.stamp);
+    if (!bank.is_found) {
+        return;
+    }
+    std::size_t _patch_count = 0;
+    if (bank.previous != no_record && scan.previous.banks[bank.previous].size == bank.stamp.size && scan.previous.banks[bank.previous].modified == bank.stamp.modified) {
+        _patch_count = scan.previous.banks[bank.previous].patch_count;
+    } else {
+        const mapped_file _file(_path);
+        const bool _is_intact = _file.access([&] {
+            bank.entries = find_sysex_patches(_path, _file.data(), _file.size());
+            bank.hash = hash_bytes(_file.data(), _file.size());
+        });
+        if (!_is_intact) {
+            // truncated while parsed, indexed empty and its stamp differs at the next scan
+            bank.entries.clear();
+            bank.hash = 0;
+        }
+        bank.stamp.size = _file.size();
+        bank.is_parsed = true;
+        _patch_count = bank.entries.size();
+        scan.parsed_banks.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (scan.feed) {
+        std::lock_guard<std::mutex> _lock_guard(scan.feed->mutex);
+        scan.feed->banks.push_back(bank.relative);
+        scan.feed->patches += _patch_count;
+    }
+}
+
+static void scan_directory(library_scan& scan, scanned_directory& directory)
+{
+    if (is_cancelled(scan)) {
+        return;
+    }
+    const library_index& _previous = scan.previous;
+    const std::filesystem::path _path = get_full_path(_previous.root, directory.relative);
+    directory.is_found = get_file_stamp(_path, directory.stamp);
+    if (!directory.is_found) {
+        return;
+    }
+    if (directory.previous != no_record && _previous.directories[directory.previous].modified == directory.stamp.modified) {
+        // no entry was added or removed, only the banks themselves can have changed
+        for (const std::uint32_t _bank : scan.previous_banks[directory.previous]) {
+            scanned_bank& _scanned = directory.banks.emplace_back();
+            _scanned.relative = get_string(_previous, _previous.banks[_bank].path_offset, _previous.banks[_bank].path_length);
+            _scanned.previous = _bank;
+        }
+        for (const std::uint32_t _child : scan.previous_children[directory.previous]) {
+            scanned_directory& _scanned = *directory.children.emplace_back(std::make_unique<scanned_directory>());
+            _scanned.relative = get_string(_previous, _previous.directories[_child].path_offset, _previous.directories[_child].path_length);
+            _scanned.previous = _child;
+        }
+    } else {
+        directory.is_listed = true;
+        scan.listed_directories.fetch_add(1, std::memory_order_relaxed);
+        std::call_once(scan.previous_paths_flag, [&scan, &_previous] {
+            for (std::uint32_t _index = 0; _index < _previous.directories.size(); ++_index) {
+                scan.previous_directory_paths.emplace(get_string(_previous, _previous.directories[_index].path_offset, _previous.directories[_index].path_length), _index);
+            }
+            for (std::uint32_t _index = 0; _index < _previous.banks.size(); ++_index) {
+                scan.previous_bank_paths.emplace(get_string(_previous, _previous.banks[_index].path_offset, _previous.banks[_index].path_length), _index);
+            }
+        });
+        const auto find_previous = [](const std::unordered_map<std::string_view, std::uint32_t>& paths, const std::string& path) {
+            const auto _iterator = paths.find(path);
+            return _iterator == paths.end() ? no_record : _iterator->second;
+        };
+        std::error_code _error;
+        for (std::filesystem::directory_iterator _iterator(_path, _error), _end; !_error && _iterator != _end; _iterator.increment(_error)) {
+            std::error_code _entry_error;
+            const std::string _name = _iterator->path().filename().u8string();
+            std::string _relative = directory.relative.empty() ? _name : directory.relative + '/' + _name;
+            if (_iterator->is_directory(_entry_error) && !_iterator->is_symlink(_entry_error)) {
+                scanned_directory& _scanned = *directory.children.emplace_back(std::make_unique<scanned_directory>());
+                _scanned.previous = find_previous(scan.previous_directory_paths, _relative);
+                _scanned.relative = std::move(_relative);
+            } else if (_iterator->is_regular_file(_entry_error) && is_sysex_file(_iterator->path())) {
+                scanned_bank& _scanned = directory.banks.emplace_back();
+                _scanned.previous = find_previous(scan.previous_bank_paths, _relative);
+                _scanned.relative = std::move(_relative);
+            }
+        }
+    }
+    // the vectors are complete, their elements do not move anymore while the tasks fill them
+    for (std::size_t _first = 0; _first < directory.banks.size(); _first += banks_per_task) {
+        // a warm check is one stat per bank, a few of them per task keep the queueing out of the way
+        scanned_bank* _begin = directory.banks.data() + _first;
+        scanned_bank* _end = directory.banks.data() + std::min(directory.banks.size(), _first + banks_per_task);
+        scan.pool.push([&scan, _begin, _end] {
+            for (scanned_bank* _bank = _begin; _bank != _end; ++_bank) {
+                scan_bank(scan, *_bank);
+            }
+        });
+    }
+    for (const std::unique_ptr<scanned_directory>& _child : directory.children) {
+        scanned_directory* _scanned = _child.get();
+        scan.pool.push([&scan, _scanned] { scan_directory(scan, *_scanned); });
+    }
+}
+
+static void add_scanned_bank(const library_index& previous, library_index& next, const scanned_bank& bank, const std::uint32_t directory)
+{
+    library_bank_record _bank;
+    _bank.path_offset = add_string(next, bank.relative);
+    _bank.path_length = static_cast<std::uint32_t>(bank.relative.size());
+    _bank.directory = directory;
+    _bank.first_patch = static_cast<std::uint32_t>(next.patches.size());
+    _bank.size = bank.stamp.size;
+    _bank.modified = bank.stamp.modified;
+    if (!bank.is_parsed) {
+        // the names of a bank were added together, they are copied as one range and their offsets moved along
+        const library_bank_record& _previous = previous.banks[bank.previous];
+        const library_patch_record* _first = previous.patches.data() + _previous.first_patch;
+        const library_patch_record* _last = _first + _previous.patch_count;
+        std::uint32_t _begin = UINT32_MAX;
+        std::uint32_t _end = 0;
+        for (const library_patch_record* _record = _first; _record != _last; ++_record) {
+            _begin = std::min(_begin, _record->name_offset);
+            _end = std::max(_end, _record->name_offset + _record->name_length);
+        }
+        if (_begin < _end) {
+            const std::uint32_t _offset = add_string(next, get_string(previous, _begin, _end - _begin));
+            for (const library_patch_record* _record = _first; _record != _last; ++_record) {
+                next.patches.push_back(*_record);
+                next.patches.back().name_offset = _record->name_offset - _begin + _offset;
+            }
+        } else {
+            next.patches.insert(next.patches.end(), _first, _last);
+        }
+        _bank.hash = _previous.hash;
+    } else {
+        for (const sysex_patch_entry& _entry : bank.entries) {
+            library_patch_record _record;
+            const std::string_view _name = std::string_view(_entry.name).substr(0, UINT16_MAX);
+            _record.name_offset = add_string(next, _name);
+            _record.name_length = static_cast<std::uint16_t>(_name.size());
+            _record.voice = _entry.location.voice;
+            _record.offset = _entry.location.offset;
+            _record.length = _entry.location.length;
+            next.patches.push_back(_record);
+        }
+        _bank.hash = bank.hash;
+    }
+    _bank.patch_count = static_cast<std::uint32_t>(next.patches.size() - _bank.first_patch);
+    next.banks.push_back(_bank);
+}
+
+[[nodiscard]] static bool add_scanned_directory(const library_index& previous, library_index& next, const scanned_directory& directory, const std::uint32_t parent)
+{
+    // depth first in listing order whatever order the tasks finished in, returns if anything changed
+    if (!directory.is_found) {
+        return true;
+    }
+    bool _is_changed = directory.is_listed;
+    const std::uint32_t _directory = static_cast<std::uint32_t>(next.directories.size());
+    library_directory_record _record;
+    _record.path_offset = add_string(next, directory.relative);
+    _record.path_length = static_cast<std::uint32_t>(directory.relative.size());
+    _record.parent = parent;
+    _record.modified = directory.stamp.modified;
+    next.directories.push_back(_record);
+    for (const scanned_bank& _bank : directory.banks) {
+        _is_changed |= !_bank.is_found || _bank.is_parsed;
+        if (_bank.is_found) {
+            add_scanned_bank(previous, next, _bank, _directory);
+        }
+    }
+    for (const std::unique_ptr<scanned_directory>& _child : directory.children) {
+        _is_changed |= add_scanned_directory(previous, next, *_child, _directory);
+    }
+    return _is_changed;
+}
+
+
+[[nodiscard]] static bool is_indexed(const library_bank_record& bank, const mapped_file& file)
+{
+    std::uint64_t _hash = 0;
+    return file.size() == bank.size && file.access([&] { _hash = hash_bytes(file.data(), file.size()); }) && _hash == bank.hash;
+}
+
+[[nodiscard]] static std::vector<sysex_patch_entry> find_mapped_patches(const std::filesystem::path& bank, const mapped_file& file)
+{
+    // none if the file is truncated while it is parsed
+    std::vector<sysex_patch_entry> _patches;
+    if (!file.access([&] { _patches = find_sysex_patches(bank, file.data(), file.size()); })) {
+        _patches.clear();
+    }
+    return _patches;
+}
+
+[[nodiscard]] static sysex_patch_entry make_patch_entry(const library_index& index, const library_patch_record& record)
+{
+    sysex_patch_entry _entry;
+    _entry.name = get_string(index, record.name_offset, record.name_length);
+    _entry.location.offset = record.offset;
+    _entry.location.length = record.length;
+    _entry.location.voice = record.voice;
+    return _entry;
+}
+
+}
+
+library_index load_library_index(const std::filesystem::path& root, const std::filesystem::path& index_path, const std::size_t threads, library_scan_feed* feed)
+{
+    library_index _previous;
+    _previous.root = root;
+    const bool _is_loaded = read_index(index_path, root, _previous);
+    if (!_is_loaded) {
+        _previous = library_index();
+        _previous.root = root;
+    }
+
+    work_stealing_pool _pool(threads);
+    library_scan _scan(_previous, _pool, feed);
+    _scan.previous_children.resize(_previous.directories.size());
+    _scan.previous_banks.resize(_previous.directories.size());
+    for (std::uint32_t _directory = 1; _directory < _previous.directories.size(); ++_directory) {
+        _scan.previous_children[_previous.directories[_directory].parent].push_back(_directory);
+    }
+    for (std::uint32_t _bank = 0; _bank < _previous.banks.size(); ++_bank) {
+        _scan.previous_banks[_previous.banks[_bank].directory].push_back(_bank);
+    }
+    scanned_directory _root;
+    _root.previous = _previous.directories.empty() ? no_record : 0;
+    _pool.push([&_scan, &_root] { scan_directory(_scan, _root); });
+    _pool.wait();
+
+    library_index _next;
+    _next.root = root;
+    _next.directories.reserve(_previous.directories.size());
+    _next.banks.reserve(_previous.banks.size());
+    _next.patches.reserve(_previous.patches.size());
+    _next.strings.reserve(_previous.strings.size());
+    const bool _is_changed = add_scanned_directory(_previous, _next, _root, no_record);
+    _next.statistics.is_loaded = _is_loaded;
+    _next.statistics.is_changed = !_is_loaded || _is_changed || _next.banks.size() != _previous.banks.size() || _next.directories.size() != _previous.directories.size();
+    _next.statistics.listed_directories = _scan.listed_directories.load();
+    _next.statistics.checked_files = _scan.checked_files.load();
+    _next.statistics.parsed_banks = _scan.parsed_banks.load();
+    if (_next.statistics.is_changed && !is_cancelled(_scan)) {
+        save_library_index(_next, index_path);
+    }
+    return _next;
+}
+
+void save_library_index(const library_index& index, const std::filesystem::path& index_path)
+{
+    const std::string _root = index.root.generic_u8string();
+    library_index_header _header;
+    std::memcpy(_header.magic, index_magic, sizeof(index_magic));
+    _header.version = index_version;
+    _header.root_length = static_cast<std::uint32_t>(_root.size());
+    _header.directory_count = index.directories.size();
+    _header.bank_count = index.banks.size();
+    _header.patch_count = index.patches.size();
+    _header.strings_size = index.strings.size();
+
+    std::filesystem::path _temporary_path = index_path;
+    _temporary_path += ".tmp";
+    {
+        std::ofstream _stream(_temporary_path, std::ios::binary | std::ios::trunc);
+        _stream.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+        _stream.write(_root.data(), static_cast<std::streamsize>(_root.size()));
+        write_records(_stream, index.directories);
+        write_records(_stream, index.banks);
+        write_records(_stream, index.patches);
+        _stream.write(index.strings.data(), static_cast<std::streamsize>(index.strings.size()));
+        if (!_stream) {
+            return;
+        }
+    }
+    std::error_code _error;
+    std::filesystem::rename(_temporary_path, index_path, _error);
+}
+
+std::string_view get_library_bank_name(const library_index& index, const std::size_t bank)
+{
+    return get_string(index, index.banks[bank].path_offset, index.banks[bank].path_length);
+}
+
+std::filesystem::path get_library_bank_path(const library_index& index, const std::size_t bank)
+{
+    return get_full_path(index.root, get_library_bank_name(index, bank));
+}
+
+sysex_bank load_library_bank(const library_index& index, const std::size_t bank)
+{
+    const std::filesystem::path _path = get_library_bank_path(index, bank);
+    std::shared_ptr<const mapped_file> _file = std::make_shared<const mapped_file>(_path);
+    if (!is_indexed(index.banks[bank], *_file)) {
+        // changed since the index was brought up to date
+        std::vector<sysex_patch_entry> _patches = find_mapped_patches(_path, *_file);
+        return sysex_bank(std::move(_file), std::move(_patches));
+    }
+    sysex_bank _bank(std::move(_file));
+    _bank.reserve(index.banks[bank].patch_count);
+    for (std::uint32_t _patch = index.banks[bank].first_patch; _patch < index.banks[bank].first_patch + index.banks[bank].patch_count; ++_patch) {
+        _bank.add_patch(make_patch_entry(index, index.patches[_patch]));
+    }
+    return _bank;
+}
+
+library_bank_loader::library_bank_loader()
+    : _thread(&library_bank_loader::run, this)
+{
+}
+
+library_bank_loader::~library_bank_loader()
+{
+    {
+        std::lock_guard<std::mutex> _lock_guard(_mutex);
+        ++_generation;
+        _is_stopping = true;
+    }
+    _condition.notify_one();
+    _thread.join();
+}
+
+void library_bank_loader::request(std::shared_ptr<const library_index> index, const std::size_t bank)
+{
+    {
+        std::lock_guard<std::mutex> _lock_guard(_mutex);
+        ++_generation;
+        _index = std::move(index);
+        _bank = bank;
+        _has_request = true;
+        _is_complete = false;
+        _file.reset();
+        _loaded.clear();
+    }
+    _condition.notify_one();
+}
+
+void library_bank_loader::cancel()
+{
+    std::lock_guard<std::mutex> _lock_guard(_mutex);
+    ++_generation;
+    _index.reset();
+    _has_request = false;
+    _is_complete = false;
+    _file.reset();
+    _loaded.clear();
+}
+
+bool library_bank_loader::take(sysex_bank& bank, const std::size_t count)
+{
+    std::lock_guard<std::mutex> _lock_guard(_mutex);
+    if (_file && bank.get_file() != _file) {
+        bank = sysex_bank(_file);
+        bank.reserve(_patch_count);
+    }
+    const std::size_t _count = std::min(count, _loaded.size());
+    for (std::size_t _index = 0; _index < _count; ++_index) {
+        bank.add_patch(std::move(_loaded.front()));
+        _loaded.pop_front();
+    }
+    return _is_complete && _loaded.empty();
+}
+
+void library_bank_loader::run()
+{
+    std::unique_lock<std::mutex> _lock(_mutex);
+    while (true) {
+        _condition.wait(_lock, [this] { return _has_request || _is_stopping; });
+        if (_is_stopping) {
+            return;
+        }
+        _has_request = false;
+        const std::shared_ptr<const library_index> _request_index = std::move(_index);
+        const std::size_t _request_bank = _bank;
+        const std::uint64_t _request_generation = _generation;
+        _patch_count = _request_index->banks[_request_bank].patch_count;
+        _lock.unlock();
+        load(*_request_index, _request_bank, _request_generation);
+        _lock.lock();
+    }
+}
+
+void library_bank_loader::load(const library_index& index, const std::size_t bank, const std::uint64_t generation)
+{
+    static constexpr std::size_t batch_size = 64;
+    const library_bank_record& _bank = index.banks[bank];
+    const std::filesystem::path _path = get_library_bank_path(index, bank);
+    const std::shared_ptr<const mapped_file> _file = std::make_shared<const mapped_file>(_path);
+    std::vector<sysex_patch_entry> _batch;
+    _batch.reserve(batch_size);
+    if (!is_indexed(_bank, *_file)) {
+        // changed since the index was brought up to date
+        for (sysex_patch_entry& _entry : find_mapped_patches(_path, *_file)) {
+            _batch.push_back(std::move(_entry));
+            if (_batch.size() == batch_size && !hand_over(_file, _batch, generation, false)) {
+                return;
+            }
+        }
+    } else {
+        for (std::uint32_t _patch = _bank.first_patch; _patch < _bank.first_patch + _bank.patch_count; ++_patch) {
+            _batch.push_back(make_patch_entry(index, index.patches[_patch]));
+            if (_batch.size() == batch_size && !hand_over(_file, _batch, generation, false)) {
+                return;
+            }
+        }
+    }
+    hand_over(_file, _batch, generation, true);
+}
+
+bool library_bank_loader::hand_over(const std::shared_ptr<const mapped_file>& file, std::vector<sysex_patch_entry>& patches, const std::uint64_t generation, const bool is_last)
+{
+    // false once the load was cancelled, its patches are dropped
+    std::lock_guard<std::mutex> _lock_guard(_mutex);
+    if (_generation != generation) {
+        return false;
+    }
+    _file = file;
+    std::move(patches.begin(), patches.end(), std::back_inserter(_loaded));
+    patches.clear();
+    _is_complete = is_last;
+    return true;
+}
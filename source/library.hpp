@@ -0,0 +1,140 @@
+#pragma once
+
+#include "sysex.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/// @brief Directory of a library index, its path is relative to the library root
+struct library_directory_record {
+    std::uint32_t path_offset = 0;
+    std::uint32_t path_length = 0;
+    std::uint32_t parent = UINT32_MAX; // index of the parent directory, none for the root
+    std::uint32_t reserved = 0;
+    std::int64_t modified = 0; // last write time, changes when an entry is added, removed or renamed
+};
+
+/// @brief Bank file of a library index with the range of its patches
+struct library_bank_record {
+    std::uint32_t path_offset = 0;
+    std::uint32_t path_length = 0;
+    std::uint32_t directory = 0;
+    std::uint32_t first_patch = 0;
+    std::uint32_t patch_count = 0;
+    std::uint32_t reserved = 0;
+    std::uint64_t size = 0;
+    std::int64_t modified = 0;
+    std::uint64_t hash = 0; // FNV-1a of the content
+};
+
+/// @brief Patch of a library index
+struct library_patch_record {
+    std::uint32_t name_offset = 0;
+    std::uint16_t name_length = 0;
+    std::uint8_t voice = sysex_patch_location::whole_message;
+    std::uint8_t reserved = 0;
+    std::uint32_t offset = 0;
+    std::uint32_t length = 0;
+};
+
+/// @brief What bringing a library index up to date took
+struct library_index_statistics {
+    bool is_loaded = false; // an index file matching the root was found
+    bool is_changed = false; // the index file was written again
+    std::size_t listed_directories = 0;
+    std::size_t checked_files = 0; // banks whose size and time were compared with the index
+    std::size_t parsed_banks = 0;
+};
+
+/// @brief Banks and patch names of a library directory, kept in a binary file between runs
+/// @details Records are fixed size and hold offsets into one string table, so the file is the arrays written one
+/// after the other and loading it is a few copies out of its mapping.
+struct library_index {
+    std::filesystem::path root;
+    std::vector<library_directory_record> directories;
+    std::vector<library_bank_record> banks;
+    std::vector<library_patch_record> patches;
+    std::string strings; // relative paths with forward slashes and patch names
+    library_index_statistics statistics;
+};
+
+/// @brief Banks reported by a running scan as they are checked, for another thread to show before the index is ready
+/// @details The other thread can also cancel the scan, its tasks then stop checking banks and the index is not written.
+struct library_scan_feed {
+    std::mutex mutex;
+    std::vector<std::string> banks; // relative paths in the order they finished, the reader takes them under the mutex
+    std::size_t patches = 0;
+    std::atomic<bool> is_cancelled = false;
+};
+
+/// @brief Loads the index file and brings it up to date with the library, writing it back if anything changed
+/// @details Directories whose time did not change are not listed again, only their banks are checked for size and
+/// time, and only new or changed banks are parsed. A missing or unreadable index gives a full scan. Directories and
+/// banks are tasks of a work stealing pool with the given count of threads, one per hardware thread if 0, and the
+/// records are put back in listing order once every task finished so the index does not depend on the timing.
+/// A cancelled scan returns the index as far as it got.
+[[nodiscard]] library_index load_library_index(const std::filesystem::path& root, const std::filesystem::path& index_path, const std::size_t threads = 0, library_scan_feed* feed = nullptr);
+
+/// @brief Writes an index file, replacing it at once so a crash never leaves half an index
+void save_library_index(const library_index& index, const std::filesystem::path& index_path);
+
+/// @brief Gets the path of a bank relative to the library root
+[[nodiscard]] std::string_view get_library_bank_name(const library_index& index, const std::size_t bank);
+
+/// @brief Gets the full path of a bank
+[[nodiscard]] std::filesystem::path get_library_bank_path(const library_index& index, const std::size_t bank);
+
+/// @brief Maps a bank and takes its patches from the index, parsing the file again only if its content changed
+[[nodiscard]] sysex_bank load_library_bank(const library_index& index, const std::size_t bank);
+
+/// @brief Loads the patches of one bank at a time on its own thread, for a caller that must not wait such as a frame
+/// @details A request cancels the one before it, which stops at its next batch of patches. Loaded patches wait in
+/// the loader until the caller takes them, as many at a time as it can merge.
+class library_bank_loader {
+public:
+    library_bank_loader();
+
+    library_bank_loader(const library_bank_loader&) = delete;
+    library_bank_loader& operator=(const library_bank_loader&) = delete;
+
+    /// @brief Cancels the current load and joins the thread
+    ~library_bank_loader();
+
+    /// @brief Starts loading a bank, the loader keeps the index alive until its load stopped
+    void request(std::shared_ptr<const library_index> index, const std::size_t bank);
+
+    /// @brief Stops the current load and drops the patches not taken yet
+    void cancel();
+
+    /// @brief Moves at most count loaded patches to the back of a bank, which is first emptied if it holds another mapping
+    /// @return If the bank is complete, every one of its patches having been taken
+    [[nodiscard]] bool take(sysex_bank& bank, const std::size_t count);
+
+private:
+    void run();
+    void load(const library_index& index, const std::size_t bank, const std::uint64_t generation);
+    bool hand_over(const std::shared_ptr<const mapped_file>& file, std::vector<sysex_patch_entry>& patches, const std::uint64_t generation, const bool is_last);
+
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::shared_ptr<const library_index> _index;
+    std::size_t _bank = 0;
+    std::uint64_t _generation = 0; // counts requests and cancels, a load of an older one stops
+    bool _has_request = false;
+    bool _is_complete = false;
+    bool _is_stopping = false;
+    std::size_t _patch_count = 0; // of the bank being loaded
+    std::shared_ptr<const mapped_file> _file; // of the bank being loaded, once it is mapped
+    std::deque<sysex_patch_entry> _loaded;
+    std::thread _thread;
+};
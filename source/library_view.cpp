@@ -0,0 +1,219 @@
+#include "library_view.hpp"
+#include "imgui_id.hpp"
+#include "library.hpp"
+#include "router.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+static constexpr std::size_t merge_batch_size = 256;
+
+static std::shared_ptr<const library_index> library = std::make_shared<library_index>();
+static std::shared_ptr<library_scan_feed> library_feed; // of the running scan, a cancelled scan keeps its own
+static std::future<library_index> library_scan;
+static std::vector<std::future<library_index>> library_cancelled_scans; // dropped once they stopped, never waited on
+static std::vector<std::string> library_scanned_banks;
+static std::size_t library_scanned_patches = 0;
+static std::unique_ptr<library_bank_loader> library_loader; // started with the first bank
+static sysex_bank library_bank; // patches of the open bank merged so far, views into its mapping
+static bool is_library_patches_complete = false;
+static int library_selected_bank_index = -1;
+static int library_selected_patch_index = -1;
+
+void merge_library_patches(const std::chrono::microseconds budget)
+{
+    if (library_selected_bank_index < 0 || is_library_patches_complete) {
+        return;
+    }
+    const std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::now() + budget;
+    while (true) {
+        const std::size_t _count = library_bank.size();
+        if (library_loader->take(library_bank, merge_batch_size)) {
+            is_library_patches_complete = true;
+            return;
+        }
+        if (library_bank.size() == _count || std::chrono::steady_clock::now() >= _deadline) {
+            return;
+        }
+    }
+}
+
+void draw_library_scan()
+{
+    // banks are listed as the scan reports them, the tree replaces them once the index is complete
+    {
+        std::lock_guard<std::mutex> _lock_guard(library_feed->mutex);
+        std::move(library_feed->banks.begin(), library_feed->banks.end(), std::back_inserter(library_scanned_banks));
+        library_feed->banks.clear();
+        library_scanned_patches = library_feed->patches;
+    }
+    ImGui::Text("Scanning library, %zu banks and %zu patches so far...", library_scanned_banks.size(), library_scanned_patches);
+    if (ImGui::BeginChild(IMGUIDU, ImVec2(-FLT_MIN, ImGui::GetContentRegionAvail().y))) {
+        ImGuiListClipper _clipper;
+        _clipper.Begin(static_cast<int>(library_scanned_banks.size()));
+        while (_clipper.Step()) {
+            for (int _bank_index = _clipper.DisplayStart; _bank_index < _clipper.DisplayEnd; ++_bank_index) {
+                ImGui::TextDisabled("%s", library_scanned_banks[_bank_index].c_str());
+            }
+        }
+    }
+    ImGui::EndChild();
+}
+
+void draw_library_bank_row(const int bank_index, int& next_selected_bank_index)
+{
+    const bool _is_bank_selected = (library_selected_bank_index == bank_index);
+    ImGuiTreeNodeFlags _tree_node_flags = ImGuiTreeNodeFlags_FramePadding | ImGuiTreeNodeFlags_SpanFullWidth | ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+    if (_is_bank_selected && library_selected_patch_index == -1) {
+        _tree_node_flags |= ImGuiTreeNodeFlags_Selected;
+    }
+
+    ImGui::SetNextItemOpen(_is_bank_selected, ImGuiCond_Always);
+    const std::string _bank_name(get_library_bank_name(*library, bank_index));
+    const bool _is_bank_open = ImGui::TreeNodeEx(reinterpret_cast<void*>(static_cast<intptr_t>(bank_index + 1)), _tree_node_flags, "%s", _bank_name.c_str());
+
+    if (ImGui::IsItemToggledOpen()) {
+        if (_is_bank_open) {
+            next_selected_bank_index = bank_index;
+        } else if (_is_bank_selected) {
+            next_selected_bank_index = -1;
+        }
+    } else if (ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
+        next_selected_bank_index = _is_bank_selected ? -1 : bank_index;
+    }
+}
+
+void draw_library_patch_row(const int patch_index)
+{
+    ImGuiTreeNodeFlags _leaf_flags = ImGuiTreeNodeFlags_FramePadding | ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen | ImGuiTreeNodeFlags_SpanFullWidth;
+    if (library_selected_patch_index == patch_index) {
+        _leaf_flags |= ImGuiTreeNodeFlags_Selected;
+    }
+    ImGui::Indent();
+    ImGui::PushID(library_selected_bank_index + 1);
+    ImGui::TreeNodeEx(reinterpret_cast<void*>(static_cast<intptr_t>(patch_index)), _leaf_flags, "%s", library_bank.get_name(patch_index).c_str());
+    ImGui::PopID();
+    ImGui::Unindent();
+    if (ImGui::IsItemClicked()) {
+        // patches already merged can be sent while the rest of the bank is still loading
+        library_selected_patch_index = patch_index;
+        release_hardware_output_notes(0);
+        send_to_hardware_output(0, library_bank.make_data(patch_index));
+    }
+}
+
+void draw_library_placeholder_row()
+{
+    ImGui::Indent();
+    ImGui::AlignTextToFramePadding();
+    ImGui::TextDisabled("Loading, %zu of %u patches...", library_bank.size(), library->banks[library_selected_bank_index].patch_count);
+    ImGui::Unindent();
+}
+
+}
+
+void start_library_scan(const std::filesystem::path& root, const std::filesystem::path& index_path)
+{
+    select_library_bank(-1);
+    if (library_scan.valid()) {
+        // the future of a running scan waits for it when destroyed, it is kept until its tasks stopped
+        library_feed->is_cancelled = true;
+        library_cancelled_scans.push_back(std::move(library_scan));
+    }
+    library_scanned_banks.clear();
+    library_scanned_patches = 0;
+    const std::shared_ptr<library_scan_feed> _feed = std::make_shared<library_scan_feed>();
+    library_feed = _feed;
+    library_scan = std::async(std::launch::async, [root, index_path, _feed] {
+        return load_library_index(root, index_path, 0, _feed.get());
+    });
+}
+
+bool is_library_scanning()
+{
+    return library_scan.valid();
+}
+
+int get_library_bank_count()
+{
+    return static_cast<int>(library->banks.size());
+}
+
+void select_library_bank(const int bank)
+{
+    library_selected_bank_index = bank;
+    library_selected_patch_index = -1;
+    library_bank = sysex_bank();
+    is_library_patches_complete = false;
+    if (bank >= 0) {
+        if (!library_loader) {
+            library_loader = std::make_unique<library_bank_loader>();
+        }
+        library_loader->request(library, static_cast<std::size_t>(bank));
+    } else if (library_loader) {
+        library_loader->cancel();
+    }
+}
+
+bool is_library_bank_loaded()
+{
+    return library_selected_bank_index < 0 || is_library_patches_complete;
+}
+
+void draw_library_view(const std::chrono::microseconds merge_budget)
+{
+    library_cancelled_scans.erase(std::remove_if(library_cancelled_scans.begin(), library_cancelled_scans.end(), [](const std::future<library_index>& scan) {
+        return scan.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), library_cancelled_scans.end());
+    if (library_scan.valid()) {
+        if (library_scan.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            draw_library_scan();
+            return;
+        }
+        library = std::make_shared<const library_index>(library_scan.get());
+        library_feed.reset();
+        library_scanned_banks.clear();
+        library_scanned_banks.shrink_to_fit();
+    }
+    merge_library_patches(merge_budget);
+
+    const ImGuiTableFlags _table_flags = ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg;
+    const float _table_height = ImGui::GetContentRegionAvail().y;
+    int _next_selected_bank_index = library_selected_bank_index;
+    if (ImGui::BeginTable(IMGUIDU, 1, _table_flags, ImVec2(-FLT_MIN, _table_height))) {
+        ImGui::TableSetupColumn(IMGUIDU, ImGuiTableColumnFlags_WidthStretch);
+
+        // one flat list of rows, the patches of the open bank and its placeholder follow it
+        const int _bank_count = get_library_bank_count();
+        const int _patch_rows = library_selected_bank_index < 0 ? 0 : static_cast<int>(library_bank.size()) + (is_library_patches_complete ? 0 : 1);
+        ImGuiListClipper _clipper;
+        _clipper.Begin(_bank_count + _patch_rows);
+        while (_clipper.Step()) {
+            for (int _row = _clipper.DisplayStart; _row < _clipper.DisplayEnd; ++_row) {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                if (library_selected_bank_index < 0 || _row <= library_selected_bank_index) {
+                    draw_library_bank_row(_row, _next_selected_bank_index);
+                } else if (_row > library_selected_bank_index + _patch_rows) {
+                    draw_library_bank_row(_row - _patch_rows, _next_selected_bank_index);
+                } else if (_row - library_selected_bank_index - 1 < static_cast<int>(library_bank.size())) {
+                    draw_library_patch_row(_row - library_selected_bank_index - 1);
+                } else {
+                    draw_library_placeholder_row();
+                }
+            }
+        }
+        ImGui::EndTable();
+    }
+    if (_next_selected_bank_index != library_selected_bank_index) {
+        // after the table, its rows were laid out for the bank open at the start of the frame
+        select_library_bank(_next_selected_bank_index);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+
+/// @brief Starts bringing the library index up to date in the background, the view lists banks as they are found
+void start_library_scan(const std::filesystem::path& root, const std::filesystem::path& index_path);
+
+/// @brief Gets if the view still waits for the scan, a frame takes the index once it is ready
+[[nodiscard]] bool is_library_scanning();
+
+/// @brief Gets the count of banks of the index shown by the view
+[[nodiscard]] int get_library_bank_count();
+
+/// @brief Opens a bank and starts loading its patches in the background, cancelling the load of the previous one
+/// @param bank Index of the bank in the library, -1 to close the open one
+void select_library_bank(const int bank);
+
+/// @brief Gets if every patch of the open bank is in the view
+[[nodiscard]] bool is_library_bank_loaded();
+
+/// @brief Draws the scan progress or the bank tree in the current window
+/// @param merge_budget Time the frame may spend moving loaded patches into the tree, the rest waits for the next one
+void draw_library_view(const std::chrono::microseconds merge_budget = std::chrono::microseconds(2000));
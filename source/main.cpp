@@ -547,8 +547,11 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
             return 0;
         break;
     case WM_DESTROY:
-        close_virtual_input();
-        close_hardware_output();
+        set_midi_clock(midi_clock_settings());
+        close_virtual_inputs();
+        close_hardware_outputs();
+        close_hardware_inputs();
+        close_virtual_outputs();
 
         ::PostQuitMessage(0);
         return 0;
@@ -0,0 +1,177 @@
+#include "mapped_file.hpp"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+#if !defined(_WIN32)
+
+namespace {
+
+static thread_local int access_depth = 0;
+static thread_local bool is_access_faulted = false;
+static struct sigaction previous_bus_action;
+static std::uintptr_t page_size = 0;
+static std::once_flag bus_handler_flag;
+
+static void on_bus_error(int, siginfo_t* info, void*)
+{
+    // a thread reading a mapping touched a page the file no longer has, the read goes on over zeros
+    if (access_depth > 0 && info->si_code == BUS_ADRERR) {
+        void* _page = reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(info->si_addr) & ~(page_size - 1));
+        if (::mmap(_page, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+            is_access_faulted = true;
+            return;
+        }
+    }
+    // any other fault goes to the previous disposition when the instruction faults again
+    ::sigaction(SIGBUS, &previous_bus_action, nullptr);
+}
+
+static void install_bus_handler()
+{
+    page_size = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+    struct sigaction _action;
+    std::memset(&_action, 0, sizeof(_action));
+    _action.sa_sigaction = on_bus_error;
+    _action.sa_flags = SA_SIGINFO;
+    sigemptyset(&_action.sa_mask);
+    ::sigaction(SIGBUS, &_action, &previous_bus_action);
+}
+
+}
+
+#endif
+
+mapped_file::mapped_file(const std::filesystem::path& path)
+{
+#if defined(_WIN32)
+    const HANDLE _file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    LARGE_INTEGER _file_size;
+    if (GetFileSizeEx(_file, &_file_size) && _file_size.QuadPart > 0) {
+        // the view keeps the file open once both handles are closed
+        if (const HANDLE _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr)) {
+            if (const void* _view = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0)) {
+                _data = static_cast<const unsigned char*>(_view);
+                _size = static_cast<std::size_t>(_file_size.QuadPart);
+            }
+            CloseHandle(_mapping);
+        }
+    }
+    CloseHandle(_file);
+#else
+    const int _file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_file < 0) {
+        return;
+    }
+    struct stat _status;
+    if (::fstat(_file, &_status) == 0 && _status.st_size > 0) {
+        void* _view = ::mmap(nullptr, static_cast<std::size_t>(_status.st_size), PROT_READ, MAP_PRIVATE, _file, 0);
+        if (_view != MAP_FAILED) {
+            _data = static_cast<const unsigned char*>(_view);
+            _size = static_cast<std::size_t>(_status.st_size);
+        }
+    }
+    ::close(_file);
+#endif
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+    : _data(std::exchange(other._data, nullptr))
+    , _size(std::exchange(other._size, 0))
+{
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file()
+{
+    unmap();
+}
+
+const unsigned char* mapped_file::data() const
+{
+    return _data;
+}
+
+std::size_t mapped_file::size() const
+{
+    return _size;
+}
+
+bool mapped_file::empty() const
+{
+    return _size == 0;
+}
+
+bool mapped_file::copy(const std::size_t offset, unsigned char* data, const std::size_t length) const
+{
+    if (!_data || offset > _size || length > _size - offset) {
+        return false;
+    }
+    return access([&] { std::memcpy(data, _data + offset, length); });
+}
+
+mapped_file::access_scope::access_scope()
+{
+#if !defined(_WIN32)
+    std::call_once(bus_handler_flag, install_bus_handler);
+    if (access_depth++ == 0) {
+        is_access_faulted = false;
+    }
+#endif
+}
+
+mapped_file::access_scope::~access_scope()
+{
+#if !defined(_WIN32)
+    --access_depth;
+#endif
+}
+
+bool mapped_file::access_scope::is_faulted() const
+{
+#if defined(_WIN32)
+    return false;
+#else
+    return is_access_faulted;
+#endif
+}
+
+void mapped_file::unmap()
+{
+    if (!_data) {
+        return;
+    }
+#if defined(_WIN32)
+    UnmapViewOfFile(_data);
+#else
+    ::munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+    _data = nullptr;
+    _size = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+/// @brief Read only memory mapping of a whole file, empty if the file can not be opened or has no byte
+/// @details Pages are read by the system on first access and shared with the file cache, nothing is copied. Another
+/// program can truncate the file while it is mapped, so the bytes are only read through access().
+class mapped_file {
+public:
+    mapped_file() = default;
+
+    /// @brief Maps the file, leaves the mapping empty on any error
+    explicit mapped_file(const std::filesystem::path& path);
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+    ~mapped_file();
+
+    /// @brief Gets the first byte of the file
+    [[nodiscard]] const unsigned char* data() const;
+
+    /// @brief Gets the size of the file in bytes
+    [[nodiscard]] std::size_t size() const;
+
+    /// @brief Gets if nothing is mapped
+    [[nodiscard]] bool empty() const;
+
+    /// @brief Calls function() which reads the mapping, false if the file got shorter than the mapping meanwhile
+    /// @details Reading pages past the end of a truncated file faults (SIGBUS). While the function runs such a fault
+    /// puts zero filled pages in place of the missing ones, the function reads zeros and its result must be thrown
+    /// away. Windows refuses to truncate a mapped file. Bytes rewritten in place are read as they are now.
+    template <typename Function>
+    [[nodiscard]] bool access(Function&& function) const;
+
+    /// @brief Copies bytes of the mapping, false if the range or the file is no longer complete
+    [[nodiscard]] bool copy(const std::size_t offset, unsigned char* data, const std::size_t length) const;
+
+private:
+    /// @brief Marks the calling thread as reading mappings while it lives
+    class access_scope {
+    public:
+        access_scope();
+        access_scope(const access_scope&) = delete;
+        access_scope& operator=(const access_scope&) = delete;
+        ~access_scope();
+
+        /// @brief Gets if a page of a truncated file was read since the outermost scope of the thread began
+        [[nodiscard]] bool is_faulted() const;
+    };
+
+    void unmap();
+
+    const unsigned char* _data = nullptr;
+    std::size_t _size = 0;
+};
+
+template <typename Function>
+bool mapped_file::access(Function&& function) const
+{
+    const access_scope _scope;
+    function();
+    return !_scope.is_faulted();
+}
@@ -0,0 +1,41 @@
+#include "notes.hpp"
+
+void active_notes::update(const unsigned char* data, const std::size_t length)
+{
+    if (length != 3) {
+        return;
+    }
+    const unsigned char _kind = data[0] & 0xF0;
+    const std::size_t _channel = data[0] & 0x0F;
+    const std::size_t _word = _channel * 2 + (data[1] >> 6);
+    const std::uint64_t _bit = std::uint64_t(1) << (data[1] & 0x3F);
+    if (_kind == 0x90 && data[2] != 0) {
+        _bits[_word] |= _bit;
+    } else if (_kind == 0x80 || _kind == 0x90) {
+        _bits[_word] &= ~_bit;
+    } else if (_kind == 0xB0 && (data[1] == 120 || data[1] == 123)) {
+        _bits[_channel * 2] = 0;
+        _bits[_channel * 2 + 1] = 0;
+    }
+}
+
+bool active_notes::is_sounding(const std::size_t channel, const std::size_t note) const
+{
+    return (_bits[channel * 2 + (note >> 6)] >> (note & 0x3F)) & 1;
+}
+
+std::size_t active_notes::count() const
+{
+    std::size_t _count = 0;
+    for (std::uint64_t _word : _bits) {
+        for (; _word; _word &= _word - 1) {
+            ++_count;
+        }
+    }
+    return _count;
+}
+
+void active_notes::clear()
+{
+    _bits = {};
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/// @brief Notes sounding on one port as one bit per channel and note, 256 bytes for 16 x 128 notes
+/// @details Only used from the thread sending to the port, so releasing them sends exactly the note offs needed
+/// instead of all notes off or a sweep of every channel and note.
+class active_notes {
+public:
+    /// @brief Bytes of a sweep sending a note off to every channel and note without running status
+    static constexpr std::size_t full_sweep_bytes = 16 * 128 * 3;
+
+    /// @brief Follows one complete message sent to the port
+    /// @details Note ons set their bit, note offs and note ons of velocity 0 clear it, all sound off (CC 120) and all
+    /// notes off (CC 123) clear their channel.
+    void update(const unsigned char* data, const std::size_t length);
+
+    /// @brief Calls sink(const unsigned char* data, std::size_t length) with a note off for every sounding note and forgets them
+    /// @details Note offs are sent as note ons of velocity 0 ordered by channel, so running status can omit their status bytes.
+    template <typename Sink>
+    void release(Sink&& sink);
+
+    /// @brief Gets if a note is sounding
+    [[nodiscard]] bool is_sounding(const std::size_t channel, const std::size_t note) const;
+
+    /// @brief Gets the count of sounding notes
+    [[nodiscard]] std::size_t count() const;
+
+    /// @brief Forgets every note without sending anything
+    void clear();
+
+private:
+    std::array<std::uint64_t, 32> _bits = {}; // two words per channel, notes 0..63 then 64..127
+};
+
+template <typename Sink>
+void active_notes::release(Sink&& sink)
+{
+    for (std::size_t _word = 0; _word < _bits.size(); ++_word) {
+        std::uint64_t _notes = _bits[_word];
+        while (_notes) {
+#if defined(_MSC_VER)
+            unsigned long _bit = 0;
+            _BitScanForward64(&_bit, _notes);
+#else
+            const int _bit = __builtin_ctzll(_notes);
+#endif
+            _notes &= _notes - 1;
+            const unsigned char _message[3] = {
+                static_cast<unsigned char>(0x90 | (_word >> 1)),
+                static_cast<unsigned char>(((_word & 1) << 6) | static_cast<std::size_t>(_bit)),
+                0
+            };
+            sink(static_cast<const unsigned char*>(_message), sizeof(_message));
+        }
+        _bits[_word] = 0;
+    }
+}
@@ -0,0 +1,22 @@
+#include "parser.hpp"
+
+midi_stream_parser::midi_stream_parser(const std::size_t max_sysex_size)
+    : _sysex(std::make_unique<unsigned char[]>(max_sysex_size))
+    , _sysex_capacity(max_sysex_size)
+{
+}
+
+void midi_stream_parser::reset()
+{
+    _is_sysex = false;
+    _is_sysex_overflow = false;
+    _sysex_size = 0;
+    _running_status = 0;
+    _message_size = 0;
+    _message_expected = 0;
+}
+
+std::size_t midi_stream_parser::get_dropped_sysex_count() const
+{
+    return _dropped_sysex_count;
+}
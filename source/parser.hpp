@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/// @brief Immutable complete message shared between its owner and the output queues without copies
+using midi_message_blob = std::shared_ptr<const std::vector<unsigned char>>;
+
+/// @brief Gets if the byte is a status byte
+[[nodiscard]] inline bool is_midi_status(const unsigned char byte)
+{
+    return (byte & 0x80) != 0;
+}
+
+/// @brief Gets if the byte is a system realtime byte (F8..FF)
+[[nodiscard]] inline bool is_midi_realtime(const unsigned char byte)
+{
+    return byte >= 0xF8;
+}
+
+/// @brief Gets if the byte is a system common byte (F0..F7)
+[[nodiscard]] inline bool is_midi_system_common(const unsigned char byte)
+{
+    return byte >= 0xF0 && byte <= 0xF7;
+}
+
+/// @brief Gets the count of data bytes following a status byte, or -1 for SysEx
+[[nodiscard]] inline int get_midi_data_count(const unsigned char byte)
+{
+    if (byte < 0xF0) { // channel voice
+        const unsigned char _high = byte & 0xF0;
+        return (_high == 0xC0 || _high == 0xD0) ? 1 : 2; // PC/Channel Pressure=1, others=2
+    }
+    switch (byte) { // system common
+    case 0xF0:
+        return -1; // SysEx (variable until F7)
+    case 0xF1:
+        return 1; // MTC Quarter Frame
+    case 0xF2:
+        return 2; // Song Position
+    case 0xF3:
+        return 1; // Song Select
+    default:
+        return 0; // tune request, EOX, real-time (F8..FF) or undefined F4/F5 => 0 data
+    }
+}
+
+/// @brief Gets if the bytes are exactly one SysEx message, F0 then data bytes only then F7
+[[nodiscard]] inline bool is_complete_sysex(const unsigned char* data, const std::size_t length)
+{
+    if (length < 2 || data[0] != 0xF0 || data[length - 1] != 0xF7) {
+        return false;
+    }
+    for (std::size_t _index = 1; _index + 1 < length; ++_index) {
+        if (is_midi_status(data[_index])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Splits one raw MIDI byte stream into complete messages, keeping running status and partial messages between calls
+class midi_stream_parser {
+public:
+    /// @brief Creates a parser whose SysEx buffer is allocated once with the given capacity
+    explicit midi_stream_parser(const std::size_t max_sysex_size = 65536);
+
+    /// @brief Parses bytes and calls sink(const unsigned char* data, std::size_t length) for every complete message
+    /// @details Running status is expanded, realtime bytes are emitted as they arrive even inside SysEx, and SysEx
+    /// messages larger than the capacity are dropped. The data pointer is only valid during the sink call.
+    template <typename Sink>
+    void parse(const unsigned char* data, const std::size_t length, Sink&& sink);
+
+    /// @brief Forgets running status and any partial message
+    void reset();
+
+    /// @brief Gets the count of SysEx messages dropped because they did not fit the buffer or were interrupted
+    [[nodiscard]] std::size_t get_dropped_sysex_count() const;
+
+private:
+    std::unique_ptr<unsigned char[]> _sysex;
+    std::size_t _sysex_capacity = 0;
+    std::size_t _sysex_size = 0;
+    std::size_t _dropped_sysex_count = 0;
+    bool _is_sysex = false;
+    bool _is_sysex_overflow = false;
+    unsigned char _running_status = 0;
+    unsigned char _message[3] = { 0, 0, 0 };
+    std::size_t _message_size = 0;
+    std::size_t _message_expected = 0;
+};
+
+template <typename Sink>
+void midi_stream_parser::parse(const unsigned char* data, const std::size_t length, Sink&& sink)
+{
+    for (std::size_t _index = 0; _index < length; ++_index) {
+        const unsigned char _byte = data[_index];
+        if (is_midi_realtime(_byte)) {
+            sink(data + _index, 1);
+            continue;
+        }
+
+        if (_is_sysex) {
+            if (!is_midi_status(_byte) || _byte == 0xF7) {
+                if (_sysex_size < _sysex_capacity) {
+                    _sysex[_sysex_size++] = _byte;
+                } else {
+                    _is_sysex_overflow = true;
+                }
+                if (_byte == 0xF7) {
+                    if (_is_sysex_overflow) {
+                        ++_dropped_sysex_count;
+                    } else {
+                        sink(_sysex.get(), _sysex_size);
+                    }
+                    _is_sysex = false;
+                }
+                continue;
+            }
+            // a status byte other than EOX aborts the unterminated SysEx
+            ++_dropped_sysex_count;
+            _is_sysex = false;
+        }
+
+        if (_byte == 0xF0) {
+            _is_sysex = _sysex_capacity > 0;
+            _is_sysex_overflow = false;
+            _sysex_size = 0;
+            if (_is_sysex) {
+                _sysex[_sysex_size++] = _byte;
+            }
+            _running_status = 0;
+            _message_size = 0;
+            continue;
+        }
+
+        if (is_midi_status(_byte)) {
+            const std::size_t _count = static_cast<std::size_t>(get_midi_data_count(_byte));
+            _running_status = is_midi_system_common(_byte) ? 0 : _byte;
+            if (_count == 0) {
+                if (_byte != 0xF7) {
+                    sink(data + _index, 1);
+                }
+                _message_size = 0;
+                continue;
+            }
+            // a message whole in this packet goes to the sink from the packet itself
+            if (_index + _count < length && !is_midi_status(data[_index + 1]) && (_count == 1 || !is_midi_status(data[_index + 2]))) {
+                sink(data + _index, 1 + _count);
+                _index += _count;
+                _message_size = 0;
+                continue;
+            }
+            _message[0] = _byte;
+            _message_size = 1;
+            _message_expected = 1 + _count;
+            continue;
+        }
+
+        if (_message_size == 0) {
+            if (!_running_status) {
+                continue; // stray data byte
+            }
+            _message[0] = _running_status;
+            const std::size_t _count = static_cast<std::size_t>(get_midi_data_count(_running_status));
+            if (_count == 1 || (_index + 1 < length && !is_midi_status(data[_index + 1]))) {
+                _message[1] = _byte;
+                _message[2] = _count == 2 ? data[_index + 1] : 0;
+                sink(static_cast<const unsigned char*>(_message), 1 + _count);
+                _index += _count - 1;
+                continue;
+            }
+            _message_size = 1;
+            _message_expected = 1 + _count;
+        }
+        _message[_message_size++] = _byte;
+        if (_message_size == _message_expected) {
+            sink(static_cast<const unsigned char*>(_message), _message_size);
+            _message_size = 0;
+        }
+    }
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+/// @brief Bounded wait-free ring of length prefixed, stamped and tagged byte packets for one producer thread and one consumer thread
+template <std::size_t Capacity>
+class spsc_ring {
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    /// @brief Pushes a packet from the producer thread, returns false without blocking if there is not enough room
+    [[nodiscard]] bool try_push(const unsigned char* data, const std::size_t length, const std::int64_t stamp = 0, const std::uint32_t tag = 0)
+    {
+        const std::size_t _tail = _tail_position.load(std::memory_order_relaxed);
+        const std::size_t _head = _head_position.load(std::memory_order_acquire);
+        if (length > UINT32_MAX || header_size + length > Capacity - (_tail - _head)) {
+            return false;
+        }
+        const std::uint32_t _length = static_cast<std::uint32_t>(length);
+        write(_tail, reinterpret_cast<const unsigned char*>(&_length), sizeof(_length));
+        write(_tail + sizeof(_length), reinterpret_cast<const unsigned char*>(&tag), sizeof(tag));
+        write(_tail + stamp_offset, reinterpret_cast<const unsigned char*>(&stamp), sizeof(stamp));
+        write(_tail + header_size, data, length);
+        _tail_position.store(_tail + header_size + length, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Pops the next packet from the consumer thread, returns false if the ring is empty
+    bool try_pop(std::vector<unsigned char>& packet)
+    {
+        std::int64_t _stamp = 0;
+        return try_pop(packet, _stamp);
+    }
+
+    /// @brief Pops the next packet and the stamp it was pushed with, returns false if the ring is empty
+    bool try_pop(std::vector<unsigned char>& packet, std::int64_t& stamp)
+    {
+        const std::size_t _head = _head_position.load(std::memory_order_relaxed);
+        const std::size_t _tail = _tail_position.load(std::memory_order_acquire);
+        if (_head == _tail) {
+            return false;
+        }
+        std::uint32_t _length = 0;
+        read(_head, reinterpret_cast<unsigned char*>(&_length), sizeof(_length));
+        read(_head + stamp_offset, reinterpret_cast<unsigned char*>(&stamp), sizeof(stamp));
+        packet.resize(_length);
+        read(_head + header_size, packet.data(), _length);
+        _head_position.store(_head + header_size + _length, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Pops the next packet into a caller owned buffer without allocating, returns false if the ring is empty
+    /// @details If the packet is larger than the buffer it stays in the ring, false is returned and length is set to its size.
+    bool try_pop(unsigned char* packet, const std::size_t capacity, std::size_t& length, std::int64_t& stamp)
+    {
+        std::uint32_t _tag = 0;
+        return try_pop(packet, capacity, length, stamp, _tag);
+    }
+
+    /// @brief Pops the next packet into a caller owned buffer with the stamp and tag it was pushed with
+    bool try_pop(unsigned char* packet, const std::size_t capacity, std::size_t& length, std::int64_t& stamp, std::uint32_t& tag)
+    {
+        length = 0;
+        const std::size_t _head = _head_position.load(std::memory_order_relaxed);
+        const std::size_t _tail = _tail_position.load(std::memory_order_acquire);
+        if (_head == _tail) {
+            return false;
+        }
+        std::uint32_t _length = 0;
+        read(_head, reinterpret_cast<unsigned char*>(&_length), sizeof(_length));
+        length = _length;
+        if (_length > capacity) {
+            return false;
+        }
+        read(_head + sizeof(_length), reinterpret_cast<unsigned char*>(&tag), sizeof(tag));
+        read(_head + stamp_offset, reinterpret_cast<unsigned char*>(&stamp), sizeof(stamp));
+        read(_head + header_size, packet, _length);
+        _head_position.store(_head + header_size + _length, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Gets if the ring holds no packet
+    [[nodiscard]] bool empty() const
+    {
+        return _head_position.load(std::memory_order_acquire) == _tail_position.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr std::size_t stamp_offset = sizeof(std::uint32_t) + sizeof(std::uint32_t); // after the length and the tag
+    static constexpr std::size_t header_size = stamp_offset + sizeof(std::int64_t);
+
+    void write(const std::size_t position, const unsigned char* data, const std::size_t length)
+    {
+        const std::size_t _offset = position & (Capacity - 1);
+        const std::size_t _first = length < Capacity - _offset ? length : Capacity - _offset;
+        std::memcpy(_data + _offset, data, _first);
+        std::memcpy(_data, data + _first, length - _first);
+    }
+
+    void read(const std::size_t position, unsigned char* data, const std::size_t length) const
+    {
+        const std::size_t _offset = position & (Capacity - 1);
+        const std::size_t _first = length < Capacity - _offset ? length : Capacity - _offset;
+        std::memcpy(data, _data + _offset, _first);
+        std::memcpy(data + _first, _data, length - _first);
+    }
+
+    alignas(64) std::atomic<std::size_t> _head_position = 0;
+    alignas(64) std::atomic<std::size_t> _tail_position = 0;
+    alignas(64) unsigned char _data[Capacity];
+};
+
+/// @brief Lets a consumer thread sleep until producers signal, producers only lock when the consumer is about to sleep
+class ring_wakeup {
+public:
+    /// @brief Wakes the consumer if it is waiting, called by producers after publishing work
+    void notify()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_is_waiting.exchange(false)) {
+            std::lock_guard<std::mutex> _lock_guard(_mutex);
+            _condition.notify_one();
+        }
+    }
+
+    /// @brief Sleeps the consumer until notified, unless has_work() already returns true
+    template <typename Predicate>
+    void wait(Predicate&& has_work)
+    {
+        std::unique_lock<std::mutex> _lock(_mutex);
+        _is_waiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (has_work()) {
+            _is_waiting.store(false);
+            return;
+        }
+        _condition.wait(_lock, [this] { return !_is_waiting.load(); });
+    }
+
+    /// @brief Sleeps the consumer until notified or until the deadline, unless has_work() already returns true
+    template <typename Predicate>
+    void wait_until(const std::chrono::steady_clock::time_point& deadline, Predicate&& has_work)
+    {
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            wait(has_work);
+            return;
+        }
+        std::unique_lock<std::mutex> _lock(_mutex);
+        _is_waiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!has_work()) {
+            _condition.wait_until(_lock, deadline, [this] { return !_is_waiting.load(); });
+        }
+        _is_waiting.store(false);
+    }
+
+private:
+    std::atomic<bool> _is_waiting = false;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+};
@@ -1,389 +1,1025 @@
 #include "router.hpp"
+#include "clock.hpp"
+#include "parser.hpp"
+#include "ring.hpp"
+#include "scheduler.hpp"
+#include "timer_wheel.hpp"
 
-#define NOMINMAX
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-
-#include <RtMidi.h>
-#include <teVirtualMIDI.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#include <time.h>
+#endif
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <memory>
 #include <mutex>
-#include <optional>
+#include <stdexcept>
 #include <thread>
+#include <utility>
 #include <vector>
 
 namespace {
 
-using PFN_CreateEx2 = LPVM_MIDI_PORT(WINAPI*)(LPCWSTR, LPVM_MIDI_DATA_CB, LPVOID, DWORD, DWORD);
-using PFN_GetData = BOOL(WINAPI*)(LPVM_MIDI_PORT, PBYTE, PDWORD);
-using PFN_SendData = BOOL(WINAPI*)(LPVM_MIDI_PORT, PBYTE, DWORD);
-using PFN_Close = VOID(WINAPI*)(LPVM_MIDI_PORT);
+static constexpr std::size_t hardware_ring_capacity = 1 << 18;
+static constexpr std::size_t control_source = max_virtual_inputs; // ring of the thread calling send_to_hardware_output
+static constexpr std::size_t clock_source = max_virtual_inputs + 1; // ring of the clock thread
+static constexpr std::size_t hardware_source_count = max_virtual_inputs + 2;
+static constexpr std::size_t clock_ring_capacity = 1 << 12;
+static constexpr std::chrono::microseconds scheduled_sleep(100); // before a timer is due, slept without waking for new packets
+static constexpr std::size_t staging_capacity = 1 << 12; // per output of a virtual input, larger messages are pushed alone
 
-static std::mutex hardware_mutex;
-static RtMidiOut hardware_midiout;
-static HMODULE virtual_module = nullptr;
-static PFN_CreateEx2 virtual_create_ex2 = nullptr;
-static PFN_GetData virtual_get_data = nullptr;
-static PFN_SendData virtual_send_data = nullptr;
-static PFN_Close virtual_close = nullptr;
-static LPVM_MIDI_PORT virtual_midiout = nullptr;
-static std::atomic<bool> is_virtual_running = false;
-static std::thread virtual_thread;
+/// @brief Tags of the packets in the hardware rings
+enum struct hardware_packet : std::uint32_t {
+    bytes, // raw bytes for the parser of the source
+    blob, // pointer to a heap allocated midi_message_blob handle the output thread takes ownership of
+    release_notes, // no bytes, queues a note off for every sounding note
+    scheduled, // complete messages to send at the time in the stamp
+};
 
-[[nodiscard]] static std::string to_string(const std::wstring& utf16)
-{
-    if (utf16.empty()) {
-        return {};
+/// @brief State of one hardware output, each virtual input and the control thread push into their own ring
+struct hardware_port {
+    std::array<spsc_ring<hardware_ring_capacity>, hardware_source_count> rings;
+    std::array<midi_stream_parser, hardware_source_count> parsers;
+    midi_stream_parser scheduled_parser; // reset for every scheduled packet, they only hold complete messages
+    timer_wheel<scheduled_message> timers;
+    std::unique_ptr<midi_output_transport> output;
+    std::atomic<midi_output_transport*> pending_output = nullptr;
+    output_scheduler scheduler;
+    latency_histograms latency;
+    std::atomic<output_pacing*> pending_pacing = nullptr;
+    std::atomic<std::size_t> ring_bytes = 0; // bytes pushed by senders and not yet popped by the output thread
+    std::atomic<double> bytes_per_millisecond = output_pacing().bytes_per_millisecond;
+    std::atomic<std::int64_t> high_water_milliseconds = output_pacing().high_water_delay.count();
+    std::atomic<output_overflow_policy> overflow_policy = output_pacing().overflow_policy;
+    std::atomic<std::int64_t> delay = 0; // steady clock ticks added to routed messages, they are scheduled when not zero
+    std::atomic<bool> is_running = false;
+    ring_wakeup wakeup;
+    std::thread thread;
+};
+
+/// @brief State of one virtual input, only touched by its receive thread once started
+struct virtual_port {
+    ~virtual_port()
+    {
+        delete pending_routes.exchange(nullptr);
+    }
+
+    std::unique_ptr<midi_input_transport> transport;
+    std::size_t input = 0;
+    midi_stream_parser parser;
+    midi_input_routes routes;
+    std::atomic<midi_input_routes*> pending_routes = nullptr;
+    std::array<std::vector<unsigned char>, max_hardware_outputs> staging; // consecutive messages to each output, pushed as one packet
+    midi_output_mask staged_outputs = 0; // outputs with staged messages
+};
+
+/// @brief State of one virtual output, hardware inputs send to it directly from their receive threads
+struct virtual_output_port {
+    std::mutex mutex; // only contended when several hardware inputs reach the same output
+    std::unique_ptr<midi_output_transport> transport;
+    latency_histograms latency; // written under the mutex
+    std::atomic<bool> is_open = false;
+};
+
+/// @brief State of one hardware input, only touched by its receive thread once started
+struct hardware_input_port {
+    ~hardware_input_port()
+    {
+        delete pending_routes.exchange(nullptr);
     }
 
-    const int _size = WideCharToMultiByte(CP_UTF8, 0, utf16.data(), static_cast<int>(utf16.size()), nullptr, 0, nullptr, nullptr);
-    std::string _utf8(_size, 0);
-    WideCharToMultiByte(CP_UTF8, 0, utf16.data(), static_cast<int>(utf16.size()), _utf8.data(), _size, nullptr, nullptr);
-    return _utf8;
+    std::unique_ptr<midi_input_transport> transport;
+    midi_stream_parser parser;
+    midi_input_routes routes;
+    std::atomic<midi_input_routes*> pending_routes = nullptr;
+};
+
+/// @brief State of the clock engine, the virtual inputs push the clock messages they take out of their routes
+struct clock_engine {
+    std::array<spsc_ring<clock_ring_capacity>, max_virtual_inputs> ticks; // status byte stamped with its ingress time
+    midi_clock_settings settings; // only touched by the clock thread while it runs
+    std::atomic<std::size_t> followed_input = max_virtual_inputs;
+    std::atomic<bool> is_master = false; // incoming ticks would double the generated ones
+    std::atomic<std::int64_t> period = 0; // steady clock ticks between two clock ticks, 0 until known
+    latency_histograms jitter; // interval errors recorded as latency_class::realtime
+    std::atomic<bool> is_running = false;
+    ring_wakeup wakeup;
+    std::thread thread;
+};
+
+// hardware and virtual output ports are allocated on first use and never freed so input threads can always reach them
+static std::array<std::atomic<hardware_port*>, max_hardware_outputs> hardware_ports = {};
+static std::mutex hardware_ports_mutex;
+static std::array<std::unique_ptr<virtual_port>, max_virtual_inputs> virtual_ports;
+static routing_table current_routes { { midi_route() } };
+static std::array<std::atomic<virtual_output_port*>, max_virtual_outputs> virtual_output_ports = {};
+static std::mutex virtual_output_ports_mutex;
+static std::array<std::unique_ptr<hardware_input_port>, max_hardware_inputs> hardware_input_ports;
+static routing_table current_return_routes { { midi_route() } };
+static std::array<output_compensation, max_hardware_outputs> hardware_compensations;
+static bool is_hardware_alignment_automatic = false;
+static std::chrono::steady_clock::duration hardware_alignment_tolerance = std::chrono::steady_clock::duration::zero();
+static std::mutex hardware_compensations_mutex;
+static clock_engine midi_clock;
+
+[[nodiscard]] static hardware_port* find_hardware_port(const std::size_t output)
+{
+    return output < max_hardware_outputs ? hardware_ports[output].load(std::memory_order_acquire) : nullptr;
 }
 
-[[nodiscard]] static std::wstring to_wstring(const std::string& utf8)
+[[nodiscard]] static hardware_port& get_hardware_port(const std::size_t output)
 {
-    if (utf8.empty()) {
-        return {};
+    if (output >= max_hardware_outputs) {
+        throw std::runtime_error("Hardware output " + std::to_string(output) + " is out of range");
     }
+    if (hardware_port* _port = find_hardware_port(output)) {
+        return *_port;
+    }
+    std::lock_guard<std::mutex> _lock_guard(hardware_ports_mutex);
+    if (hardware_port* _port = find_hardware_port(output)) {
+        return *_port;
+    }
+    hardware_port* _port = new hardware_port();
+    hardware_ports[output].store(_port, std::memory_order_release);
+    return *_port;
+}
+
+[[nodiscard]] static virtual_output_port* find_virtual_output_port(const std::size_t output)
+{
+    return output < max_virtual_outputs ? virtual_output_ports[output].load(std::memory_order_acquire) : nullptr;
+}
 
-    const int _size = MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), nullptr, 0);
-    std::wstring _utf16(_size, 0);
-    MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), _utf16.data(), _size);
-    return _utf16;
+[[nodiscard]] static virtual_output_port& get_virtual_output_port(const std::size_t output)
+{
+    if (output >= max_virtual_outputs) {
+        throw std::runtime_error("Virtual output " + std::to_string(output) + " is out of range");
+    }
+    if (virtual_output_port* _port = find_virtual_output_port(output)) {
+        return *_port;
+    }
+    std::lock_guard<std::mutex> _lock_guard(virtual_output_ports_mutex);
+    if (virtual_output_port* _port = find_virtual_output_port(output)) {
+        return *_port;
+    }
+    virtual_output_port* _port = new virtual_output_port();
+    virtual_output_ports[output].store(_port, std::memory_order_release);
+    return *_port;
 }
 
-[[nodiscard]] static std::string get_last_error_message(DWORD error)
+[[nodiscard]] static latency_report get_report(const latency_histograms& histograms)
 {
-    LPWSTR _buffer = nullptr;
-    const DWORD _flags = FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS;
-    const DWORD _language_id = MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT);
-    const DWORD _result = FormatMessageW(_flags, nullptr, error, _language_id, (LPWSTR)&_buffer, 0, nullptr);
-    const std::wstring _message = _result ? std::wstring(_buffer, _result) : L"(unknown)";
+    latency_report _report;
+    for (std::size_t _class = 0; _class < _report.size(); ++_class) {
+        _report[_class] = histograms.get_snapshot(static_cast<latency_class>(_class));
+    }
+    return _report;
+}
 
-    if (_buffer) {
-        LocalFree(_buffer);
+static void update_hardware_output_delays()
+{
+    std::lock_guard<std::mutex> _lock_guard(hardware_compensations_mutex);
+    std::array<std::chrono::steady_clock::duration, max_hardware_outputs> _response_times = {};
+    std::chrono::steady_clock::duration _slowest = std::chrono::steady_clock::duration::zero();
+    for (std::size_t _output = 0; _output < max_hardware_outputs; ++_output) {
+        const hardware_port* _port = find_hardware_port(_output);
+        if (_port && _port->is_running.load()) {
+            // a note starts sounding once its last byte is on the wire
+            const std::chrono::duration<double, std::milli> _wire_time(3.0 / _port->bytes_per_millisecond.load());
+            _response_times[_output] = hardware_compensations[_output].device_latency + std::chrono::duration_cast<std::chrono::steady_clock::duration>(_wire_time);
+            _slowest = std::max(_slowest, _response_times[_output]);
+        }
+    }
+    for (std::size_t _output = 0; _output < max_hardware_outputs; ++_output) {
+        hardware_port* _port = find_hardware_port(_output);
+        if (!_port) {
+            continue;
+        }
+        std::chrono::steady_clock::duration _delay = hardware_compensations[_output].offset;
+        const std::chrono::steady_clock::duration _alignment = _slowest - _response_times[_output];
+        if (is_hardware_alignment_automatic && _port->is_running.load() && _alignment > hardware_alignment_tolerance) {
+            _delay += _alignment;
+        }
+        _port->delay.store(std::max(_delay, std::chrono::steady_clock::duration::zero()).count());
     }
+}
 
-    return to_string(_message);
+[[nodiscard]] static bool has_hardware_work(const hardware_port& port)
+{
+    if (!port.is_running.load() || port.pending_output.load() || port.pending_pacing.load()) {
+        return true;
+    }
+    for (const spsc_ring<hardware_ring_capacity>& _ring : port.rings) {
+        if (!_ring.empty()) {
+            return true;
+        }
+    }
+    return false;
 }
 
-[[nodiscard]] static bool is_status(unsigned char byte)
+[[nodiscard]] static std::chrono::steady_clock::duration get_queue_delay(const hardware_port& port)
 {
-    return (byte & 0x80) != 0;
+    const std::size_t _queued_bytes = port.ring_bytes.load() + port.scheduler.get_counters().queued_bytes.load();
+    const double _milliseconds = static_cast<double>(_queued_bytes) / port.bytes_per_millisecond.load();
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(_milliseconds));
 }
 
-[[nodiscard]] static bool is_realtime(unsigned char byte)
+[[nodiscard]] static bool is_congested(const hardware_port& port)
 {
-    return byte >= 0xF8;
+    return get_queue_delay(port) > std::chrono::milliseconds(port.high_water_milliseconds.load());
 }
 
-[[nodiscard]] static bool is_system_common(unsigned char byte)
+[[nodiscard]] static bool is_rejecting(const hardware_port& port)
 {
-    return byte >= 0xF0 && byte <= 0xF7;
+    return port.overflow_policy.load() == output_overflow_policy::reject && is_congested(port);
 }
 
-[[nodiscard]] static int data_count_for_status(unsigned char byte)
+[[nodiscard]] static bool push_to_hardware_port(hardware_port& port, const std::size_t source, const unsigned char* data, const std::size_t length, const std::size_t wire_length, const std::int64_t stamp, const hardware_packet tag)
 {
-    if (byte < 0xF0) { // channel voice
-        unsigned char hi = byte & 0xF0;
-        return (hi == 0xC0 || hi == 0xD0) ? 1 : 2; // PC/Channel Pressure=1, others=2
-    }
-    switch (byte) { // system common
-    case 0xF0:
-        return -1; // SysEx (variable until F7)
-    case 0xF1:
-        return 1; // MTC Quarter Frame
-    case 0xF2:
-        return 2; // Song Position
-    case 0xF3:
-        return 1; // Song Select
-    case 0xF6:
-        return 0; // Tune Request
-    case 0xF7:
-        return 0; // EOX (handled mainly inside SysEx)
-    default:
-        return 0; // real-time (F8..FF) or undefined F4/F5 => 0 data
+    port.ring_bytes.fetch_add(wire_length);
+    if (!port.rings[source].try_push(data, length, stamp, static_cast<std::uint32_t>(tag))) {
+        port.ring_bytes.fetch_sub(wire_length);
+        return false;
     }
+    return true;
 }
 
-static void send_short(const unsigned char* data, const std::size_t length)
+static void schedule_hardware_packet(hardware_port& port, const unsigned char* data, const std::size_t length, const output_scheduler::clock::time_point due)
 {
-    try {
-        hardware_midiout.sendMessage(data, (int)length);
-    } catch (...) {
-    }
+    port.scheduled_parser.reset();
+    port.scheduled_parser.parse(data, length, [&port, due](const unsigned char* message, const std::size_t message_length) {
+        scheduled_message _message;
+        if (message_length > sizeof(_message.bytes)) {
+            _message.sysex = std::make_shared<const std::vector<unsigned char>>(message, message + message_length);
+        } else {
+            std::memcpy(_message.bytes, message, message_length);
+            _message.size = message_length;
+        }
+        port.timers.insert(due, std::move(_message));
+    });
 }
 
-static void send_vector(const std::vector<unsigned char>& data)
+/// @brief Drops every packet left in the rings of a closed port so none is replayed once it opens again
+static void discard_hardware_packets(hardware_port& port, midi_receive_arena& arena)
 {
-    if (!data.empty()) {
-        try {
-            hardware_midiout.sendMessage(&data);
-        } catch (...) {
+    for (spsc_ring<hardware_ring_capacity>& _ring : port.rings) {
+        std::size_t _length = 0;
+        std::int64_t _stamp = 0;
+        std::uint32_t _tag = 0;
+        while (_ring.try_pop(arena.data(), arena.capacity(), _length, _stamp, _tag)) {
+            if (_tag == static_cast<std::uint32_t>(hardware_packet::blob)) {
+                // the handle was allocated by the sender and is only freed by the output thread
+                midi_message_blob* _handle = nullptr;
+                std::memcpy(&_handle, arena.data(), sizeof(_handle));
+                delete _handle;
+            }
         }
     }
+    for (midi_stream_parser& _parser : port.parsers) {
+        _parser.reset();
+    }
+    port.scheduled_parser.reset();
+    port.ring_bytes.store(0);
 }
 
-static void send_byte(const unsigned char byte)
+static void sleep_until(const output_scheduler::clock::time_point time)
 {
-    send_short(&byte, 1);
+#if defined(__linux__)
+    // an absolute deadline on the monotonic clock, the time spent before the sleep starts is not added to it
+    const std::chrono::nanoseconds _time = time.time_since_epoch();
+    timespec _deadline;
+    _deadline.tv_sec = static_cast<time_t>(std::chrono::duration_cast<std::chrono::seconds>(_time).count());
+    _deadline.tv_nsec = static_cast<long>((_time % std::chrono::seconds(1)).count());
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &_deadline, nullptr) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_until(time);
+#endif
 }
 
-static void split_and_send(const std::vector<unsigned char>& data)
+static void run_hardware_output(hardware_port& port, std::promise<void>& opened)
 {
-    static unsigned char _running_status = 0;
-    static std::vector<unsigned char> _sysex_accumulate;
-
-    std::size_t _index = 0;
-    while (_index < data.size()) {
-        const unsigned char _byte = data[_index];
-        if (is_realtime(_byte)) {
-            send_byte(_byte);
-            ++_index;
-            continue;
-        }
-
-        if (_byte == 0xF0 || !_sysex_accumulate.empty()) {
-            if (_byte == 0xF0 && _sysex_accumulate.empty()) {
-                _sysex_accumulate.clear();
-                _sysex_accumulate.push_back(0xF0);
-                ++_index;
+#if defined(__linux__)
+    // timed waits wake within a few microseconds instead of the default 50 us slack
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif
+    midi_receive_arena _arena(hardware_ring_capacity);
+    // a sender that saw the port open just before it last closed may have pushed after it was drained then, senders
+    // only see the port open again once this thread, the only consumer of the rings, dropped those packets
+    discard_hardware_packets(port, _arena);
+    port.is_running.store(true);
+    opened.set_value();
+    port.scheduler.set_latency_histograms(&port.latency);
+    while (port.is_running.load()) {
+        if (midi_output_transport* _output = port.pending_output.exchange(nullptr)) {
+            if (port.output) {
+                // a SysEx cut in the middle and the notes still sounding are only ended on the port being switched away
+                // from, the rest of the SysEx is dropped
+                port.scheduler.terminate_sysex(*port.output);
+                port.scheduler.release_notes(output_scheduler::clock::now(), *port.output);
             }
-            for (; _index < data.size(); ++_index) {
-                const unsigned char _char = data[_index];
-                if (is_realtime(_char)) {
-                    send_byte(_char);
-                    continue;
-                }
-                _sysex_accumulate.push_back(_char);
-                if (_char == 0xF7) {
-                    send_vector(_sysex_accumulate);
-                    _sysex_accumulate.clear();
-                    ++_index;
-                    break;
+            port.output.reset(_output);
+            port.scheduler.reset_wire();
+        }
+        if (const std::unique_ptr<output_pacing> _pacing { port.pending_pacing.exchange(nullptr) }) {
+            port.scheduler.set_pacing(*_pacing);
+        }
+        bool _is_drained = true;
+        for (std::size_t _source = 0; _source < port.rings.size(); ++_source) {
+            std::size_t _length = 0;
+            std::int64_t _stamp = 0;
+            std::uint32_t _tag = 0;
+            if (port.rings[_source].try_pop(_arena.data(), _arena.capacity(), _length, _stamp, _tag)) {
+                const output_scheduler::clock::time_point _ingress_time { output_scheduler::clock::duration(_stamp) };
+                if (_tag == static_cast<std::uint32_t>(hardware_packet::release_notes)) {
+                    port.scheduler.release_notes(_ingress_time);
+                } else if (_tag == static_cast<std::uint32_t>(hardware_packet::scheduled)) {
+                    schedule_hardware_packet(port, _arena.data(), _length, _ingress_time);
+                    port.ring_bytes.fetch_sub(_length);
+                } else if (_tag == static_cast<std::uint32_t>(hardware_packet::blob)) {
+                    midi_message_blob* _handle = nullptr;
+                    std::memcpy(&_handle, _arena.data(), sizeof(_handle));
+                    const std::unique_ptr<midi_message_blob> _blob(_handle);
+                    port.scheduler.push(*_blob, _ingress_time);
+                    port.ring_bytes.fetch_sub((*_blob)->size());
+                } else {
+                    port.parsers[_source].parse(_arena.data(), _length, [&port, _ingress_time](const unsigned char* data, const std::size_t length) {
+                        port.scheduler.push(data, length, _ingress_time);
+                    });
+                    port.ring_bytes.fetch_sub(_length);
                 }
+                _is_drained = false;
+            }
+        }
+        const output_scheduler::clock::time_point _now = output_scheduler::clock::now();
+        port.timers.advance(_now, [&port](const output_scheduler::clock::time_point due, scheduled_message&& message) {
+            if (message.sysex) {
+                port.scheduler.push(message.sysex, due, true);
+            } else {
+                port.scheduler.push(message.bytes, message.size, due, true);
             }
-            _running_status = 0;
+        });
+        // the scheduler tells when the wire can take the next message and the timers when the next one is due, new
+        // packets wake the thread earlier
+        const output_scheduler::clock::time_point _send_deadline = port.output ? port.scheduler.flush(_now, *port.output) : output_scheduler::clock::time_point::max();
+        const output_scheduler::clock::time_point _timer_deadline = port.timers.next_deadline();
+        if (!_is_drained) {
             continue;
         }
+        if (_timer_deadline < _send_deadline && _timer_deadline - _now <= scheduled_sleep) {
+            // the last stretch before a timer is one absolute sleep, a packet arriving meanwhile waits for the timer
+            sleep_until(_timer_deadline);
+        } else if (_timer_deadline < _send_deadline) {
+            port.wakeup.wait_until(_timer_deadline - scheduled_sleep, [&port] { return has_hardware_work(port); });
+        } else {
+            port.wakeup.wait_until(_send_deadline, [&port] { return has_hardware_work(port); });
+        }
+    }
+    if (port.output) {
+        port.scheduler.terminate_sysex(*port.output);
+    }
+    port.scheduler.clear();
+    port.timers.clear();
+    if (port.output) {
+        port.scheduler.release_notes(output_scheduler::clock::now(), *port.output);
+    }
+    port.output.reset();
+    discard_hardware_packets(port, _arena);
+}
 
-        if (is_status(_byte)) {
-            const int _need = data_count_for_status(_byte);
-            if (is_system_common(_byte) && _byte != 0xF0) {
-                const std::size_t _have = data.size() - (_index + 1);
-                const std::size_t _take = (_need > 0 && _have >= static_cast<std::size_t>(_need)) ? static_cast<std::size_t>(_need) : 0;
-                unsigned char _message[3] = { _byte, 0, 0 };
-                for (size_t k = 0; k < _take; ++k) {
-                    _message[1 + k] = data[_index + 1 + k];
-                }
-                send_short(_message, 1 + _take);
-                _index += 1 + _take;
-                _running_status = 0;
+static void send_clock_message(const midi_output_mask outputs, const unsigned char status, const output_scheduler::clock::time_point time)
+{
+    const std::int64_t _stamp = time.time_since_epoch().count();
+    midi_output_mask _outputs = outputs;
+    while (_outputs) {
+        const std::size_t _output = get_lowest_output(_outputs);
+        _outputs &= _outputs - 1;
+        hardware_port* _port = find_hardware_port(_output);
+        if (_port && _port->is_running.load() && push_to_hardware_port(*_port, clock_source, &status, 1, 1, _stamp, hardware_packet::bytes)) {
+            _port->wakeup.notify();
+        }
+    }
+}
+
+static void run_midi_clock(clock_engine& engine)
+{
+#if defined(__linux__)
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif
+    const midi_clock_settings& _settings = engine.settings;
+    midi_clock_tracker _tracker(_settings.bandwidth);
+    const output_scheduler::clock::duration _master_period = std::chrono::duration_cast<output_scheduler::clock::duration>(std::chrono::duration<double>(60.0 / (24.0 * _settings.tempo)));
+    const output_scheduler::clock::time_point _master_origin = output_scheduler::clock::now();
+    output_scheduler::clock::time_point _master_next = _master_origin + _master_period;
+    std::uint64_t _sent = 0;
+    output_scheduler::clock::time_point _last_sent = {};
+    spsc_ring<clock_ring_capacity>* _ticks = _settings.mode == midi_clock_mode::follow ? &engine.ticks[_settings.input] : nullptr;
+    if (!_ticks) {
+        engine.period.store(_master_period.count());
+    }
+    while (engine.is_running.load()) {
+        std::size_t _length = 0;
+        std::int64_t _stamp = 0;
+        std::uint32_t _tag = 0;
+        unsigned char _status = 0;
+        while (_ticks && _ticks->try_pop(&_status, sizeof(_status), _length, _stamp, _tag)) {
+            if (_status == 0xF8) {
+                _tracker.receive(output_scheduler::clock::time_point(output_scheduler::clock::duration(_stamp)));
+                engine.period.store(_tracker.get_period().count());
                 continue;
             }
+            // start, continue and stop leave after the ticks received before them and no tick is predicted past them
+            _tracker.stop();
+            const output_scheduler::clock::time_point _now = output_scheduler::clock::now();
+            while (_tracker.has_next(_now)) {
+                send_clock_message(_settings.outputs, 0xF8, _now);
+                _tracker.send();
+            }
+            send_clock_message(_settings.outputs, _status, _now);
+        }
+        const output_scheduler::clock::time_point _now = output_scheduler::clock::now();
+        const bool _has_next = !_ticks || _tracker.has_next(_now);
+        const output_scheduler::clock::time_point _deadline = !_has_next ? output_scheduler::clock::time_point::max() : _ticks ? _tracker.get_next_time() : _master_next;
+        if (_now < _deadline) {
+            engine.wakeup.wait_until(_deadline, [&engine, _ticks] { return !engine.is_running.load() || (_ticks && !_ticks->empty()); });
+            continue;
+        }
+        send_clock_message(_settings.outputs, 0xF8, _now);
+        if (_ticks) {
+            _tracker.send();
+        } else {
+            // ticks missed while the thread was late are skipped, a burst would jump the receivers ahead
+            _master_next = _master_origin + _master_period * ((_now - _master_origin) / _master_period + 1);
+        }
+        const output_scheduler::clock::duration _period(engine.period.load());
+        if (_sent && _period.count()) {
+            const output_scheduler::clock::duration _interval = _now - _last_sent;
+            engine.jitter.record(latency_class::realtime, _interval > _period ? _interval - _period : _period - _interval);
+        }
+        ++_sent;
+        _last_sent = _now;
+    }
+    engine.period.store(0);
+}
 
-            if (_need >= 0) {
-                if (_index + 1 + _need <= data.size()) {
-                    unsigned char _message[3] = { _byte, 0, 0 };
-                    for (int k = 0; k < _need; ++k) {
-                        _message[1 + k] = data[_index + 1 + k];
-                    }
-                    send_short(_message, 1 + static_cast<std::size_t>(_need));
-                    _running_status = _byte;
-                    _index += 1 + static_cast<std::size_t>(_need);
-                } else {
-                    _index = data.size();
-                }
+static void push_virtual_input(virtual_port& port, const std::size_t output, const unsigned char* data, const std::size_t length, const std::int64_t stamp, midi_output_mask& pushed)
+{
+    hardware_port* _hardware = find_hardware_port(output);
+    const bool _is_realtime = length == 1 && is_midi_realtime(data[0]);
+    if (!_hardware || !_hardware->is_running.load() || (!_is_realtime && is_rejecting(*_hardware))) {
+        return;
+    }
+    // a delayed output holds the messages in its timer wheel until the slower outputs catch up
+    const std::int64_t _delay = _hardware->delay.load();
+    const hardware_packet _tag = _delay ? hardware_packet::scheduled : hardware_packet::bytes;
+    if (push_to_hardware_port(*_hardware, port.input, data, length, length, stamp + _delay, _tag)) {
+        pushed |= midi_output_mask(1) << output;
+    }
+}
+
+static void flush_virtual_output(virtual_port& port, const std::size_t output, const std::int64_t stamp, midi_output_mask& pushed)
+{
+    std::vector<unsigned char>& _staging = port.staging[output];
+    if (!_staging.empty()) {
+        push_virtual_input(port, output, _staging.data(), _staging.size(), stamp, pushed);
+        _staging.clear();
+    }
+    port.staged_outputs &= ~(midi_output_mask(1) << output);
+}
+
+static void flush_virtual_input(virtual_port& port, const std::int64_t stamp, midi_output_mask& pushed)
+{
+    while (port.staged_outputs) {
+        flush_virtual_output(port, get_lowest_output(port.staged_outputs), stamp, pushed);
+    }
+}
+
+static void stage_virtual_input(virtual_port& port, const std::size_t output, const unsigned char* message, const std::size_t length, const std::int64_t stamp, midi_output_mask& pushed)
+{
+    // every output stages on its own so plain and transformed routes of the same input do not flush each other
+    std::vector<unsigned char>& _staging = port.staging[output];
+    const bool _is_realtime = is_midi_realtime(message[0]);
+    if (_is_realtime || _staging.size() + length > staging_capacity) {
+        flush_virtual_output(port, output, stamp, pushed);
+    }
+    if (_is_realtime || length > staging_capacity) {
+        // realtime bytes are pushed alone so they can pass a rejecting output
+        push_virtual_input(port, output, message, length, stamp, pushed);
+        return;
+    }
+    if (_staging.capacity() < staging_capacity) {
+        _staging.reserve(staging_capacity);
+    }
+    _staging.insert(_staging.end(), message, message + length);
+    port.staged_outputs |= midi_output_mask(1) << output;
+}
+
+static void receive_virtual_input(void* context, const unsigned char* data, const std::size_t length)
+{
+    virtual_port& _port = *static_cast<virtual_port*>(context);
+    if (const std::unique_ptr<midi_input_routes> _routes { _port.pending_routes.exchange(nullptr) }) {
+        _port.routes = std::move(*_routes);
+    }
+    const std::int64_t _ingress_stamp = output_scheduler::clock::now().time_since_epoch().count();
+    midi_output_mask _pushed = 0;
+    _port.parser.parse(data, length, [&_port, &_pushed, _ingress_stamp](const unsigned char* message, const std::size_t message_length) {
+        if ((message[0] == 0xF8 || (message[0] >= 0xFA && message[0] <= 0xFC)) && midi_clock.followed_input.load(std::memory_order_relaxed) == _port.input) {
+            // the clock engine sends the tick again at its smoothed time, start, continue and stop in order with the ticks
+            if (midi_clock.ticks[_port.input].try_push(message, 1, _ingress_stamp)) {
+                midi_clock.wakeup.notify();
+            }
+            return;
+        }
+        if (message[0] == 0xF8 && midi_clock.is_master.load(std::memory_order_relaxed)) {
+            return;
+        }
+        // one load finds every output of the message, filters were resolved when the routes were compiled
+        const midi_output_mask _outputs = _port.routes.outputs[message[0]];
+        midi_output_mask _plain = _outputs & ~_port.routes.transformed_outputs;
+        while (_plain) {
+            const std::size_t _output = get_lowest_output(_plain);
+            _plain &= _plain - 1;
+            stage_virtual_input(_port, _output, message, message_length, _ingress_stamp, _pushed);
+        }
+        midi_output_mask _transformed = _outputs & _port.routes.transformed_outputs;
+        while (_transformed) {
+            // each transformed output stages its own copy, SysEx is never changed
+            const std::size_t _output = get_lowest_output(_transformed);
+            _transformed &= _transformed - 1;
+            if (message[0] == 0xF0) {
+                stage_virtual_input(_port, _output, message, message_length, _ingress_stamp, _pushed);
                 continue;
             }
-            ++_index;
-            continue;
+            unsigned char _bytes[3];
+            if (const std::size_t _length = _port.routes.transforms[_output]->apply(message, message_length, _bytes)) {
+                stage_virtual_input(_port, _output, _bytes, _length, _ingress_stamp, _pushed);
+            }
         }
+    });
+    flush_virtual_input(_port, _ingress_stamp, _pushed);
+    while (_pushed) {
+        const std::size_t _output = get_lowest_output(_pushed);
+        _pushed &= _pushed - 1;
+        find_hardware_port(_output)->wakeup.notify();
+    }
+}
 
-        if (_running_status) {
-            const int _need = data_count_for_status(_running_status);
-            if (_need == 1) {
-                const unsigned char _message[2] = { _running_status, data[_index] };
-                send_short(_message, 2);
-                ++_index;
-            } else if (_need == 2) {
-                if (_index + 1 < data.size()) {
-                    unsigned char _message[3] = { _running_status, data[_index], data[_index + 1] };
-                    send_short(_message, 3);
-                    _index += 2;
-                } else {
-                    ++_index;
-                }
-            } else {
-                ++_index;
+static void send_to_virtual_output(const std::size_t output, const unsigned char* message, const std::size_t length, const output_scheduler::clock::time_point ingress_time)
+{
+    virtual_output_port* _port = find_virtual_output_port(output);
+    if (!_port || !_port->is_open.load()) {
+        return;
+    }
+    const latency_class _class = message[0] == 0xF0 ? latency_class::sysex : length == 1 && is_midi_realtime(message[0]) ? latency_class::realtime : latency_class::voice;
+    std::lock_guard<std::mutex> _lock_guard(_port->mutex);
+    if (_port->transport) {
+        _port->transport->send(message, length);
+        _port->latency.record(_class, output_scheduler::clock::now() - ingress_time);
+    }
+}
+
+static void receive_hardware_input(void* context, const unsigned char* data, const std::size_t length)
+{
+    hardware_input_port& _port = *static_cast<hardware_input_port*>(context);
+    if (const std::unique_ptr<midi_input_routes> _routes { _port.pending_routes.exchange(nullptr) }) {
+        _port.routes = std::move(*_routes);
+    }
+    const output_scheduler::clock::time_point _ingress_time = output_scheduler::clock::now();
+    _port.parser.parse(data, length, [&_port, _ingress_time](const unsigned char* message, const std::size_t message_length) {
+        midi_output_mask _outputs = _port.routes.outputs[message[0]];
+        while (_outputs) {
+            const std::size_t _output = get_lowest_output(_outputs);
+            _outputs &= _outputs - 1;
+            if (!((_port.routes.transformed_outputs >> _output) & 1) || message[0] == 0xF0) {
+                send_to_virtual_output(_output, message, message_length, _ingress_time);
+                continue;
+            }
+            unsigned char _bytes[3];
+            if (const std::size_t _length = _port.routes.transforms[_output]->apply(message, message_length, _bytes)) {
+                send_to_virtual_output(_output, _bytes, _length, _ingress_time);
             }
-            continue;
         }
+    });
+}
+
+}
+
+std::vector<std::string> get_hardware_ports()
+{
+    return get_rtmidi_output_ports();
+}
+
+void open_hardware_output(const std::size_t output, const std::size_t& index)
+{
+    open_hardware_output(output, create_rtmidi_output(index));
+}
 
-        ++_index;
+void open_hardware_output(const std::size_t output, std::unique_ptr<midi_output_transport> transport)
+{
+    // the transport is swapped in by the output thread so senders never wait on it
+    hardware_port& _port = get_hardware_port(output);
+    delete _port.pending_output.exchange(transport.release());
+    if (_port.is_running.load()) {
+        _port.wakeup.notify();
+        return;
     }
+    // the output thread opens the port to senders once it drained its rings
+    std::promise<void> _opened;
+    std::future<void> _is_opened = _opened.get_future();
+    _port.thread = std::thread(run_hardware_output, std::ref(_port), std::ref(_opened));
+    _is_opened.wait();
+    update_hardware_output_delays();
 }
 
-static void unload_vtmidi_library()
+void close_hardware_output(const std::size_t output)
 {
-    virtual_create_ex2 = nullptr;
-    virtual_get_data = nullptr;
-    virtual_send_data = nullptr;
-    virtual_close = nullptr;
+    hardware_port* _port = find_hardware_port(output);
+    if (!_port || !_port->is_running.exchange(false)) {
+        return;
+    }
+    _port->wakeup.notify();
+    if (_port->thread.joinable()) {
+        _port->thread.join();
+    }
+    delete _port->pending_output.exchange(nullptr);
+    update_hardware_output_delays();
+}
 
-    if (virtual_module) {
-        FreeLibrary(virtual_module);
-        virtual_module = nullptr;
+void close_hardware_outputs()
+{
+    for (std::size_t _output = 0; _output < max_hardware_outputs; ++_output) {
+        close_hardware_output(_output);
     }
 }
 
-static void load_vtmidi_library()
+void set_hardware_output_pacing(const std::size_t output, const output_pacing& pacing)
 {
-#if defined(_WIN64)
-    const wchar_t* _candidate_paths[] = { L".\\teVirtualMIDI64.dll", L"teVirtualMIDI64.dll" };
-#else
-    const wchar_t* _candidate_paths[] = { L".\\teVirtualMIDI32.dll", L"teVirtualMIDI32.dll" };
-#endif
+    hardware_port& _port = get_hardware_port(output);
+    _port.bytes_per_millisecond.store(pacing.bytes_per_millisecond);
+    _port.high_water_milliseconds.store(pacing.high_water_delay.count());
+    _port.overflow_policy.store(pacing.overflow_policy);
+    delete _port.pending_pacing.exchange(new output_pacing(pacing));
+    _port.wakeup.notify();
+    update_hardware_output_delays();
+}
 
-    if (virtual_module) {
-        return;
+void set_hardware_output_compensation(const std::size_t output, const output_compensation& compensation)
+{
+    if (output >= max_hardware_outputs) {
+        throw std::runtime_error("Hardware output " + std::to_string(output) + " is out of range");
     }
+    {
+        std::lock_guard<std::mutex> _lock_guard(hardware_compensations_mutex);
+        hardware_compensations[output] = compensation;
+    }
+    update_hardware_output_delays();
+}
 
-    for (const wchar_t* _path : _candidate_paths) {
-        virtual_module = LoadLibraryW(_path);
-        if (virtual_module) {
-            break;
-        }
+void set_hardware_output_alignment(const bool is_automatic, const std::chrono::steady_clock::duration tolerance)
+{
+    {
+        std::lock_guard<std::mutex> _lock_guard(hardware_compensations_mutex);
+        is_hardware_alignment_automatic = is_automatic;
+        hardware_alignment_tolerance = tolerance;
     }
+    update_hardware_output_delays();
+}
+
+std::chrono::steady_clock::duration get_hardware_output_delay(const std::size_t output)
+{
+    const hardware_port* _port = find_hardware_port(output);
+    return std::chrono::steady_clock::duration(_port ? _port->delay.load() : 0);
+}
+
+const output_counters& get_hardware_output_counters(const std::size_t output)
+{
+    return get_hardware_port(output).scheduler.get_counters();
+}
+
+latency_report get_latency_report(const std::size_t output)
+{
+    return get_report(get_hardware_port(output).latency);
+}
+
+std::chrono::steady_clock::duration estimated_hardware_queue_delay(const std::size_t output)
+{
+    const hardware_port* _port = find_hardware_port(output);
+    return _port ? get_queue_delay(*_port) : std::chrono::steady_clock::duration::zero();
+}
+
+bool is_hardware_output_congested(const std::size_t output)
+{
+    const hardware_port* _port = find_hardware_port(output);
+    return _port && is_congested(*_port);
+}
+
+bool is_hardware_output_open(const std::size_t output)
+{
+    const hardware_port* _port = find_hardware_port(output);
+    return _port && _port->is_running.load();
+}
 
-    if (!virtual_module) {
-        DWORD _error = GetLastError();
-        throw std::runtime_error(std::string("LoadLibrary failed: ") + get_last_error_message(_error).c_str());
+bool send_to_hardware_output(const std::size_t output, const unsigned char* data, const std::size_t length)
+{
+    hardware_port* _port = find_hardware_port(output);
+    if (!_port || !_port->is_running.load()) {
+        return false;
+    }
+    if (!length) {
+        return true;
+    }
+    const bool _is_realtime = length == 1 && is_midi_realtime(data[0]);
+    if (!_is_realtime && is_rejecting(*_port)) {
+        return false;
     }
+    const std::int64_t _ingress_stamp = output_scheduler::clock::now().time_since_epoch().count();
+    if (!push_to_hardware_port(*_port, control_source, data, length, length, _ingress_stamp, hardware_packet::bytes)) {
+        return false;
+    }
+    _port->wakeup.notify();
+    return true;
+}
 
-    virtual_create_ex2 = reinterpret_cast<PFN_CreateEx2>(GetProcAddress(virtual_module, "virtualMIDICreatePortEx2"));
-    virtual_get_data = reinterpret_cast<PFN_GetData>(GetProcAddress(virtual_module, "virtualMIDIGetData"));
-    virtual_send_data = reinterpret_cast<PFN_SendData>(GetProcAddress(virtual_module, "virtualMIDISendData"));
-    virtual_close = reinterpret_cast<PFN_Close>(GetProcAddress(virtual_module, "virtualMIDIClosePort"));
+bool send_to_hardware_output(const std::size_t output, const std::vector<unsigned char>& message)
+{
+    return send_to_hardware_output(output, message.data(), message.size());
+}
 
-    if (!virtual_create_ex2 || !virtual_get_data || !virtual_close) {
-        unload_vtmidi_library();
-        throw std::runtime_error("GetProcAddress failed (missing exports)");
+bool send_to_hardware_output(const std::size_t output, const midi_message_blob& message)
+{
+    hardware_port* _port = find_hardware_port(output);
+    if (!_port || !_port->is_running.load()) {
+        return false;
+    }
+    if (!message || message->empty()) {
+        return true;
+    }
+    if (is_rejecting(*_port)) {
+        return false;
+    }
+    // only the handle goes through the ring, the bytes are shared with the caller until they are on the wire
+    midi_message_blob* _handle = new midi_message_blob(message);
+    const std::int64_t _ingress_stamp = output_scheduler::clock::now().time_since_epoch().count();
+    if (!push_to_hardware_port(*_port, control_source, reinterpret_cast<const unsigned char*>(&_handle), sizeof(_handle), message->size(), _ingress_stamp, hardware_packet::blob)) {
+        delete _handle;
+        return false;
     }
+    _port->wakeup.notify();
+    return true;
 }
 
-static void remove_last_word_inplace(std::string& s)
+bool send_to_hardware_output_at(const std::size_t output, const std::chrono::steady_clock::time_point time, const unsigned char* data, const std::size_t length)
 {
-    const char* _whitespace = " \t\n\r\f\v";
-    const std::size_t _end = s.find_last_not_of(_whitespace);
-    if (_end == std::string::npos) {
-        s.clear();
-        return;
+    hardware_port* _port = find_hardware_port(output);
+    if (!_port || !_port->is_running.load()) {
+        return false;
+    }
+    if (!length) {
+        return true;
+    }
+    const bool _is_realtime = length == 1 && is_midi_realtime(data[0]);
+    if (!_is_realtime && is_rejecting(*_port)) {
+        return false;
+    }
+    // the ring stamp carries the requested time instead of the ingress time
+    const std::int64_t _due_stamp = time.time_since_epoch().count();
+    if (!push_to_hardware_port(*_port, control_source, data, length, length, _due_stamp, hardware_packet::scheduled)) {
+        return false;
     }
-    s.erase(_end + 1);
-    const std::size_t _separator = s.find_last_of(_whitespace);
-    if (_separator == std::string::npos) {
-        s.clear();
+    _port->wakeup.notify();
+    return true;
+}
+
+bool send_to_hardware_output_at(const std::size_t output, const std::chrono::steady_clock::time_point time, const std::vector<unsigned char>& message)
+{
+    return send_to_hardware_output_at(output, time, message.data(), message.size());
+}
+
+bool release_hardware_output_notes(const std::size_t output)
+{
+    hardware_port* _port = find_hardware_port(output);
+    if (!_port || !_port->is_running.load()) {
+        return false;
+    }
+    const std::int64_t _ingress_stamp = output_scheduler::clock::now().time_since_epoch().count();
+    const unsigned char _empty = 0;
+    if (!push_to_hardware_port(*_port, control_source, &_empty, 0, 0, _ingress_stamp, hardware_packet::release_notes)) {
+        return false;
+    }
+    _port->wakeup.notify();
+    return true;
+}
+
+void set_midi_clock(const midi_clock_settings& settings)
+{
+    if (settings.mode == midi_clock_mode::follow && settings.input >= max_virtual_inputs) {
+        throw std::runtime_error("Virtual input " + std::to_string(settings.input) + " is out of range");
+    }
+    if (settings.mode == midi_clock_mode::master && !(settings.tempo > 0)) {
+        throw std::runtime_error("Clock tempo must be positive");
+    }
+    midi_clock.followed_input.store(max_virtual_inputs);
+    midi_clock.is_master.store(settings.mode == midi_clock_mode::master);
+    if (midi_clock.is_running.exchange(false)) {
+        midi_clock.wakeup.notify();
+        midi_clock.thread.join();
+    }
+    // ticks left from the previous run would be taken as a burst of incoming ticks
+    for (spsc_ring<clock_ring_capacity>& _ring : midi_clock.ticks) {
+        std::size_t _length = 0;
+        std::int64_t _stamp = 0;
+        std::uint32_t _tag = 0;
+        unsigned char _status = 0;
+        while (_ring.try_pop(&_status, sizeof(_status), _length, _stamp, _tag)) {
+        }
+    }
+    midi_clock.settings = settings;
+    if (settings.mode == midi_clock_mode::through) {
         return;
     }
-    s.erase(_separator);
+    midi_clock.is_running.store(true);
+    midi_clock.thread = std::thread(run_midi_clock, std::ref(midi_clock));
+    if (settings.mode == midi_clock_mode::follow) {
+        midi_clock.followed_input.store(settings.input);
+    }
 }
 
+double get_midi_clock_tempo()
+{
+    const std::int64_t _period = midi_clock.period.load();
+    return _period ? 60.0 / (24.0 * std::chrono::duration<double>(output_scheduler::clock::duration(_period)).count()) : 0.0;
 }
 
-std::vector<std::string> get_hardware_ports()
+latency_snapshot get_midi_clock_jitter()
+{
+    return midi_clock.jitter.get_snapshot(latency_class::realtime);
+}
+
+void set_midi_routes(const std::vector<midi_route>& routes)
 {
-    std::vector<std::string> _hardware_ports;
-    _hardware_ports.resize(hardware_midiout.getPortCount());
-    for (unsigned int _index = 0; _index < _hardware_ports.size(); ++_index) {
-        _hardware_ports[_index] = hardware_midiout.getPortName(_index);
-        remove_last_word_inplace(_hardware_ports[_index]);
+    current_routes = routing_table(routes);
+    for (const std::unique_ptr<virtual_port>& _port : virtual_ports) {
+        if (_port) {
+            delete _port->pending_routes.exchange(new midi_input_routes(current_routes.get_input_routes(_port->input)));
+        }
     }
-    return _hardware_ports;
 }
 
-void open_hardware_output(const std::size_t& index)
+void open_virtual_input(const std::size_t input, const std::string& port)
 {
-    std::lock_guard<std::mutex> _lock_guard(hardware_mutex);
-    if (hardware_midiout.isPortOpen()) {
-        hardware_midiout.closePort();
+    if (is_virtual_input_open(input)) {
+        return;
     }
-    hardware_midiout.openPort(index);
+    open_virtual_input(input, create_virtual_input(port));
 }
 
-void close_hardware_output()
+void open_virtual_input(const std::size_t input, std::unique_ptr<midi_input_transport> transport)
 {
-    std::lock_guard<std::mutex> _lock_guard(hardware_mutex);
-    if (hardware_midiout.isPortOpen()) {
-        hardware_midiout.closePort();
+    if (input >= max_virtual_inputs) {
+        throw std::runtime_error("Virtual input " + std::to_string(input) + " is out of range");
     }
+    if (virtual_ports[input]) {
+        return;
+    }
+    std::unique_ptr<virtual_port> _port = std::make_unique<virtual_port>();
+    _port->transport = std::move(transport);
+    _port->input = input;
+    _port->routes = current_routes.get_input_routes(input);
+    midi_receive_callback _callback;
+    _callback.function = receive_virtual_input;
+    _callback.context = _port.get();
+    _port->transport->start(_callback);
+    virtual_ports[input] = std::move(_port);
 }
 
-bool is_hardware_output_open()
+void close_virtual_input(const std::size_t input)
 {
-    std::lock_guard<std::mutex> _lock_guard(hardware_mutex);
-    return hardware_midiout.isPortOpen();
+    if (input < max_virtual_inputs && virtual_ports[input]) {
+        virtual_ports[input]->transport->stop();
+        virtual_ports[input].reset();
+    }
 }
 
-void send_to_hardware_output(const std::vector<unsigned char>& message)
+void close_virtual_inputs()
 {
-    std::lock_guard<std::mutex> _lock_guard(hardware_mutex);
-    if (hardware_midiout.isPortOpen()) {
-        split_and_send(message);
+    for (std::size_t _input = 0; _input < max_virtual_inputs; ++_input) {
+        close_virtual_input(_input);
     }
 }
 
-void open_virtual_input(const std::string& port, const std::function<void(const std::vector<unsigned char>&)>& callback)
+bool is_virtual_input_open(const std::size_t input)
+{
+    return input < max_virtual_inputs && virtual_ports[input] != nullptr;
+}
+
+std::vector<std::string> get_hardware_input_ports()
+{
+    return get_rtmidi_input_ports();
+}
+
+void set_midi_return_routes(const std::vector<midi_route>& routes)
 {
-    if (is_virtual_running.load()) {
+    current_return_routes = routing_table(routes);
+    for (std::size_t _input = 0; _input < max_hardware_inputs; ++_input) {
+        if (hardware_input_ports[_input]) {
+            delete hardware_input_ports[_input]->pending_routes.exchange(new midi_input_routes(current_return_routes.get_input_routes(_input)));
+        }
+    }
+}
+
+void open_hardware_input(const std::size_t input, const std::size_t& index)
+{
+    if (is_hardware_input_open(input)) {
         return;
     }
+    open_hardware_input(input, create_rtmidi_input(index));
+}
 
-    load_vtmidi_library();
+void open_hardware_input(const std::size_t input, std::unique_ptr<midi_input_transport> transport)
+{
+    if (input >= max_hardware_inputs) {
+        throw std::runtime_error("Hardware input " + std::to_string(input) + " is out of range");
+    }
+    if (hardware_input_ports[input]) {
+        return;
+    }
+    std::unique_ptr<hardware_input_port> _port = std::make_unique<hardware_input_port>();
+    _port->transport = std::move(transport);
+    _port->routes = current_return_routes.get_input_routes(input);
+    midi_receive_callback _callback;
+    _callback.function = receive_hardware_input;
+    _callback.context = _port.get();
+    _port->transport->start(_callback);
+    hardware_input_ports[input] = std::move(_port);
+}
 
-    const DWORD _flags = 0;
-    const DWORD _max_sysex_size = 65535;
-    virtual_midiout = virtual_create_ex2(to_wstring(port).c_str(), nullptr, nullptr, _max_sysex_size, _flags);
-    if (!virtual_midiout) {
-        throw std::runtime_error("CreatePortEx2 failed");
+void close_hardware_input(const std::size_t input)
+{
+    if (input < max_hardware_inputs && hardware_input_ports[input]) {
+        hardware_input_ports[input]->transport->stop();
+        hardware_input_ports[input].reset();
     }
+}
 
-    is_virtual_running = true;
-    virtual_thread = std::thread([callback] {
-        std::vector<unsigned char> _buffer(65536);
-        while (is_virtual_running.load()) {
+void close_hardware_inputs()
+{
+    for (std::size_t _input = 0; _input < max_hardware_inputs; ++_input) {
+        close_hardware_input(_input);
+    }
+}
 
-            DWORD _size;
-            if (virtual_get_data(virtual_midiout, _buffer.data(), &_size)) {
-                _buffer.resize(_size);
-                callback(_buffer);
-            } else {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            }
-        }
-    });
+bool is_hardware_input_open(const std::size_t input)
+{
+    return input < max_hardware_inputs && hardware_input_ports[input] != nullptr;
+}
+
+void open_virtual_output(const std::size_t output, const std::string& port)
+{
+    open_virtual_output(output, create_virtual_output(port));
 }
 
-void close_virtual_input()
+void open_virtual_output(const std::size_t output, std::unique_ptr<midi_output_transport> transport)
 {
-    if (!is_virtual_running.exchange(false)) {
+    virtual_output_port& _port = get_virtual_output_port(output);
+    std::unique_ptr<midi_output_transport> _previous;
+    {
+        std::lock_guard<std::mutex> _lock_guard(_port.mutex);
+        _previous = std::exchange(_port.transport, std::move(transport));
+    }
+    _port.is_open.store(true);
+}
+
+void close_virtual_output(const std::size_t output)
+{
+    virtual_output_port* _port = find_virtual_output_port(output);
+    if (!_port || !_port->is_open.exchange(false)) {
         return;
     }
-    LPVM_MIDI_PORT _port = virtual_midiout;
-    virtual_midiout = nullptr;
-    if (_port) {
-        virtual_close(_port);
+    std::unique_ptr<midi_output_transport> _previous;
+    {
+        std::lock_guard<std::mutex> _lock_guard(_port->mutex);
+        _previous = std::move(_port->transport);
     }
-    if (virtual_thread.joinable()) {
-        virtual_thread.join();
+}
+
+void close_virtual_outputs()
+{
+    for (std::size_t _output = 0; _output < max_virtual_outputs; ++_output) {
+        close_virtual_output(_output);
     }
-    unload_vtmidi_library();
 }
 
-bool is_virtual_input_open()
+bool is_virtual_output_open(const std::size_t output)
+{
+    const virtual_output_port* _port = find_virtual_output_port(output);
+    return _port && _port->is_open.load();
+}
+
+latency_report get_virtual_output_latency_report(const std::size_t output)
 {
-    return is_virtual_running.load();
+    return get_report(get_virtual_output_port(output).latency);
 }
@@ -1,29 +1,194 @@
 #pragma once
 
-#include <functional>
+#include "latency.hpp"
+#include "routing.hpp"
+#include "scheduler.hpp"
+#include "transport.hpp"
+
+#include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 
+/// @brief Maximum count of hardware outputs, they are numbered from 0
+inline constexpr std::size_t max_hardware_outputs = routing_table::max_outputs;
+
+/// @brief Maximum count of virtual inputs, they are numbered from 0
+inline constexpr std::size_t max_virtual_inputs = routing_table::max_inputs;
+
+/// @brief Maximum count of hardware inputs, they are numbered from 0
+inline constexpr std::size_t max_hardware_inputs = routing_table::max_inputs;
+
+/// @brief Maximum count of virtual outputs, they are numbered from 0
+inline constexpr std::size_t max_virtual_outputs = routing_table::max_outputs;
+
 /// @brief Gets a list of the available hardware port names
 [[nodiscard]] std::vector<std::string> get_hardware_ports();
 
-/// @brief Opens the selected hardware port
-void open_hardware_output(const std::size_t& index);
+/// @brief Opens the selected hardware port as a hardware output
+void open_hardware_output(const std::size_t output, const std::size_t& index);
+
+/// @brief Opens a hardware output on any output transport, replacing the current one
+void open_hardware_output(const std::size_t output, std::unique_ptr<midi_output_transport> transport);
+
+/// @brief Closes a hardware output if open
+void close_hardware_output(const std::size_t output);
+
+/// @brief Closes every open hardware output
+void close_hardware_outputs();
+
+/// @brief Changes how fast messages are released to a hardware output, takes effect on its output thread
+void set_hardware_output_pacing(const std::size_t output, const output_pacing& pacing);
+
+/// @brief Delay compensation of a hardware output, lines up devices layered on the same virtual input
+struct output_compensation {
+    std::chrono::steady_clock::duration offset = std::chrono::steady_clock::duration::zero(); // added to every message routed to the output
+    std::chrono::steady_clock::duration device_latency = std::chrono::steady_clock::duration::zero(); // from the last byte on the wire to the sound, used by automatic alignment
+};
+
+/// @brief Changes the delay compensation of a hardware output, takes effect on the next routed message
+void set_hardware_output_compensation(const std::size_t output, const output_compensation& compensation);
+
+/// @brief Turns automatic alignment of the open hardware outputs on or off
+/// @details The response time of an output is its device latency plus the wire time of a note at its pacing rate.
+/// Outputs faster than the slowest open one by more than the tolerance are delayed by the difference, on top of their
+/// offset. Delays are worked out again whenever an output opens or closes or its pacing or compensation changes.
+void set_hardware_output_alignment(const bool is_automatic, const std::chrono::steady_clock::duration tolerance);
+
+/// @brief Gets the delay applied to the messages routed to a hardware output, offset and alignment together
+[[nodiscard]] std::chrono::steady_clock::duration get_hardware_output_delay(const std::size_t output);
+
+/// @brief Gets the counters of a hardware output scheduler, readable from any thread
+[[nodiscard]] const output_counters& get_hardware_output_counters(const std::size_t output);
+
+/// @brief Gets the latency histograms of a hardware output from ingress to the end of the send, per message class
+[[nodiscard]] latency_report get_latency_report(const std::size_t output);
+
+/// @brief Gets the modeled time for every byte queued for a hardware output to reach the wire, readable from any thread
+[[nodiscard]] std::chrono::steady_clock::duration estimated_hardware_queue_delay(const std::size_t output);
+
+/// @brief Gets if the queue of a hardware output is above the high water mark of its pacing
+[[nodiscard]] bool is_hardware_output_congested(const std::size_t output);
+
+/// @brief Gets if a hardware output is open
+[[nodiscard]] bool is_hardware_output_open(const std::size_t output);
+
+/// @brief Queues bytes for a hardware output without blocking, returns false if the output is closed or its queue is full
+/// @details Bypasses the routes and must always be called from the same thread, usually the user interface. Also
+/// returns false while the output is congested and its overflow policy is reject, single realtime bytes are always
+/// accepted. A refused packet may cut a message, the parser resynchronizes on the next status byte.
+bool send_to_hardware_output(const std::size_t output, const unsigned char* data, const std::size_t length);
+
+/// @brief Queues bytes for a hardware output without blocking, returns false if the output is closed or its queue is full
+bool send_to_hardware_output(const std::size_t output, const std::vector<unsigned char>& message);
+
+/// @brief Queues a complete SysEx for a hardware output without parsing or copying it, returns false like the byte overloads
+/// @details The message must pass is_complete_sysex and must not be modified afterwards. It is sent between complete
+/// messages, so the thread must not be in the middle of a message sent as bytes.
+bool send_to_hardware_output(const std::size_t output, const midi_message_blob& message);
+
+/// @brief Queues complete messages for a hardware output to be sent at a given time, returns false like the byte overloads
+/// @details A timer wheel on the output thread holds them until the time, then they are paced and prioritized like
+/// any other message. The thread waits for packets until 100 us before the time, then sleeps to an absolute deadline
+/// with a timer slack of 1 ns. Times in the past send right away. Their lateness against the requested time is recorded
+/// as latency_class::scheduled. Must be called from the same thread as send_to_hardware_output.
+bool send_to_hardware_output_at(const std::size_t output, const std::chrono::steady_clock::time_point time, const unsigned char* data, const std::size_t length);
+
+/// @brief Queues complete messages for a hardware output to be sent at a given time, returns false like the byte overloads
+bool send_to_hardware_output_at(const std::size_t output, const std::chrono::steady_clock::time_point time, const std::vector<unsigned char>& message);
+
+/// @brief Queues a note off for every note sent to a hardware output and still sounding, returns false like the byte overloads
+/// @details Called before a patch change from the same thread as the sends so the note offs leave before the patch.
+/// Switching or closing the transport of an output releases its notes without this call.
+bool release_hardware_output_notes(const std::size_t output);
+
+/// @brief Where the MIDI clock ticks sent to the hardware outputs come from
+enum struct midi_clock_mode {
+    through, // ticks follow the routes like any other message
+    master, // ticks are generated at a fixed tempo, incoming ticks are dropped
+    follow, // ticks of one virtual input are taken out of its routes and sent again smoothed, with its start, continue and stop
+};
+
+/// @brief Configures the clock engine
+struct midi_clock_settings {
+    midi_clock_mode mode = midi_clock_mode::through;
+    double tempo = 120.0; // quarter notes per minute in master mode
+    std::size_t input = 0; // virtual input followed
+    midi_output_mask outputs = 1; // hardware outputs receiving the ticks
+    double bandwidth = 0.02; // of the tracking loop in cycles per tick, lower is smoother and slower to follow tempo changes
+};
+
+/// @brief Replaces the clock settings, restarting the clock thread
+/// @details Outside of through mode a dedicated thread sends each tick at its time with timed waits on the steady
+/// clock, through its own ring of every output so realtime bytes never wait behind another sender. The error of every
+/// interval between two ticks against the tempo is recorded.
+void set_midi_clock(const midi_clock_settings& settings);
+
+/// @brief Gets the tempo of the clock engine in quarter notes per minute, 0 in through mode or until a tempo was found
+[[nodiscard]] double get_midi_clock_tempo();
+
+/// @brief Gets the histogram of how far the intervals between the ticks sent by the clock engine are from its tempo
+[[nodiscard]] latency_snapshot get_midi_clock_jitter();
+
+/// @brief Replaces the routes from virtual inputs to hardware outputs, open inputs pick them up on their next packet
+/// @details Messages routed to an output with a delay go through its timer wheel like send_to_hardware_output_at and
+/// their latency is recorded as latency_class::scheduled.
+void set_midi_routes(const std::vector<midi_route>& routes);
+
+/// @brief Opens the virtual port with the selected name as a virtual input, its messages follow the routes
+void open_virtual_input(const std::size_t input, const std::string& port);
+
+/// @brief Opens a virtual input on any input transport, its messages follow the routes
+void open_virtual_input(const std::size_t input, std::unique_ptr<midi_input_transport> transport);
+
+/// @brief Closes a virtual input if open
+void close_virtual_input(const std::size_t input);
+
+/// @brief Closes every open virtual input
+void close_virtual_inputs();
+
+/// @brief Gets if a virtual input is open
+[[nodiscard]] bool is_virtual_input_open(const std::size_t input);
+
+/// @brief Gets a list of the available hardware input port names
+[[nodiscard]] std::vector<std::string> get_hardware_input_ports();
+
+/// @brief Replaces the return routes from hardware inputs to virtual outputs, open inputs pick them up on their next packet
+/// @details The input and output of each route are a hardware input and a virtual output. Filters and transforms work
+/// like the routes of the other direction.
+void set_midi_return_routes(const std::vector<midi_route>& routes);
+
+/// @brief Opens the selected hardware input port, its messages follow the return routes
+void open_hardware_input(const std::size_t input, const std::size_t& index);
+
+/// @brief Opens a hardware input on any input transport, its messages follow the return routes
+/// @details Messages are parsed, routed and sent to the virtual outputs from the receive thread of the transport,
+/// virtual ports take messages as fast as they come so they are neither queued nor paced.
+void open_hardware_input(const std::size_t input, std::unique_ptr<midi_input_transport> transport);
+
+/// @brief Closes a hardware input if open
+void close_hardware_input(const std::size_t input);
+
+/// @brief Closes every open hardware input
+void close_hardware_inputs();
+
+/// @brief Gets if a hardware input is open
+[[nodiscard]] bool is_hardware_input_open(const std::size_t input);
 
-/// @brief Closes the hardware port if open
-void close_hardware_output();
+/// @brief Opens the virtual port with the selected name as a virtual output, replacing the current one
+void open_virtual_output(const std::size_t output, const std::string& port);
 
-/// @brief Gets if the hardware port is open
-[[nodiscard]] bool is_hardware_output_open();
+/// @brief Opens a virtual output on any output transport, replacing the current one
+void open_virtual_output(const std::size_t output, std::unique_ptr<midi_output_transport> transport);
 
-/// @brief Sends bytes to the hardware port
-void send_to_hardware_output(const std::vector<unsigned char>& message);
+/// @brief Closes a virtual output if open
+void close_virtual_output(const std::size_t output);
 
-/// @brief Opens the virtual port with the selected name and executes a callback when bytes are received
-void open_virtual_input(const std::string& port, const std::function<void(const std::vector<unsigned char>&)>& callback);
+/// @brief Closes every open virtual output
+void close_virtual_outputs();
 
-/// @brief Closes the virtual port if open
-void close_virtual_input();
+/// @brief Gets if a virtual output is open
+[[nodiscard]] bool is_virtual_output_open(const std::size_t output);
 
-/// @brief Gets if the virtual port is open
-[[nodiscard]] bool is_virtual_input_open();
+/// @brief Gets the latency histograms of a virtual output from ingress to the end of the send, per message class
+[[nodiscard]] latency_report get_virtual_output_latency_report(const std::size_t output);
@@ -0,0 +1,136 @@
+#include "routing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace {
+
+static constexpr double min_velocity_exponent = 0.01; // 0 and below would map velocity 1 to pow(0, e), 1 or infinity
+
+}
+
+bool midi_channel_transform::is_identity() const
+{
+    return channel < 0 && transpose == 0 && velocity_exponent == 1.0 && velocity_min == 1 && velocity_max == 127;
+}
+
+midi_transform::midi_transform(const std::array<midi_channel_transform, 16>& transforms)
+    : _first_data_maps {}
+    , _second_data_maps {}
+{
+    midi_byte_map _identity;
+    for (std::size_t _byte = 0; _byte < _identity.size(); ++_byte) {
+        _identity[_byte] = static_cast<unsigned char>(_byte);
+    }
+    _status_map = _identity;
+    _maps.push_back(_identity);
+    for (std::size_t _channel = 0; _channel < transforms.size(); ++_channel) {
+        const midi_channel_transform& _transform = transforms[_channel];
+        if (_transform.channel >= 0 && _transform.channel < 16) {
+            for (std::size_t _status = 0x80 | _channel; _status < 0xF0; _status += 0x10) {
+                _status_map[_status] = static_cast<unsigned char>((_status & 0xF0) | _transform.channel);
+            }
+        }
+        if (_transform.transpose != 0) {
+            midi_byte_map _notes;
+            for (int _byte = 0; _byte < 256; ++_byte) {
+                const int _note = _byte + _transform.transpose;
+                _notes[_byte] = static_cast<unsigned char>(_byte < 128 && _note >= 0 && _note < 128 ? _note : 0x80);
+            }
+            const unsigned char _index = static_cast<unsigned char>(_maps.size());
+            _maps.push_back(_notes);
+            _first_data_maps[0x80 | _channel] = _index;
+            _first_data_maps[0x90 | _channel] = _index;
+            _first_data_maps[0xA0 | _channel] = _index;
+        }
+        if (_transform.velocity_exponent != 1.0 || _transform.velocity_min != 1 || _transform.velocity_max != 127) {
+            midi_byte_map _velocities = _identity;
+            const double _min = std::clamp<double>(_transform.velocity_min, 1, 127);
+            const double _max = std::clamp<double>(_transform.velocity_max, 1, 127);
+            // written so NaN falls back to the minimum as well
+            const double _exponent = _transform.velocity_exponent > min_velocity_exponent ? _transform.velocity_exponent : min_velocity_exponent;
+            for (int _velocity = 1; _velocity < 128; ++_velocity) {
+                const double _curve = std::pow((_velocity - 1) / 126.0, _exponent);
+                _velocities[_velocity] = static_cast<unsigned char>(std::clamp(std::lround(_min + (_max - _min) * _curve), 1L, 127L));
+            }
+            _second_data_maps[0x90 | _channel] = static_cast<unsigned char>(_maps.size());
+            _maps.push_back(_velocities);
+        }
+    }
+}
+
+routing_table::routing_table(const std::vector<midi_route>& routes)
+    : _masks(max_inputs * 256, 0)
+    , _transforms(max_inputs * max_outputs)
+{
+    std::map<std::size_t, std::array<midi_channel_transform, 16>> _pair_transforms;
+    for (const midi_route& _route : routes) {
+        if (_route.input >= max_inputs || _route.output >= max_outputs) {
+            continue;
+        }
+        std::array<midi_channel_transform, 16>& _channel_transforms = _pair_transforms[_route.input * max_outputs + _route.output];
+        for (std::size_t _channel = 0; _channel < _channel_transforms.size(); ++_channel) {
+            if (_route.channels & (1 << _channel)) {
+                _channel_transforms[_channel] = _route.transforms[_channel];
+            }
+        }
+        const midi_output_mask _output = midi_output_mask(1) << _route.output;
+        for (std::size_t _status = 0x80; _status < 256; ++_status) {
+            const midi_message_type _type = get_message_type(static_cast<unsigned char>(_status));
+            const bool _is_type_allowed = (_route.types & static_cast<std::uint16_t>(_type)) != 0;
+            const bool _is_channel_allowed = _status >= 0xF0 || (_route.channels & (1 << (_status & 0x0F))) != 0;
+            if (_is_type_allowed && _is_channel_allowed) {
+                _masks[_route.input * 256 + _status] |= _output;
+            }
+        }
+    }
+    for (const auto& [_pair, _channel_transforms] : _pair_transforms) {
+        const bool _is_identity = std::all_of(_channel_transforms.begin(), _channel_transforms.end(), [](const midi_channel_transform& transform) {
+            return transform.is_identity();
+        });
+        if (!_is_identity) {
+            _transforms[_pair] = std::make_shared<const midi_transform>(_channel_transforms);
+        }
+    }
+}
+
+midi_input_routes routing_table::get_input_routes(const std::size_t input) const
+{
+    midi_input_routes _routes;
+    for (std::size_t _status = 0; _status < _routes.outputs.size(); ++_status) {
+        _routes.outputs[_status] = _masks[input * 256 + _status];
+    }
+    for (std::size_t _output = 0; _output < max_outputs; ++_output) {
+        _routes.transforms[_output] = get_transform(input, _output);
+        if (_routes.transforms[_output]) {
+            _routes.transformed_outputs |= midi_output_mask(1) << _output;
+        }
+    }
+    return _routes;
+}
+
+midi_message_type routing_table::get_message_type(const unsigned char status)
+{
+    switch (status & 0xF0) {
+    case 0x80:
+    case 0x90:
+        return midi_message_type::note;
+    case 0xA0:
+        return midi_message_type::poly_pressure;
+    case 0xB0:
+        return midi_message_type::control_change;
+    case 0xC0:
+        return midi_message_type::program_change;
+    case 0xD0:
+        return midi_message_type::channel_pressure;
+    case 0xE0:
+        return midi_message_type::pitch_bend;
+    default:
+        break;
+    }
+    if (status == 0xF0) {
+        return midi_message_type::sysex;
+    }
+    return status >= 0xF8 ? midi_message_type::realtime : midi_message_type::system_common;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/// @brief Kinds of messages a route can let through, as bits of midi_route::types
+enum struct midi_message_type : std::uint16_t {
+    note = 1 << 0, // note off and note on
+    poly_pressure = 1 << 1,
+    control_change = 1 << 2,
+    program_change = 1 << 3,
+    channel_pressure = 1 << 4,
+    pitch_bend = 1 << 5,
+    sysex = 1 << 6,
+    system_common = 1 << 7, // F1 to F6 and a lone F7
+    realtime = 1 << 8,
+};
+
+/// @brief Every message type bit set
+inline constexpr std::uint16_t all_midi_message_types = 0x01FF;
+
+/// @brief Changes applied to the channel messages of one source channel on their way through a route
+struct midi_channel_transform {
+    std::int8_t channel = -1; // destination channel from 0 to 15, -1 keeps the source channel
+    int transpose = 0; // semitones added to the notes of note and poly pressure messages, notes leaving 0..127 are dropped
+    double velocity_exponent = 1.0; // note on velocity curve, below 1 raises soft velocities and above 1 lowers them, at least 0.01
+    std::uint8_t velocity_min = 1; // velocity a note on of velocity 1 is sent with, velocity 0 stays a note off
+    std::uint8_t velocity_max = 127; // velocity a note on of velocity 127 is sent with
+
+    /// @brief Gets if the transform leaves every message unchanged
+    [[nodiscard]] bool is_identity() const;
+};
+
+/// @brief Lets messages from one virtual input reach one hardware output
+struct midi_route {
+    std::size_t input = 0;
+    std::size_t output = 0;
+    std::uint16_t channels = 0xFFFF; // bit n lets channel n + 1 through, ignored by system messages
+    std::uint16_t types = all_midi_message_types; // midi_message_type bits
+    std::array<midi_channel_transform, 16> transforms = {}; // indexed by source channel, system messages are never changed
+};
+
+/// @brief Table of 256 bytes mapping every byte value to another
+using midi_byte_map = std::array<unsigned char, 256>;
+
+/// @brief Channel transforms of one route compiled into byte maps indexed by status and data bytes
+/// @details Applying it is a few table lookups whatever the transforms, with no branch on the message kind.
+class midi_transform {
+public:
+    /// @brief Compiles the transforms of every source channel
+    explicit midi_transform(const std::array<midi_channel_transform, 16>& transforms);
+
+    /// @brief Transforms one complete message other than SysEx into output, returns 0 if the message is dropped
+    [[nodiscard]] std::size_t apply(const unsigned char* message, const std::size_t length, unsigned char* output) const
+    {
+        unsigned char _bytes[3] = { 0, 0, 0 };
+        for (std::size_t _index = 0; _index < length; ++_index) {
+            _bytes[_index] = message[_index];
+        }
+        const unsigned char _status = _bytes[0];
+        output[0] = _status_map[_status];
+        output[1] = _maps[_first_data_maps[_status]][_bytes[1]];
+        output[2] = _maps[_second_data_maps[_status]][_bytes[2]];
+        // data bytes mapped to a status byte mark a dropped message, the padding of short messages maps to itself
+        return ((output[1] | output[2]) & 0x80) ? 0 : length;
+    }
+
+private:
+    midi_byte_map _status_map;
+    std::array<unsigned char, 256> _first_data_maps; // index in _maps for the first data byte of each status
+    std::array<unsigned char, 256> _second_data_maps; // index in _maps for the second data byte of each status
+    std::vector<midi_byte_map> _maps; // identity first, then note and velocity maps of the channels that need them
+};
+
+/// @brief Outputs a message goes to, bit n selects hardware output n
+using midi_output_mask = std::uint64_t;
+
+/// @brief Output masks of one input indexed by status byte, data bytes are never looked up
+using midi_routing_row = std::array<midi_output_mask, 256>;
+
+struct midi_input_routes;
+
+/// @brief Routes compiled into one flat array of output masks indexed by input and status byte
+/// @details Dispatching a message is one load whatever the number of routes, filters are resolved when compiling.
+class routing_table {
+public:
+    static constexpr std::size_t max_inputs = 16;
+    static constexpr std::size_t max_outputs = 64;
+
+    /// @brief Compiles the routes, routes naming an input or output out of range are ignored
+    /// @details When several routes join the same input and output, each source channel takes its transform from the
+    /// last of them letting that channel through.
+    explicit routing_table(const std::vector<midi_route>& routes = {});
+
+    /// @brief Gets the outputs a message starting with the status byte goes to
+    [[nodiscard]] midi_output_mask get_outputs(const std::size_t input, const unsigned char status) const
+    {
+        return _masks[input * 256 + status];
+    }
+
+    /// @brief Gets the compiled transforms of the routes from an input to an output, or null if they change nothing
+    [[nodiscard]] const std::shared_ptr<const midi_transform>& get_transform(const std::size_t input, const std::size_t output) const
+    {
+        return _transforms[input * max_outputs + output];
+    }
+
+    /// @brief Copies the masks and transforms of one input
+    [[nodiscard]] midi_input_routes get_input_routes(const std::size_t input) const;
+
+    /// @brief Gets the message type bit of a status byte
+    [[nodiscard]] static midi_message_type get_message_type(const unsigned char status);
+
+private:
+    std::vector<midi_output_mask> _masks;
+    std::vector<std::shared_ptr<const midi_transform>> _transforms;
+};
+
+/// @brief Everything one input needs to dispatch its messages, copied out of a routing_table
+struct midi_input_routes {
+    midi_routing_row outputs = {};
+    midi_output_mask transformed_outputs = 0; // outputs whose messages go through a transform
+    std::array<std::shared_ptr<const midi_transform>, routing_table::max_outputs> transforms;
+};
+
+/// @brief Gets the index of the lowest set bit of a non zero mask
+[[nodiscard]] inline std::size_t get_lowest_output(const midi_output_mask mask)
+{
+#if defined(_MSC_VER)
+    unsigned long _index = 0;
+    _BitScanForward64(&_index, mask);
+    return _index;
+#else
+    return static_cast<std::size_t>(__builtin_ctzll(mask));
+#endif
+}
@@ -0,0 +1,379 @@
+#include "scheduler.hpp"
+#include "parser.hpp"
+
+#include <algorithm>
+
+namespace {
+
+static constexpr std::size_t no_coalesce_key = static_cast<std::size_t>(-1);
+
+[[nodiscard]] static std::chrono::steady_clock::duration to_duration(const double milliseconds)
+{
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(milliseconds));
+}
+
+[[nodiscard]] static std::size_t get_coalesce_key(const unsigned char* data, const std::size_t length)
+{
+    const unsigned char _kind = data[0] & 0xF0;
+    const std::size_t _channel = data[0] & 0x0F;
+    if (_kind == 0xB0 && length == 3) {
+        const unsigned char _controller = data[1];
+        // bank select and (N)RPN must stay ordered, switches and channel mode messages change what notes do
+        const bool _is_parameter_sequence = _controller == 0 || _controller == 32 || _controller == 6 || _controller == 38 || (_controller >= 96 && _controller <= 101);
+        const bool _is_switch = _controller >= 64 && _controller <= 69;
+        const bool _is_channel_mode = _controller >= 120;
+        return _is_parameter_sequence || _is_switch || _is_channel_mode ? no_coalesce_key : _channel * 128 + _controller;
+    }
+    if (_kind == 0xE0 && length == 3) {
+        return 16 * 128 + _channel;
+    }
+    if (_kind == 0xD0 && length == 2) {
+        return 16 * 128 + 16 + _channel;
+    }
+    return no_coalesce_key;
+}
+
+[[nodiscard]] static bool is_note_off(const unsigned char* data, const std::size_t length)
+{
+    const unsigned char _kind = data[0] & 0xF0;
+    return length == 3 && (_kind == 0x80 || (_kind == 0x90 && data[2] == 0));
+}
+
+}
+
+const unsigned char* scheduled_message::data() const
+{
+    return sysex ? sysex->data() : bytes;
+}
+
+std::size_t scheduled_message::length() const
+{
+    return sysex ? sysex->size() : size;
+}
+
+std::size_t running_status_encoder::encode(const unsigned char* data, const std::size_t length, const clock::time_point now, const std::chrono::milliseconds refresh)
+{
+    if (length == 0 || is_midi_realtime(data[0])) {
+        return 0;
+    }
+    if (is_midi_system_common(data[0])) {
+        _running_status = 0;
+        return 0;
+    }
+    if (data[0] == _running_status && now - _status_time < refresh) {
+        return 1;
+    }
+    _running_status = data[0];
+    _status_time = now;
+    return 0;
+}
+
+void running_status_encoder::reset()
+{
+    _running_status = 0;
+}
+
+output_scheduler::output_scheduler(const output_pacing& pacing)
+    : _pacing(pacing)
+    , _credit_bytes(static_cast<double>(pacing.burst_bytes))
+{
+}
+
+void output_scheduler::set_pacing(const output_pacing& pacing)
+{
+    _pacing = pacing;
+    _credit_bytes = std::min(_credit_bytes, static_cast<double>(_pacing.burst_bytes));
+}
+
+void output_scheduler::push(const unsigned char* data, const std::size_t length, const clock::time_point ingress_time, const bool is_scheduled)
+{
+    if (length == 0) {
+        return;
+    }
+    scheduled_message _message;
+    _message.ingress_time = ingress_time;
+    _message.is_scheduled = is_scheduled;
+    if (is_midi_realtime(data[0])) {
+        _message.bytes[0] = data[0];
+        _message.size = 1;
+        push(output_lane::realtime, std::move(_message));
+        return;
+    }
+    const bool _is_congested = is_congested();
+    if (_is_congested && _pacing.overflow_policy == output_overflow_policy::drop && !is_note_off(data, length)) {
+        _counters.dropped_messages.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (length > sizeof(_message.bytes)) {
+        _message.sysex = std::make_shared<const std::vector<unsigned char>>(data, data + length);
+        push(output_lane::bulk, std::move(_message));
+        return;
+    }
+
+    // sequences start at 1 so a zeroed slot never points into the lane
+    std::deque<scheduled_message>& _voices = _lanes[static_cast<std::size_t>(output_lane::voice)];
+    const std::uint64_t _sequence = _popped_voice_sequence + _voices.size() + 1;
+    const std::size_t _key = get_coalesce_key(data, length);
+    if (_key == no_coalesce_key) {
+        _barrier_sequence = _sequence;
+    } else {
+        const std::uint64_t _slot_sequence = _coalesce_sequences[_key];
+        // only into a slot queued after the last note, above the high water mark without waiting for the coalesce latency
+        const bool _is_overflowing = _is_congested && _pacing.overflow_policy == output_overflow_policy::coalesce;
+        const bool _is_coalescing = _is_overflowing || estimated_queue_delay() > _pacing.coalesce_latency;
+        if (_slot_sequence > _popped_voice_sequence && _slot_sequence > _barrier_sequence && _is_coalescing) {
+            scheduled_message& _slot = _voices[static_cast<std::size_t>(_slot_sequence - _popped_voice_sequence - 1)];
+            std::copy(data, data + length, _slot.bytes);
+            _counters.coalesced_messages.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        _coalesce_sequences[_key] = _sequence;
+    }
+    std::copy(data, data + length, _message.bytes);
+    _message.size = length;
+    push(output_lane::voice, std::move(_message));
+}
+
+void output_scheduler::push(const midi_message_blob& sysex, const clock::time_point ingress_time, const bool is_scheduled)
+{
+    if (is_congested() && _pacing.overflow_policy == output_overflow_policy::drop) {
+        _counters.dropped_messages.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    scheduled_message _message;
+    _message.ingress_time = ingress_time;
+    _message.is_scheduled = is_scheduled;
+    _message.sysex = sysex;
+    push(output_lane::bulk, std::move(_message));
+}
+
+output_scheduler::clock::time_point output_scheduler::flush(const clock::time_point now, midi_output_transport& transport)
+{
+    refill(now);
+    const bool _is_raw = transport.is_raw_byte_stream();
+    const bool _use_running_status = _pacing.use_running_status && transport.accepts_running_status();
+    std::deque<scheduled_message>& _realtimes = _lanes[static_cast<std::size_t>(output_lane::realtime)];
+    std::deque<scheduled_message>& _voices = _lanes[static_cast<std::size_t>(output_lane::voice)];
+    std::deque<scheduled_message>& _bulks = _lanes[static_cast<std::size_t>(output_lane::bulk)];
+
+    while (_credit_bytes >= 0) {
+        // realtime bytes go first, on raw byte transports even in the middle of a SysEx
+        if (!_realtimes.empty()) {
+            send(transport, _realtimes.front().bytes, 1);
+            record(latency_class::realtime, _realtimes.front());
+            pop(output_lane::realtime);
+            continue;
+        }
+
+        if (_sysex_offset > 0) {
+            // a SysEx split on a raw byte transport must finish before any other message
+            const scheduled_message& _sysex = _bulks.front();
+            const std::size_t _remaining = _sysex.length() - _sysex_offset;
+            const std::size_t _chunk = std::min(_remaining, std::max<std::size_t>(1, static_cast<std::size_t>(_credit_bytes)));
+            send(transport, _sysex.data() + _sysex_offset, _chunk);
+            _queued_bytes -= _chunk;
+            _sysex_offset += _chunk;
+            if (_sysex_offset == _sysex.length()) {
+                finish_sysex(now);
+            }
+            continue;
+        }
+
+        if (now < _gap_end) {
+            break;
+        }
+
+        if (!_voices.empty()) {
+            const scheduled_message& _message = _voices.front();
+            const std::size_t _skip = _use_running_status ? _encoder.encode(_message.bytes, _message.size, now, _pacing.running_status_refresh) : 0;
+            send(transport, _message.bytes + _skip, _message.size - _skip);
+            _notes.update(_message.bytes, _message.size);
+            record(latency_class::voice, _message);
+            start_gap(now);
+            pop(output_lane::voice);
+            continue;
+        }
+
+        if (!_bulks.empty() && now >= _sysex_gap_end) {
+            const scheduled_message& _sysex = _bulks.front();
+            if (_use_running_status) {
+                _encoder.reset();
+            }
+            if (_is_raw) {
+                const std::size_t _chunk = std::min(_sysex.length(), std::max<std::size_t>(1, static_cast<std::size_t>(_credit_bytes)));
+                send(transport, _sysex.data(), _chunk);
+                _queued_bytes -= _chunk;
+                _sysex_offset = _chunk;
+                if (_sysex_offset == _sysex.length()) {
+                    finish_sysex(now);
+                }
+            } else {
+                send(transport, _sysex.data(), _sysex.length());
+                _queued_bytes -= _sysex.length();
+                _sysex_offset = _sysex.length();
+                finish_sysex(now);
+            }
+            continue;
+        }
+        break;
+    }
+    _counters.queued_bytes.store(_queued_bytes, std::memory_order_relaxed);
+
+    if (empty()) {
+        return clock::time_point::max();
+    }
+    const double _debt_milliseconds = std::max(0.0, -_credit_bytes) / _pacing.bytes_per_millisecond;
+    clock::time_point _next = now + to_duration(_debt_milliseconds);
+    if (_realtimes.empty() && _sysex_offset == 0) {
+        const clock::time_point _lane_ready = _voices.empty() ? std::max(_gap_end, _sysex_gap_end) : _gap_end;
+        _next = std::max(_next, _lane_ready);
+    }
+    return _next;
+}
+
+bool output_scheduler::empty() const
+{
+    for (const std::deque<scheduled_message>& _lane : _lanes) {
+        if (!_lane.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+output_scheduler::clock::duration output_scheduler::estimated_queue_delay() const
+{
+    return to_duration(static_cast<double>(_queued_bytes) / _pacing.bytes_per_millisecond);
+}
+
+bool output_scheduler::is_congested() const
+{
+    return estimated_queue_delay() > _pacing.high_water_delay;
+}
+
+const output_counters& output_scheduler::get_counters() const
+{
+    return _counters;
+}
+
+void output_scheduler::release_notes(const clock::time_point ingress_time)
+{
+    _notes.release([this, ingress_time](const unsigned char* data, const std::size_t length) {
+        push(data, length, ingress_time);
+        _counters.released_notes.fetch_add(1, std::memory_order_relaxed);
+    });
+}
+
+std::size_t output_scheduler::release_notes(const clock::time_point now, midi_output_transport& transport)
+{
+    const bool _use_running_status = _pacing.use_running_status && transport.accepts_running_status();
+    std::size_t _bytes = 0;
+    _notes.release([&](const unsigned char* data, const std::size_t length) {
+        const std::size_t _skip = _use_running_status ? _encoder.encode(data, length, now, _pacing.running_status_refresh) : 0;
+        send(transport, data + _skip, length - _skip);
+        _counters.released_notes.fetch_add(1, std::memory_order_relaxed);
+        _bytes += length - _skip;
+    });
+    return _bytes;
+}
+
+const active_notes& output_scheduler::get_active_notes() const
+{
+    return _notes;
+}
+
+bool output_scheduler::terminate_sysex(midi_output_transport& transport)
+{
+    if (_sysex_offset == 0) {
+        return false;
+    }
+    static constexpr unsigned char _end = 0xF7;
+    send(transport, &_end, 1);
+    std::deque<scheduled_message>& _bulks = _lanes[static_cast<std::size_t>(output_lane::bulk)];
+    _queued_bytes -= _bulks.front().length() - _sysex_offset;
+    _counters.queued_bytes.store(_queued_bytes, std::memory_order_relaxed);
+    _bulks.pop_front();
+    _sysex_offset = 0;
+    return true;
+}
+
+void output_scheduler::clear()
+{
+    _popped_voice_sequence += _lanes[static_cast<std::size_t>(output_lane::voice)].size();
+    for (std::deque<scheduled_message>& _lane : _lanes) {
+        _lane.clear();
+    }
+    _queued_bytes = 0;
+    _counters.queued_bytes.store(0, std::memory_order_relaxed);
+    _sysex_offset = 0;
+}
+
+void output_scheduler::reset_wire()
+{
+    _encoder.reset();
+}
+
+void output_scheduler::set_latency_histograms(latency_histograms* histograms)
+{
+    _latency = histograms;
+}
+
+void output_scheduler::push(const output_lane lane, scheduled_message&& message)
+{
+    _queued_bytes += message.length();
+    _counters.queued_bytes.store(_queued_bytes, std::memory_order_relaxed);
+    _lanes[static_cast<std::size_t>(lane)].push_back(std::move(message));
+}
+
+void output_scheduler::pop(const output_lane lane)
+{
+    std::deque<scheduled_message>& _lane = _lanes[static_cast<std::size_t>(lane)];
+    _queued_bytes -= _lane.front().length();
+    _lane.pop_front();
+    if (lane == output_lane::voice) {
+        ++_popped_voice_sequence;
+    }
+}
+
+void output_scheduler::send(midi_output_transport& transport, const unsigned char* data, const std::size_t length)
+{
+    transport.send(data, length);
+    _credit_bytes -= static_cast<double>(length);
+    _counters.sent_messages.fetch_add(1, std::memory_order_relaxed);
+    _counters.sent_bytes.fetch_add(length, std::memory_order_relaxed);
+}
+
+void output_scheduler::record(const latency_class message_class, const scheduled_message& message)
+{
+    if (_latency && message.ingress_time != clock::time_point()) {
+        _latency->record(message.is_scheduled ? latency_class::scheduled : message_class, clock::now() - message.ingress_time);
+    }
+}
+
+void output_scheduler::start_gap(const clock::time_point now)
+{
+    if (_pacing.message_gap.count() > 0) {
+        const double _wire_milliseconds = std::max(0.0, -_credit_bytes) / _pacing.bytes_per_millisecond;
+        _gap_end = now + to_duration(_wire_milliseconds) + _pacing.message_gap;
+    }
+}
+
+void output_scheduler::finish_sysex(const clock::time_point now)
+{
+    // only the next SysEx waits for the receiver to store this one, other lanes keep flowing
+    const double _wire_milliseconds = std::max(0.0, -_credit_bytes) / _pacing.bytes_per_millisecond;
+    _sysex_gap_end = now + to_duration(_wire_milliseconds) + _pacing.sysex_gap;
+    start_gap(now);
+    record(latency_class::sysex, _lanes[static_cast<std::size_t>(output_lane::bulk)].front());
+    _lanes[static_cast<std::size_t>(output_lane::bulk)].pop_front();
+    _sysex_offset = 0;
+}
+
+void output_scheduler::refill(const clock::time_point now)
+{
+    if (now > _refill_time) {
+        const double _elapsed_milliseconds = std::chrono::duration<double, std::milli>(now - _refill_time).count();
+        _credit_bytes = std::min(_credit_bytes + _elapsed_milliseconds * _pacing.bytes_per_millisecond, static_cast<double>(_pacing.burst_bytes));
+    }
+    _refill_time = now;
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "latency.hpp"
+#include "notes.hpp"
+#include "parser.hpp"
+#include "transport.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+/// @brief What happens to new messages while the queue of a port is above its high water mark
+enum struct output_overflow_policy {
+    reject, // senders are refused and told so, nothing queued is lost
+    drop, // new messages are discarded except realtime and note offs
+    coalesce, // control changes, pitch bends and pressures replace their queued value at once, never past a later note
+};
+
+/// @brief Configures how fast messages are released to a port, defaults model a 31250 baud DIN link
+struct output_pacing {
+    double bytes_per_millisecond = 3.125; // 31250 baud, 10 bits per byte
+    std::size_t burst_bytes = 32; // bytes that can leave back to back after the wire was idle
+    std::chrono::microseconds message_gap = std::chrono::microseconds(0); // silence after every message
+    std::chrono::microseconds sysex_gap = std::chrono::milliseconds(20); // delay before the next SysEx so the synth can store the previous one
+    bool use_running_status = true; // omit repeated channel status bytes on transports accepting running status
+    std::chrono::milliseconds running_status_refresh = std::chrono::milliseconds(250); // resend the status at least this often
+    std::chrono::microseconds coalesce_latency = std::chrono::milliseconds(5); // queue delay above which CC, pitch bend and pressure keep only their last value
+    std::chrono::milliseconds high_water_delay = std::chrono::milliseconds(2000); // queue delay above which the overflow policy applies
+    output_overflow_policy overflow_policy = output_overflow_policy::coalesce;
+};
+
+/// @brief Output lanes in priority order
+enum struct output_lane : std::size_t {
+    realtime,
+    voice,
+    bulk,
+    count
+};
+
+/// @brief Counters of an output scheduler, readable from any thread
+struct output_counters {
+    std::atomic<std::uint64_t> sent_messages = 0;
+    std::atomic<std::uint64_t> sent_bytes = 0;
+    std::atomic<std::uint64_t> coalesced_messages = 0;
+    std::atomic<std::uint64_t> dropped_messages = 0;
+    std::atomic<std::uint64_t> released_notes = 0; // note offs sent for notes left sounding
+    std::atomic<std::size_t> queued_bytes = 0; // bytes waiting in the scheduler, the wire time model of the port
+};
+
+/// @brief Message waiting in an output scheduler, short messages are stored inline and SysEx is shared
+struct scheduled_message {
+    unsigned char bytes[3] = { 0, 0, 0 };
+    std::size_t size = 0;
+    midi_message_blob sysex;
+    std::chrono::steady_clock::time_point ingress_time = {}; // requested send time for scheduled messages
+    bool is_scheduled = false; // latency is recorded as latency_class::scheduled
+
+    /// @brief Gets the message bytes
+    [[nodiscard]] const unsigned char* data() const;
+
+    /// @brief Gets the message size in bytes
+    [[nodiscard]] std::size_t length() const;
+};
+
+/// @brief Omits repeated channel status bytes, sending the status again at least every refresh interval
+class running_status_encoder {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /// @brief Gets how many leading bytes of the message can be omitted on the wire (0 or 1)
+    [[nodiscard]] std::size_t encode(const unsigned char* data, const std::size_t length, const clock::time_point now, const std::chrono::milliseconds refresh);
+
+    /// @brief Forgets the running status so the next channel message is sent in full
+    void reset();
+
+private:
+    unsigned char _running_status = 0;
+    clock::time_point _status_time = {};
+};
+
+/// @brief Holds messages for one output port and releases them at the pace the wire can carry
+/// @details Realtime messages are sent first, then channel voice and system common messages, then SysEx. On raw byte
+/// transports SysEx is sent in chunks as the budget allows so realtime bytes can be inserted inside it. Only used from
+/// the output thread, time is always passed in so the pacing can run on a simulated clock.
+class output_scheduler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit output_scheduler(const output_pacing& pacing = output_pacing());
+
+    /// @brief Changes the pacing, queued messages are kept
+    void set_pacing(const output_pacing& pacing);
+
+    /// @brief Queues one complete message that entered the bridge at the ingress time
+    /// @details Once the modeled queue delay exceeds the coalesce latency, a control change, pitch bend or channel
+    /// pressure replaces the queued value for the same channel and controller, as long as no note or other voice
+    /// message was queued after it. Bank select, (N)RPN, switch controllers 64 to 69 and channel mode messages are
+    /// never coalesced. Above the high water mark the overflow policy decides instead, coalescing keeps the same rules.
+    /// Scheduled messages pass their requested time as ingress time.
+    void push(const unsigned char* data, const std::size_t length, const clock::time_point ingress_time, const bool is_scheduled = false);
+
+    /// @brief Queues one complete SysEx without copying it, the caller checked it with is_complete_sysex
+    void push(const midi_message_blob& sysex, const clock::time_point ingress_time, const bool is_scheduled = false);
+
+    /// @brief Sends every queued message the pacing allows at this time and returns when to flush again
+    /// @return The next time a message can leave, or clock::time_point::max() if the queue is empty
+    clock::time_point flush(const clock::time_point now, midi_output_transport& transport);
+
+    /// @brief Gets if no message is queued
+    [[nodiscard]] bool empty() const;
+
+    /// @brief Gets the modeled time needed to put every queued message on the wire
+    [[nodiscard]] clock::duration estimated_queue_delay() const;
+
+    /// @brief Gets if the modeled queue delay is above the high water mark
+    [[nodiscard]] bool is_congested() const;
+
+    /// @brief Gets the counters, they can be read from any thread
+    [[nodiscard]] const output_counters& get_counters() const;
+
+    /// @brief Queues a note off for every note sent to the port and still sounding
+    /// @details Used before a patch change, the note offs keep their order against messages pushed before and after.
+    void release_notes(const clock::time_point ingress_time);
+
+    /// @brief Sends a note off for every sounding note right away without pacing, returns the bytes sent
+    /// @details Used before the transport goes away, queued notes were never sent so they need no note off.
+    std::size_t release_notes(const clock::time_point now, midi_output_transport& transport);
+
+    /// @brief Gets the notes sent to the port and still sounding
+    [[nodiscard]] const active_notes& get_active_notes() const;
+
+    /// @brief Ends a SysEx cut in the middle with an F7 sent right away and drops the rest of it, false if none was
+    /// @details Used before the transport goes away or changes, so its receiver does not swallow what comes next and the
+    /// next transport never gets the rest of the message without its F0.
+    bool terminate_sysex(midi_output_transport& transport);
+
+    /// @brief Drops every queued message, a SysEx cut in the middle is ended with terminate_sysex first
+    void clear();
+
+    /// @brief Forgets the wire state, called when the transport behind the scheduler changes
+    void reset_wire();
+
+    /// @brief Records the time from ingress to the end of the transport call of every sent message, or stops if null
+    /// @details Measured against the real steady clock, so it is left detached when driving a simulated clock.
+    void set_latency_histograms(latency_histograms* histograms);
+
+private:
+    static constexpr std::size_t coalesce_key_count = 16 * 128 + 16 + 16; // control changes, pitch bends, channel pressures
+
+    void push(const output_lane lane, scheduled_message&& message);
+    void pop(const output_lane lane);
+    void send(midi_output_transport& transport, const unsigned char* data, const std::size_t length);
+    void record(const latency_class message_class, const scheduled_message& message);
+    void start_gap(const clock::time_point now);
+    void finish_sysex(const clock::time_point now);
+    void refill(const clock::time_point now);
+
+    output_pacing _pacing;
+    std::array<std::deque<scheduled_message>, static_cast<std::size_t>(output_lane::count)> _lanes;
+    std::size_t _sysex_offset = 0;
+    std::uint64_t _popped_voice_sequence = 0;
+    std::uint64_t _barrier_sequence = 0;
+    std::array<std::uint64_t, coalesce_key_count> _coalesce_sequences = {};
+    std::size_t _queued_bytes = 0;
+    output_counters _counters;
+    latency_histograms* _latency = nullptr;
+    running_status_encoder _encoder;
+    active_notes _notes;
+    double _credit_bytes = 0;
+    clock::time_point _refill_time = {};
+    clock::time_point _gap_end = {};
+    clock::time_point _sysex_gap_end = {};
+};
@@ -1,46 +1,34 @@
 #include "sysex.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <fstream>
+#include <iterator>
 
 namespace {
 
-[[nodiscard]] static std::vector<unsigned char> read_all(const std::filesystem::path& sysex_path)
+[[nodiscard]] static std::size_t yamaha_count(const unsigned char* message, const std::size_t length)
 {
-    std::ifstream _fstream(sysex_path, std::ios::binary);
-    if (!_fstream) {
-        return {};
-    }
-    _fstream.seekg(0, std::ios::end);
-    std::streampos _position = _fstream.tellg();
-    _fstream.seekg(0, std::ios::beg);
-    std::vector<unsigned char> _buffer((size_t)std::max<std::streamoff>(0, _position));
-    if (!_buffer.empty()) {
-        _fstream.read((char*)_buffer.data(), _buffer.size());
-    }
-    return _buffer;
-}
-
-[[nodiscard]] static std::size_t yamaha_count(const std::vector<unsigned char>& message)
-{
-    if (message.size() < 7) {
+    if (length < 7) {
         return 0;
     }
     return (size_t(message[4]) << 7) | size_t(message[5]); // MS7 | LS7
 }
 
-[[nodiscard]] static bool is_yamaha(const std::vector<unsigned char>& message)
+[[nodiscard]] static bool is_yamaha(const unsigned char* message, const std::size_t length)
 {
-    return message.size() >= 2 && message[0] == 0xF0 && message[1] == 0x43;
+    return length >= 2 && message[0] == 0xF0 && message[1] == 0x43;
 }
 
-[[nodiscard]] static bool is_dx7_bank32(const std::vector<unsigned char>& message)
+[[nodiscard]] static bool is_dx7_bank32(const unsigned char* message, const std::size_t length)
 {
-    return is_yamaha(message) && message.size() >= 7 && message[3] == 0x09 && yamaha_count(message) == 4096;
+    return is_yamaha(message, length) && length >= 7 && message[3] == 0x09 && yamaha_count(message, length) == 4096 && length >= 6 + 32 * 128;
 }
 
-[[nodiscard]] static bool is_dx7_single_voice_message(const std::vector<unsigned char>& message)
+[[nodiscard]] static bool is_dx7_single_voice_message(const unsigned char* message, const std::size_t length)
 {
-    return is_yamaha(message) && message.size() >= 7 && message[3] == 0x00 && yamaha_count(message) == 155;
+    return is_yamaha(message, length) && length >= 7 && message[3] == 0x00 && yamaha_count(message, length) == 155;
 }
 
 [[nodiscard]] static std::string clean_ascii_10(const char* data)
@@ -65,12 +53,12 @@ namespace {
     return clean_ascii_10(reinterpret_cast<const char*>(chunk128) + 118);
 }
 
-[[nodiscard]] static std::string name_from_single_voice_message(const std::vector<unsigned char>& message)
+[[nodiscard]] static std::string name_from_single_voice_message(const unsigned char* message, const std::size_t length)
 {
     // DX7 single-voice: F0 43 0n 00 01 1B [155 params] chk F7
     // name is last 10 bytes of the 155-byte param block (offset 6+145)
-    if (message.size() >= 6 + 155 + 1 + 1) {
-        return clean_ascii_10(reinterpret_cast<const char*>(message.data()) + 6 + 145);
+    if (length >= 6 + 155 + 1 + 1) {
+        return clean_ascii_10(reinterpret_cast<const char*>(message) + 6 + 145);
     }
     return "Voice";
 }
@@ -82,14 +70,13 @@ namespace {
     for (size_t i = 0; i < length; ++i) {
         _sum += data[i];
     }
-    return unsigned char((128 - (_sum & 0x7F)) & 0x7F);
+    return static_cast<unsigned char>((128 - (_sum & 0x7F)) & 0x7F);
 }
 
-[[nodiscard]] static std::vector<unsigned char> dx7_chunk128_to_param155(const unsigned char* c)
+static void dx7_chunk128_to_param155(const unsigned char* c, unsigned char* parameters)
 {
     // Unpack one 128-unsigned char bank chunk → 155 single-voice parameter bytes (no header/checksum yet)
-    std::vector<unsigned char> _parameter;
-    _parameter.reserve(155);
+    unsigned char* _parameter = parameters;
 
     auto unpack_op = [&](int base) {
         // bytes base..base+16 (17 bytes) as per packed map (operator order 6..1)
@@ -99,25 +86,25 @@ namespace {
         const unsigned char b12 = c[base + 12], b13 = c[base + 13], b14 = c[base + 14], b15 = c[base + 15], b16 = c[base + 16];
 
         // EG rates/levels
-        _parameter.push_back(b0);
-        _parameter.push_back(b1);
-        _parameter.push_back(b2);
-        _parameter.push_back(b3);
-        _parameter.push_back(b4);
-        _parameter.push_back(b5);
-        _parameter.push_back(b6);
-        _parameter.push_back(b7);
+        *_parameter++ = b0;
+        *_parameter++ = b1;
+        *_parameter++ = b2;
+        *_parameter++ = b3;
+        *_parameter++ = b4;
+        *_parameter++ = b5;
+        *_parameter++ = b6;
+        *_parameter++ = b7;
 
         // Keyboard scaling
-        _parameter.push_back(b8); // break point (0-99)
-        _parameter.push_back(b9); // left depth
-        _parameter.push_back(b10); // right depth
+        *_parameter++ = b8; // break point (0-99)
+        *_parameter++ = b9; // left depth
+        *_parameter++ = b10; // right depth
 
         // curves (byte11: 0 0 0 | RC(2) | LC(2))
         const unsigned char LC = (b11)&0x03;
         const unsigned char RC = (b11 >> 2) & 0x03;
-        _parameter.push_back(LC); // left curve
-        _parameter.push_back(RC); // right curve
+        *_parameter++ = LC; // left curve
+        *_parameter++ = RC; // right curve
 
         // byte12: | DET(4) | RS(3) |
         const unsigned char RS = (b12)&0x07;
@@ -127,20 +114,20 @@ namespace {
         unsigned char AMS = (b13)&0x03;
         unsigned char KVS = (b13 >> 2) & 0x07;
 
-        _parameter.push_back(RS); // rate scaling
-        _parameter.push_back(AMS); // amp mod sens
-        _parameter.push_back(KVS); // key vel sens
+        *_parameter++ = RS; // rate scaling
+        *_parameter++ = AMS; // amp mod sens
+        *_parameter++ = KVS; // key vel sens
 
-        _parameter.push_back(b14); // output level
+        *_parameter++ = b14; // output level
 
         // byte15: 0 | FC(5) | M(1)
         unsigned char M = b15 & 0x01;
         unsigned char FC = (b15 >> 1) & 0x1F;
 
-        _parameter.push_back(M); // osc mode
-        _parameter.push_back(FC); // coarse
-        _parameter.push_back(b16); // fine
-        _parameter.push_back(DET); // detune (0..14)
+        *_parameter++ = M; // osc mode
+        *_parameter++ = FC; // coarse
+        *_parameter++ = b16; // fine
+        *_parameter++ = DET; // detune (0..14)
     };
 
     // Operators in order OP6..OP1, 17 bytes each starting at 0,17,34,51,68,85
@@ -152,91 +139,133 @@ namespace {
     unpack_op(85);
 
     // Pitch EG (bytes 102..109)
-    _parameter.push_back(c[102]);
-    _parameter.push_back(c[103]);
-    _parameter.push_back(c[104]);
-    _parameter.push_back(c[105]);
-    _parameter.push_back(c[106]);
-    _parameter.push_back(c[107]);
-    _parameter.push_back(c[108]);
-    _parameter.push_back(c[109]);
+    *_parameter++ = c[102];
+    *_parameter++ = c[103];
+    *_parameter++ = c[104];
+    *_parameter++ = c[105];
+    *_parameter++ = c[106];
+    *_parameter++ = c[107];
+    *_parameter++ = c[108];
+    *_parameter++ = c[109];
 
     // Alg (byte110: 0 0 | ALG(5))
-    _parameter.push_back(c[110] & 0x1F);
+    *_parameter++ = c[110] & 0x1F;
 
     // FB + Key Sync (byte111: 0 0 0 | OKS(1) | FB(3))
     const unsigned char b111 = c[111];
     const unsigned char FB = b111 & 0x07;
     const unsigned char OKS = (b111 >> 3) & 0x01;
-    _parameter.push_back(FB);
-    _parameter.push_back(OKS);
+    *_parameter++ = FB;
+    *_parameter++ = OKS;
 
     // LFO speed/delay/pitch-mod depth/amp-mod depth (112..115)
-    _parameter.push_back(c[112]);
-    _parameter.push_back(c[113]);
-    _parameter.push_back(c[114]);
-    _parameter.push_back(c[115]);
+    *_parameter++ = c[112];
+    *_parameter++ = c[113];
+    *_parameter++ = c[114];
+    *_parameter++ = c[115];
 
     // byte116: | LPMS(3) | LFW(3) | LKS(1) |
     const unsigned char b116 = c[116];
     const unsigned char LKS = b116 & 0x01; // LFO sync
     const unsigned char LFW = (b116 >> 1) & 0x07; // LFO wave
     const unsigned char LPMS = (b116 >> 4) & 0x07; // pitch mod sens
-    _parameter.push_back(LKS);
-    _parameter.push_back(LFW);
-    _parameter.push_back(LPMS);
+    *_parameter++ = LKS;
+    *_parameter++ = LFW;
+    *_parameter++ = LPMS;
 
     // Transpose (117)
-    _parameter.push_back(c[117]);
+    *_parameter++ = c[117];
 
     // Name chars (118..127)
     for (int _index = 118; _index <= 127; ++_index) {
-        _parameter.push_back(c[_index]);
+        *_parameter++ = c[_index];
     }
 
     // Size check
-    if (_parameter.size() != 155) { /* defensive, but it should be 155 */
+    if (_parameter - parameters != 155) { /* defensive, but it should be 155 */
     }
-    return _parameter;
 }
 
-[[nodiscard]] static std::vector<unsigned char> build_single_voice_sysex_from_parameters(const std::vector<unsigned char>& params155, int midiChannel /*0..15*/ = 0)
+static void dx7_param155_to_chunk128(const unsigned char* p, unsigned char* chunk)
+{
+    // Pack 155 single-voice parameter bytes → one 128-unsigned char bank chunk, the inverse of dx7_chunk128_to_param155
+    for (int _operator = 0; _operator < 6; ++_operator) {
+        const unsigned char* _source = p + _operator * 21;
+        unsigned char* _target = chunk + _operator * 17;
+        for (int _index = 0; _index < 11; ++_index) {
+            _target[_index] = _source[_index] & 0x7F; // EG rates/levels, break point, depths
+        }
+        _target[11] = static_cast<unsigned char>((_source[11] & 0x03) | ((_source[12] & 0x03) << 2)); // LC | RC
+        _target[12] = static_cast<unsigned char>((_source[13] & 0x07) | ((_source[20] & 0x0F) << 3)); // RS | DET
+        _target[13] = static_cast<unsigned char>((_source[14] & 0x03) | ((_source[15] & 0x07) << 2)); // AMS | KVS
+        _target[14] = _source[16] & 0x7F; // output level
+        _target[15] = static_cast<unsigned char>((_source[17] & 0x01) | ((_source[18] & 0x1F) << 1)); // M | FC
+        _target[16] = _source[19] & 0x7F; // fine
+    }
+
+    // Pitch EG
+    for (int _index = 0; _index < 8; ++_index) {
+        chunk[102 + _index] = p[126 + _index] & 0x7F;
+    }
+    chunk[110] = p[134] & 0x1F; // Alg
+    chunk[111] = static_cast<unsigned char>((p[135] & 0x07) | ((p[136] & 0x01) << 3)); // FB | OKS
+    for (int _index = 0; _index < 4; ++_index) {
+        chunk[112 + _index] = p[137 + _index] & 0x7F; // LFO speed/delay/pitch-mod depth/amp-mod depth
+    }
+    chunk[116] = static_cast<unsigned char>((p[141] & 0x01) | ((p[142] & 0x07) << 1) | ((p[143] & 0x07) << 4)); // LKS | LFW | LPMS
+    chunk[117] = p[144] & 0x7F; // Transpose
+    for (int _index = 0; _index < 10; ++_index) {
+        chunk[118 + _index] = p[145 + _index] & 0x7F; // Name chars
+    }
+}
+
+[[nodiscard]] static std::vector<unsigned char> build_single_voice_sysex_from_parameters(const unsigned char* params155, int midiChannel /*0..15*/ = 0)
 {
     // Build full single-voice SysEx from 155 params (adds header+checksum+F7)
     std::vector<unsigned char> message;
     message.reserve(1 + 1 + 1 + 1 + 2 + 155 + 1 + 1);
     message.push_back(0xF0);
     message.push_back(0x43); // Yamaha
-    message.push_back(unsigned char(0x00 | (midiChannel & 0x0F))); // sub-status 0x0, channel nibble
+    message.push_back(static_cast<unsigned char>(0x00 | (midiChannel & 0x0F))); // sub-status 0x0, channel nibble
     message.push_back(0x00); // format 0 = single voice
     // 155 = 1*128 + 27
     message.push_back(0x01); // unsigned char count MS (7-bit)
     message.push_back(0x1B); // unsigned char count LS (7-bit)
-    message.insert(message.end(), params155.begin(), params155.end());
-    message.push_back(yamaha_checksum(params155.data(), params155.size()));
+    message.insert(message.end(), params155, params155 + 155);
+    message.push_back(yamaha_checksum(params155, 155));
     message.push_back(0xF7);
     return message;
 }
 
-[[nodiscard]] static std::vector<std::vector<unsigned char>> split_sysex_all(const std::vector<unsigned char>& data)
+[[nodiscard]] static midi_message_blob make_single_voice_data(const unsigned char* chunk128, const int channel)
 {
-    std::vector<std::vector<unsigned char>> _split_data;
+    unsigned char _parameters[155];
+    dx7_chunk128_to_param155(chunk128, _parameters);
+    return std::make_shared<const std::vector<unsigned char>>(build_single_voice_sysex_from_parameters(_parameters, channel));
+}
+
+[[nodiscard]] static std::vector<sysex_patch_location> split_sysex_all(const unsigned char* data, const std::size_t length)
+{
+    std::vector<sysex_patch_location> _split_data;
     std::size_t _index = 0;
-    while (_index < data.size()) {
+    while (_index < length) {
         // find F0
-        while (_index < data.size() && data[_index] != 0xF0) {
+        while (_index < length && data[_index] != 0xF0) {
             ++_index;
         }
-        if (_index >= data.size()) {
+        if (_index >= length) {
             break;
         }
         const std::size_t _size = _index++;
         // find F7
-        while (_index < data.size() && data[_index] != 0xF7) {
+        while (_index < length && data[_index] != 0xF7) {
             ++_index;
         }
-        if (_index < data.size()) {
-            _split_data.emplace_back(data.begin() + _size, data.begin() + _index + 1);
+        if (_index < length) {
+            sysex_patch_location _location;
+            _location.offset = static_cast<std::uint32_t>(_size);
+            _location.length = static_cast<std::uint32_t>(_index + 1 - _size);
+            _split_data.push_back(_location);
             ++_index; // continue after F7
         } else {
             break; // unterminated at EOF -> stop
@@ -247,6 +276,22 @@ namespace {
 
 }
 
+std::vector<unsigned char> read_sysex_file(const std::filesystem::path& path)
+{
+    std::ifstream _fstream(path, std::ios::binary);
+    if (!_fstream) {
+        return {};
+    }
+    _fstream.seekg(0, std::ios::end);
+    std::streampos _position = _fstream.tellg();
+    _fstream.seekg(0, std::ios::beg);
+    std::vector<unsigned char> _buffer((size_t)std::max<std::streamoff>(0, _position));
+    if (!_buffer.empty()) {
+        _fstream.read((char*)_buffer.data(), _buffer.size());
+    }
+    return _buffer;
+}
+
 std::vector<std::filesystem::path> load_sysex_banks_recursive(const std::filesystem::path& root_path)
 {
     std::vector<std::filesystem::path> _sysex_banks;
@@ -258,71 +303,232 @@ std::vector<std::filesystem::path> load_sysex_banks_recursive(const std::filesys
         if (!_iterator->is_regular_file(_error)) {
             continue;
         }
-        std::string _extension = _iterator->path().extension().string();
-        std::transform(_extension.begin(), _extension.end(), _extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
-        if (_extension == ".syx") {
-            const std::filesystem::path _path = _iterator->path();
+        if (is_sysex_file(_iterator->path())) {
             _sysex_banks.push_back(_iterator->path());
         }
     }
     return _sysex_banks;
 }
 
-std::vector<sysex_patch> load_sysex_patches(const std::filesystem::path& bank)
+bool is_sysex_file(const std::filesystem::path& path)
 {
-    std::vector<sysex_patch> _sysex_patches;
-    const std::vector<unsigned char> _raw_data = read_all(bank);
-    const std::vector<std::vector<unsigned char>> _split_data = split_sysex_all(_raw_data);
-    if (_split_data.empty()) {
-        return _sysex_patches;
-    }
+    std::string _extension = path.extension().string();
+    std::transform(_extension.begin(), _extension.end(), _extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return _extension == ".syx";
+}
 
+std::vector<sysex_patch_entry> find_sysex_patches(const std::filesystem::path& bank, const unsigned char* data, const std::size_t length)
+{
+    std::vector<sysex_patch_entry> _entries;
+    if (length > UINT32_MAX) {
+        return _entries;
+    }
     int _single_voice_index = 0;
     int _other_index = 0;
-    for (const std::vector<unsigned char>& _message : _split_data) {
-        if (!is_yamaha(_message)) {
+    for (const sysex_patch_location& _location : split_sysex_all(data, length)) {
+        const unsigned char* _message = data + _location.offset;
+        if (!is_complete_sysex(_message, _location.length)) {
+            // Interrupted by a status byte, can not be sent as one message
+            continue;
+        }
+        if (!is_yamaha(_message, _location.length)) {
             // Unknown vendor: still expose as a patch with a generic name
-            sysex_patch _patch;
-            _patch.name = bank.filename().string() + " (message " + std::to_string(++_other_index) + ")";
-            _patch.data = _message;
-            _sysex_patches.push_back(std::move(_patch));
+            _entries.push_back({ bank.filename().string() + " (message " + std::to_string(++_other_index) + ")", _location });
             continue;
         }
 
-        if (is_dx7_bank32(_message)) {
+        if (is_dx7_bank32(_message, _location.length)) {
             // Explode 32-voice bank into 32 single-voice messages
             const std::size_t _data_offset = 6;
-            const unsigned char* data = _message.data() + _data_offset;
             for (int _index = 0; _index < 32; ++_index) {
-                const unsigned char* _chunk = data + _index * 128;
-                std::vector<unsigned char> _parameters = dx7_chunk128_to_param155(_chunk);
-                std::vector<unsigned char> _patch_message = build_single_voice_sysex_from_parameters(_parameters, /*channel*/ 0);
-                sysex_patch _patch;
-                _patch.name = name_from_chunk(_chunk);
-                _patch.data = std::move(_patch_message);
-                _sysex_patches.push_back(std::move(_patch));
+                sysex_patch_entry _entry { name_from_chunk(_message + _data_offset + _index * 128), _location };
+                _entry.location.voice = static_cast<std::uint8_t>(_index);
+                _entries.push_back(std::move(_entry));
             }
             continue;
         }
 
-        if (is_dx7_single_voice_message(_message)) {
-            sysex_patch _patch;
-            _patch.name = name_from_single_voice_message(_message);
-            if (_patch.name == "Voice") {
+        if (is_dx7_single_voice_message(_message, _location.length)) {
+            std::string _name = name_from_single_voice_message(_message, _location.length);
+            if (_name == "Voice") {
                 // If name not present, label with filename + index to avoid duplicates
-                _patch.name = bank.stem().string() + " (Voice " + std::to_string(++_single_voice_index) + ")";
+                _name = bank.stem().string() + " (Voice " + std::to_string(++_single_voice_index) + ")";
             }
-            _patch.data = _message; // already a complete single-voice F0..F7
-            _sysex_patches.push_back(std::move(_patch));
+            _entries.push_back({ std::move(_name), _location }); // already a complete single-voice F0..F7
             continue;
         }
 
         // Other Yamaha formats (DX7II/TX etc.) — expose raw message
+        _entries.push_back({ bank.filename().string() + " (Yamaha message " + std::to_string(++_other_index) + ")", _location });
+    }
+    return _entries;
+}
+
+midi_message_blob make_sysex_patch_data(const sysex_patch_location& location, const unsigned char* data)
+{
+    const unsigned char* _message = data + location.offset;
+    if (location.voice == sysex_patch_location::whole_message) {
+        return std::make_shared<const std::vector<unsigned char>>(_message, _message + location.length);
+    }
+    return make_single_voice_data(_message + 6 + location.voice * 128, /*channel*/ 0);
+}
+
+std::vector<sysex_patch> load_sysex_patches(const std::filesystem::path& bank)
+{
+    std::vector<sysex_patch> _sysex_patches;
+    const std::vector<unsigned char> _raw_data = read_sysex_file(bank);
+    for (sysex_patch_entry& _entry : find_sysex_patches(bank, _raw_data.data(), _raw_data.size())) {
         sysex_patch _patch;
-        _patch.name = bank.filename().string() + " (Yamaha message " + std::to_string(++_other_index) + ")";
-        _patch.data = _message;
+        _patch.name = std::move(_entry.name);
+        _patch.data = make_sysex_patch_data(_entry.location, _raw_data.data());
         _sysex_patches.push_back(std::move(_patch));
     }
-
     return _sysex_patches;
 }
+
+sysex_bank load_sysex_bank(const std::filesystem::path& bank)
+{
+    std::shared_ptr<const mapped_file> _file = std::make_shared<const mapped_file>(bank);
+    std::vector<sysex_patch_entry> _patches;
+    if (!_file->access([&] { _patches = find_sysex_patches(bank, _file->data(), _file->size()); })) {
+        _patches.clear();
+    }
+    return sysex_bank(std::move(_file), std::move(_patches));
+}
+
+sysex_bank::sysex_bank(std::shared_ptr<const mapped_file> file)
+    : _file(std::move(file))
+{
+}
+
+sysex_bank::sysex_bank(std::shared_ptr<const mapped_file> file, std::vector<sysex_patch_entry>&& patches)
+    : _file(std::move(file))
+    , _patches(std::move(patches))
+{
+}
+
+const std::shared_ptr<const mapped_file>& sysex_bank::get_file() const
+{
+    return _file;
+}
+
+void sysex_bank::add_patch(sysex_patch_entry&& entry)
+{
+    _patches.push_back(std::move(entry));
+}
+
+void sysex_bank::reserve(const std::size_t count)
+{
+    _patches.reserve(count);
+}
+
+std::size_t sysex_bank::size() const
+{
+    return _patches.size();
+}
+
+const std::string& sysex_bank::get_name(const std::size_t patch) const
+{
+    return _patches[patch].name;
+}
+
+midi_message_blob sysex_bank::make_data(const std::size_t patch) const
+{
+    const sysex_patch_location& _location = _patches[patch].location;
+    if (!_file || std::size_t(_location.offset) + _location.length > _file->size()) {
+        return nullptr;
+    }
+    // the file can have been rewritten or truncated since it was mapped, the bytes are checked once copied
+    const unsigned char* _message = _file->data() + _location.offset;
+    if (_location.voice == sysex_patch_location::whole_message) {
+        std::vector<unsigned char> _copy(_location.length);
+        if (!_file->copy(_location.offset, _copy.data(), _copy.size()) || !is_complete_sysex(_copy.data(), _copy.size())) {
+            return nullptr;
+        }
+        return std::make_shared<const std::vector<unsigned char>>(std::move(_copy));
+    }
+    unsigned char _chunk[dx7_voice_bank::packed_size];
+    bool _is_voice = false;
+    const bool _is_intact = _file->access([&] {
+        _is_voice = _location.voice < 32 && is_dx7_bank32(_message, _location.length) && _message[_location.length - 1] == 0xF7;
+        std::memcpy(_chunk, _message + 6 + _location.voice * dx7_voice_bank::packed_size, sizeof(_chunk));
+    });
+    if (!_is_intact || !_is_voice || std::any_of(std::begin(_chunk), std::end(_chunk), is_midi_status)) {
+        return nullptr;
+    }
+    return make_single_voice_data(_chunk, 0);
+}
+
+void dx7_voice_bank::add_packed(const unsigned char* packed)
+{
+    _voices.insert(_voices.end(), packed, packed + packed_size);
+}
+
+bool dx7_voice_bank::add_message(const unsigned char* message, const std::size_t length)
+{
+    if (!is_complete_sysex(message, length)) {
+        return false;
+    }
+    if (is_dx7_bank32(message, length)) {
+        // the 32 voices follow each other in the dump as they are kept here
+        _voices.insert(_voices.end(), message + 6, message + 6 + 32 * packed_size);
+        return true;
+    }
+    if (is_dx7_single_voice_message(message, length) && length >= 6 + 155 + 1 + 1) {
+        _voices.resize(_voices.size() + packed_size);
+        dx7_param155_to_chunk128(message + 6, _voices.data() + _voices.size() - packed_size);
+        return true;
+    }
+    return false;
+}
+
+void dx7_voice_bank::reserve(const std::size_t count)
+{
+    _voices.reserve(count * packed_size);
+}
+
+std::size_t dx7_voice_bank::size() const
+{
+    return _voices.size() / packed_size;
+}
+
+const unsigned char* dx7_voice_bank::get_packed(const std::size_t voice) const
+{
+    return _voices.data() + voice * packed_size;
+}
+
+unsigned char* dx7_voice_bank::get_packed(const std::size_t voice)
+{
+    return _voices.data() + voice * packed_size;
+}
+
+std::string dx7_voice_bank::get_name(const std::size_t voice) const
+{
+    return name_from_chunk(get_packed(voice));
+}
+
+midi_message_blob dx7_voice_bank::make_data(const std::size_t voice, const int channel) const
+{
+    return make_single_voice_data(get_packed(voice), channel);
+}
+
+dx7_voice_bank load_dx7_voice_bank(const std::filesystem::path& bank)
+{
+    // mapped only while the voices are copied out, the store does not keep the file
+    const mapped_file _file(bank);
+    dx7_voice_bank _bank;
+    const bool _is_intact = _file.access([&] {
+        const std::vector<sysex_patch_location> _locations = split_sysex_all(_file.data(), _file.size());
+        std::size_t _count = 0;
+        for (const sysex_patch_location& _location : _locations) {
+            // counted first so the array is allocated once at its size
+            const unsigned char* _message = _file.data() + _location.offset;
+            _count += is_dx7_bank32(_message, _location.length) ? 32 : is_dx7_single_voice_message(_message, _location.length) ? 1 : 0;
+        }
+        _bank.reserve(_count);
+        for (const sysex_patch_location& _location : _locations) {
+            _bank.add_message(_file.data() + _location.offset, _location.length);
+        }
+    });
+    return _is_intact ? _bank : dx7_voice_bank();
+}
@@ -1,17 +1,131 @@
 #pragma once
 
+#include "mapped_file.hpp"
+#include "parser.hpp"
+
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <string>
 #include <vector>
 
 /// @brief Represents a sysex patch
 struct sysex_patch {
     std::string name;
-    std::vector<unsigned char> data;
+    midi_message_blob data; // complete SysEx, checked with is_complete_sysex
+};
+
+/// @brief Where a patch lies in its bank file, enough to build it again without searching the file
+struct sysex_patch_location {
+    static constexpr std::uint8_t whole_message = 0xFF;
+
+    std::uint32_t offset = 0; // of the F0 of the message holding the patch
+    std::uint32_t length = 0; // of that message up to its F7
+    std::uint8_t voice = whole_message; // voice of a DX7 32 voice bank, or the message as is
+};
+
+/// @brief Name and location of a patch found in a bank file
+struct sysex_patch_entry {
+    std::string name;
+    sysex_patch_location location;
+};
+
+/// @brief DX7 voices kept in their packed 128 byte form, one contiguous array for the whole bank
+/// @details A voice costs its 128 bytes and no allocation of its own. Its name is read from the packed bytes and its
+/// single voice message is only built when it is sent, so an edit is a change of the packed bytes. Voices of 32 voice
+/// banks are copied as they are in the dump, single voice messages are packed.
+class dx7_voice_bank {
+public:
+    static constexpr std::size_t packed_size = 128;
+
+    /// @brief Adds a voice in packed form
+    void add_packed(const unsigned char* packed);
+
+    /// @brief Adds the 32 voices of a bank dump or the voice of a single voice message
+    /// @return If the message was a DX7 voice message
+    bool add_message(const unsigned char* message, const std::size_t length);
+
+    /// @brief Reserves room for a count of voices
+    void reserve(const std::size_t count);
+
+    /// @brief Gets the count of voices
+    [[nodiscard]] std::size_t size() const;
+
+    /// @brief Gets the packed bytes of a voice
+    [[nodiscard]] const unsigned char* get_packed(const std::size_t voice) const;
+
+    /// @brief Gets the packed bytes of a voice to edit them
+    [[nodiscard]] unsigned char* get_packed(const std::size_t voice);
+
+    /// @brief Gets the name of a voice, the 10 characters of its packed bytes
+    [[nodiscard]] std::string get_name(const std::size_t voice) const;
+
+    /// @brief Builds the single voice message of a voice
+    [[nodiscard]] midi_message_blob make_data(const std::size_t voice, const int channel = 0) const;
+
+private:
+    std::vector<unsigned char> _voices;
 };
 
+/// @brief Bank file mapped in memory, its patches are names and locations in the mapping
+/// @details Copies share the mapping, which stays until the last of them is gone. No byte of a patch is copied until
+/// its message is built to be sent. A voice of a DX7 32 voice bank stays as its 128 packed bytes in the mapped dump
+/// and is only unpacked to a single voice message then.
+class sysex_bank {
+public:
+    sysex_bank() = default;
+
+    /// @brief Holds a mapping, patches are added afterwards
+    explicit sysex_bank(std::shared_ptr<const mapped_file> file);
+
+    /// @brief Holds a mapping and the patches found in it
+    sysex_bank(std::shared_ptr<const mapped_file> file, std::vector<sysex_patch_entry>&& patches);
+
+    /// @brief Gets the mapping, null for a bank without file
+    [[nodiscard]] const std::shared_ptr<const mapped_file>& get_file() const;
+
+    /// @brief Adds a patch found in the mapping
+    void add_patch(sysex_patch_entry&& entry);
+
+    /// @brief Reserves room for a count of patches
+    void reserve(const std::size_t count);
+
+    /// @brief Gets the count of patches
+    [[nodiscard]] std::size_t size() const;
+
+    /// @brief Gets the name of a patch
+    [[nodiscard]] const std::string& get_name(const std::size_t patch) const;
+
+    /// @brief Builds the SysEx sent for a patch, voices of banks are unpacked to single voice messages
+    /// @return Null if the file, changed on disk since, no longer holds a complete message where the patch was found
+    [[nodiscard]] midi_message_blob make_data(const std::size_t patch) const;
+
+private:
+    std::shared_ptr<const mapped_file> _file;
+    std::vector<sysex_patch_entry> _patches;
+};
+
+/// @brief Reads a whole file, empty if it can not be read
+[[nodiscard]] std::vector<unsigned char> read_sysex_file(const std::filesystem::path& path);
+
+/// @brief Gets if a file has the .syx extension, in any case
+[[nodiscard]] bool is_sysex_file(const std::filesystem::path& path);
+
 /// @brief Loads recursively all sysex banks but does not load patches
 [[nodiscard]] std::vector<std::filesystem::path> load_sysex_banks_recursive(const std::filesystem::path& root_path);
 
+/// @brief Finds every patch in the bytes of a bank file, DX7 32 voice banks give one patch per voice
+[[nodiscard]] std::vector<sysex_patch_entry> find_sysex_patches(const std::filesystem::path& bank, const unsigned char* data, const std::size_t length);
+
+/// @brief Builds the SysEx sent for a patch from the bytes of its bank file, voices of banks become single voice messages
+[[nodiscard]] midi_message_blob make_sysex_patch_data(const sysex_patch_location& location, const unsigned char* data);
+
 /// @brief Loads recursively all patches from the bank
 [[nodiscard]] std::vector<sysex_patch> load_sysex_patches(const std::filesystem::path& bank);
+
+/// @brief Maps a bank file and finds its patches without copying any of them
+[[nodiscard]] sysex_bank load_sysex_bank(const std::filesystem::path& bank);
+
+/// @brief Reads the DX7 voices of a bank file into a packed store, skipping any other message
+[[nodiscard]] dx7_voice_bank load_dx7_voice_bank(const std::filesystem::path& bank);
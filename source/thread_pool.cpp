@@ -0,0 +1,107 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace {
+
+static thread_local const work_stealing_pool* current_pool = nullptr;
+static thread_local std::size_t current_worker = 0;
+
+}
+
+work_stealing_pool::work_stealing_pool(const std::size_t threads)
+{
+    const std::size_t _count = threads ? threads : std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    for (std::size_t _worker = 0; _worker < _count; ++_worker) {
+        _queues.push_back(std::make_unique<worker_queue>());
+    }
+    for (std::size_t _worker = 0; _worker < _count; ++_worker) {
+        _threads.emplace_back(&work_stealing_pool::run, this, _worker);
+    }
+}
+
+work_stealing_pool::~work_stealing_pool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> _lock_guard(_mutex);
+        _is_stopping.store(true);
+    }
+    _work_condition.notify_all();
+    for (std::thread& _thread : _threads) {
+        _thread.join();
+    }
+}
+
+void work_stealing_pool::push(task&& work)
+{
+    const std::size_t _worker = current_pool == this ? current_worker : _next_queue.fetch_add(1) % _queues.size();
+    _pending.fetch_add(1);
+    _queued.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> _lock_guard(_queues[_worker]->mutex);
+        _queues[_worker]->tasks.push_back(std::move(work));
+    }
+    {
+        // taken so a worker checking the count right before sleeping can not miss the notification
+        std::lock_guard<std::mutex> _lock_guard(_mutex);
+    }
+    _work_condition.notify_one();
+}
+
+void work_stealing_pool::wait()
+{
+    std::unique_lock<std::mutex> _lock(_mutex);
+    _idle_condition.wait(_lock, [this] { return _pending.load() == 0; });
+}
+
+std::size_t work_stealing_pool::size() const
+{
+    return _threads.size();
+}
+
+bool work_stealing_pool::try_pop(const std::size_t worker, task& work)
+{
+    {
+        worker_queue& _own = *_queues[worker];
+        std::lock_guard<std::mutex> _lock_guard(_own.mutex);
+        if (!_own.tasks.empty()) {
+            work = std::move(_own.tasks.back());
+            _own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (std::size_t _offset = 1; _offset < _queues.size(); ++_offset) {
+        worker_queue& _victim = *_queues[(worker + _offset) % _queues.size()];
+        std::lock_guard<std::mutex> _lock_guard(_victim.mutex);
+        if (!_victim.tasks.empty()) {
+            work = std::move(_victim.tasks.front());
+            _victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void work_stealing_pool::run(const std::size_t worker)
+{
+    current_pool = this;
+    current_worker = worker;
+    while (true) {
+        task _work;
+        if (try_pop(worker, _work)) {
+            _queued.fetch_sub(1);
+            _work();
+            if (_pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> _lock_guard(_mutex);
+                _idle_condition.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> _lock(_mutex);
+        _work_condition.wait(_lock, [this] { return _queued.load() > 0 || _is_stopping.load(); });
+        if (_is_stopping.load() && _queued.load() == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief Fixed set of worker threads each with its own task deque, idle workers steal from the others
+/// @details A task pushed from a worker goes to the back of that worker's deque and is taken from the back, so a tree
+/// of tasks is walked depth first and stays in cache. Idle workers steal from the front of the others, where the
+/// oldest and usually largest subtrees are. Deques are guarded by their own mutex, they are only contended on steals.
+class work_stealing_pool {
+public:
+    using task = std::function<void()>;
+
+    /// @brief Starts the workers, one per hardware thread if the count is 0
+    explicit work_stealing_pool(const std::size_t threads = 0);
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    /// @brief Waits for every task and joins the workers
+    ~work_stealing_pool();
+
+    /// @brief Queues a task, from any thread or from a running task
+    void push(task&& work);
+
+    /// @brief Blocks until every task pushed so far and every task they pushed have finished
+    void wait();
+
+    /// @brief Gets the count of workers
+    [[nodiscard]] std::size_t size() const;
+
+private:
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    void run(const std::size_t worker);
+    [[nodiscard]] bool try_pop(const std::size_t worker, task& work);
+
+    std::vector<std::unique_ptr<worker_queue>> _queues;
+    std::vector<std::thread> _threads;
+    std::atomic<std::size_t> _queued = 0; // tasks waiting in a deque
+    std::atomic<std::size_t> _pending = 0; // tasks pushed and not finished yet
+    std::atomic<std::size_t> _next_queue = 0; // round robin for tasks pushed from outside the pool
+    std::atomic<bool> _is_stopping = false;
+    std::mutex _mutex;
+    std::condition_variable _work_condition;
+    std::condition_variable _idle_condition;
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// @brief Hierarchical timer wheel holding values until their due time, for one thread
+/// @details Four levels of 256 slots with 65.536 us ticks cover about 78 hours ahead, the last level wraps around
+/// and values further away wait in an overflow list checked each time the last level turns. Inserting is constant
+/// time, values are cascaded to lower levels as time reaches them and keep their exact due time so they are released
+/// on time rather than on tick boundaries. Spans with no value are skipped whole. Slots keep their storage once grown
+/// so a steady flow of timers does not allocate.
+template <typename Value>
+class timer_wheel {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t level_count = 4;
+    static constexpr std::size_t slot_bits = 8;
+    static constexpr std::size_t slot_count = std::size_t(1) << slot_bits;
+    static constexpr std::size_t tick_bits = 16; // 65.536 us
+
+    /// @brief Adds a value released once the time passes its due time, values already due are released on the next advance
+    void insert(const clock::time_point due, Value&& value)
+    {
+        const std::uint64_t _tick = std::max(get_tick(due), _current_tick);
+        if (_size == 0) {
+            // nothing to cascade, the wheel can start at the tick of the value whatever time it was left at
+            _current_tick = _tick;
+        }
+        ++_size;
+        place(_tick, std::make_pair(due, std::move(value)));
+    }
+
+    /// @brief Moves the wheel to the time and calls sink(clock::time_point due, Value&& value) for every due value
+    /// @details Values come out ordered by tick, and in insertion order within a tick.
+    template <typename Sink>
+    void advance(const clock::time_point now, Sink&& sink)
+    {
+        const std::uint64_t _now_tick = get_tick(now);
+        if (_size == 0) {
+            _current_tick = std::max(_current_tick, _now_tick);
+            return;
+        }
+        while (true) {
+            release(_levels[0][_current_tick & (slot_count - 1)], now, sink);
+            if (_current_tick >= _now_tick || _size == 0) {
+                break;
+            }
+            _current_tick = std::min(get_next_busy_tick(), _now_tick);
+            cascade();
+        }
+        _current_tick = std::max(_current_tick, _now_tick);
+    }
+
+    /// @brief Gets when advance has to be called next, the earliest due time in the next busy tick or the next cascade
+    [[nodiscard]] clock::time_point next_deadline() const
+    {
+        if (_size == 0) {
+            return clock::time_point::max();
+        }
+        if (_level_sizes[0] == 0) {
+            return get_tick_time(get_next_busy_tick());
+        }
+        const std::uint64_t _level_end = (_current_tick | (slot_count - 1)) + 1;
+        for (std::uint64_t _tick = _current_tick; _tick < _level_end; ++_tick) {
+            const std::vector<std::pair<clock::time_point, Value>>& _slot = _levels[0][_tick & (slot_count - 1)];
+            if (!_slot.empty()) {
+                clock::time_point _deadline = clock::time_point::max();
+                for (const std::pair<clock::time_point, Value>& _timer : _slot) {
+                    _deadline = std::min(_deadline, _timer.first);
+                }
+                return _deadline;
+            }
+        }
+        return get_tick_time(_level_end);
+    }
+
+    /// @brief Gets the count of values waiting
+    [[nodiscard]] std::size_t size() const
+    {
+        return _size;
+    }
+
+    /// @brief Drops every value waiting
+    void clear()
+    {
+        for (std::array<std::vector<std::pair<clock::time_point, Value>>, slot_count>& _level : _levels) {
+            for (std::vector<std::pair<clock::time_point, Value>>& _slot : _level) {
+                _slot.clear();
+            }
+        }
+        _overflow.clear();
+        _level_sizes = {};
+        _size = 0;
+    }
+
+private:
+    [[nodiscard]] static std::uint64_t get_tick(const clock::time_point time)
+    {
+        const clock::rep _nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+        return _nanoseconds > 0 ? static_cast<std::uint64_t>(_nanoseconds) >> tick_bits : 0;
+    }
+
+    [[nodiscard]] static clock::time_point get_tick_time(const std::uint64_t tick)
+    {
+        const std::chrono::nanoseconds _time(static_cast<std::chrono::nanoseconds::rep>(tick << tick_bits));
+        return clock::time_point(std::chrono::duration_cast<clock::duration>(_time));
+    }
+
+    [[nodiscard]] std::uint64_t get_next_busy_tick() const
+    {
+        // the next tick, or past the empty lower levels the next span boundary where a level above cascades
+        std::uint64_t _next = _current_tick + 1;
+        for (std::size_t _level = 0; _level < level_count - 1 && _level_sizes[_level] == 0; ++_level) {
+            const std::size_t _shift = slot_bits * (_level + 1);
+            _next = ((_current_tick >> _shift) + 1) << _shift;
+        }
+        return _next;
+    }
+
+    void place(const std::uint64_t tick, std::pair<clock::time_point, Value>&& timer)
+    {
+        // the lowest level whose current span holds the tick, the last level wraps around over its 256 spans
+        for (std::size_t _level = 0; _level < level_count - 1; ++_level) {
+            const std::size_t _shift = slot_bits * (_level + 1);
+            if ((tick >> _shift) == (_current_tick >> _shift)) {
+                ++_level_sizes[_level];
+                _levels[_level][(tick >> (slot_bits * _level)) & (slot_count - 1)].emplace_back(std::move(timer));
+                return;
+            }
+        }
+        const std::size_t _top_shift = slot_bits * (level_count - 1);
+        if ((tick >> _top_shift) - (_current_tick >> _top_shift) <= slot_count) {
+            // the slot of the current span was cascaded already, it is next reached one whole turn later
+            ++_level_sizes[level_count - 1];
+            _levels[level_count - 1][(tick >> _top_shift) & (slot_count - 1)].emplace_back(std::move(timer));
+            return;
+        }
+        _overflow.emplace_back(std::move(timer));
+    }
+
+    void cascade()
+    {
+        // entering a new span of a level spreads the matching slot of the level above over the levels below
+        for (std::size_t _level = 1; _level < level_count; ++_level) {
+            if ((_current_tick & ((std::uint64_t(1) << (slot_bits * _level)) - 1)) != 0) {
+                return;
+            }
+            std::vector<std::pair<clock::time_point, Value>>& _slot = _levels[_level][(_current_tick >> (slot_bits * _level)) & (slot_count - 1)];
+            _level_sizes[_level] -= _slot.size();
+            _cascading.swap(_slot);
+            for (std::pair<clock::time_point, Value>& _timer : _cascading) {
+                place(std::max(get_tick(_timer.first), _current_tick), std::move(_timer));
+            }
+            _cascading.clear();
+        }
+        // the last level turned, values of the overflow list may be within its reach now
+        _cascading.swap(_overflow);
+        for (std::pair<clock::time_point, Value>& _timer : _cascading) {
+            place(std::max(get_tick(_timer.first), _current_tick), std::move(_timer));
+        }
+        _cascading.clear();
+    }
+
+    template <typename Sink>
+    void release(std::vector<std::pair<clock::time_point, Value>>& slot, const clock::time_point now, Sink& sink)
+    {
+        std::size_t _kept = 0;
+        for (std::size_t _index = 0; _index < slot.size(); ++_index) {
+            if (slot[_index].first <= now) {
+                --_size;
+                --_level_sizes[0];
+                sink(slot[_index].first, std::move(slot[_index].second));
+            } else {
+                if (_kept != _index) {
+                    slot[_kept] = std::move(slot[_index]);
+                }
+                ++_kept;
+            }
+        }
+        slot.resize(_kept);
+    }
+
+    std::array<std::array<std::vector<std::pair<clock::time_point, Value>>, slot_count>, level_count> _levels;
+    std::vector<std::pair<clock::time_point, Value>> _overflow; // beyond the reach of the last level
+    std::vector<std::pair<clock::time_point, Value>> _cascading;
+    std::array<std::size_t, level_count> _level_sizes = {}; // values held by each level
+    std::uint64_t _current_tick = 0;
+    std::size_t _size = 0;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// @brief Called from the receive thread of an input transport for every received packet
+/// @details The bytes are a view into the receive arena of the transport and are only valid during the call. A plain
+/// function pointer and context so the receive loop does not go through a type erased call or copy the packet.
+struct midi_receive_callback {
+    void (*function)(void* context, const unsigned char* data, const std::size_t length) = nullptr;
+    void* context = nullptr;
+
+    void operator()(const unsigned char* data, const std::size_t length) const
+    {
+        function(context, data, length);
+    }
+};
+
+/// @brief Makes a receive callback calling target(data, length), the target must outlive the input transport
+template <typename Target>
+[[nodiscard]] midi_receive_callback make_midi_receive_callback(Target& target)
+{
+    midi_receive_callback _callback;
+    _callback.function = [](void* context, const unsigned char* data, const std::size_t length) {
+        (*static_cast<Target*>(context))(data, length);
+    };
+    _callback.context = &target;
+    return _callback;
+}
+
+/// @brief Fixed capacity buffer a receive thread reads packets into, allocated once and reused for every packet
+class midi_receive_arena {
+public:
+    static constexpr std::size_t default_capacity = 65536;
+
+    explicit midi_receive_arena(const std::size_t capacity = default_capacity)
+        : _data(std::make_unique<unsigned char[]>(capacity))
+        , _capacity(capacity)
+    {
+    }
+
+    /// @brief Gets the start of the buffer
+    [[nodiscard]] unsigned char* data()
+    {
+        return _data.get();
+    }
+
+    /// @brief Gets the size of the buffer in bytes
+    [[nodiscard]] std::size_t capacity() const
+    {
+        return _capacity;
+    }
+
+    /// @brief Grows the buffer if it is smaller than the capacity, it never shrinks
+    void reserve(const std::size_t capacity)
+    {
+        if (capacity > _capacity) {
+            _data = std::make_unique<unsigned char[]>(capacity);
+            _capacity = capacity;
+        }
+    }
+
+private:
+    std::unique_ptr<unsigned char[]> _data;
+    std::size_t _capacity;
+};
+
+/// @brief Sending side of a MIDI backend, only used from one thread at a time
+class midi_output_transport {
+public:
+    virtual ~midi_output_transport() = default;
+
+    /// @brief Sends one complete message, or raw bytes if the transport is a raw byte stream
+    virtual void send(const unsigned char* data, const std::size_t length) = 0;
+
+    /// @brief Gets if bytes reach the wire as sent, so running status and split messages are allowed
+    [[nodiscard]] virtual bool is_raw_byte_stream() const
+    {
+        return false;
+    }
+
+    /// @brief Gets if a channel message may be sent without its status byte when it repeats the previous one
+    /// @details Raw byte streams do, and so do backends whose driver keeps the running status of the port.
+    [[nodiscard]] virtual bool accepts_running_status() const
+    {
+        return is_raw_byte_stream();
+    }
+};
+
+/// @brief Receiving side of a MIDI backend which owns its receive thread
+class midi_input_transport {
+public:
+    virtual ~midi_input_transport() = default;
+
+    /// @brief Starts the receive thread and calls the callback from it for every received packet
+    virtual void start(const midi_receive_callback& callback) = 0;
+
+    /// @brief Stops and joins the receive thread for good, the callback is not called anymore after this returns
+    virtual void stop() = 0;
+};
+
+/// @brief Both ends of an in-process loopback, bytes sent to the output are received by the input
+struct midi_loopback {
+    std::unique_ptr<midi_output_transport> output;
+    std::unique_ptr<midi_input_transport> input;
+};
+
+/// @brief Gets a list of the available RtMidi output port names
+[[nodiscard]] std::vector<std::string> get_rtmidi_output_ports();
+
+/// @brief Gets a list of the available RtMidi input port names
+[[nodiscard]] std::vector<std::string> get_rtmidi_input_ports();
+
+/// @brief Opens the selected RtMidi output port (WinMM on Windows, ALSA or JACK on Linux)
+[[nodiscard]] std::unique_ptr<midi_output_transport> create_rtmidi_output(const std::size_t index);
+
+/// @brief Opens the selected RtMidi input port with SysEx, timing and active sensing let through
+[[nodiscard]] std::unique_ptr<midi_input_transport> create_rtmidi_input(const std::size_t index);
+
+/// @brief Creates a named virtual input port (teVirtualMIDI on Windows, ALSA sequencer on Linux)
+[[nodiscard]] std::unique_ptr<midi_input_transport> create_virtual_input(const std::string& port);
+
+/// @brief Creates a named virtual output port other applications can read from, sends complete messages only
+[[nodiscard]] std::unique_ptr<midi_output_transport> create_virtual_output(const std::string& port);
+
+/// @brief Creates a lock-free in-process loopback that does not need any MIDI driver or hardware
+[[nodiscard]] midi_loopback create_loopback();
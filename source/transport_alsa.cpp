@@ -0,0 +1,218 @@
+#if defined(MIDIBRIDGE_HAS_ALSA)
+
+#include "transport.hpp"
+
+#include <alsa/asoundlib.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+class alsa_input_transport : public midi_input_transport {
+public:
+    explicit alsa_input_transport(const std::string& port)
+    {
+        const std::size_t _max_sysex_size = 65535;
+        if (snd_seq_open(&_sequencer, "default", SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK) < 0) {
+            _sequencer = nullptr;
+            throw std::runtime_error("snd_seq_open failed");
+        }
+        snd_seq_set_client_name(_sequencer, port.c_str());
+        const unsigned int _capabilities = SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE;
+        const unsigned int _type = SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION;
+        if (snd_seq_create_simple_port(_sequencer, port.c_str(), _capabilities, _type) < 0) {
+            release();
+            throw std::runtime_error("snd_seq_create_simple_port failed");
+        }
+        if (snd_midi_event_new(_max_sysex_size, &_decoder) < 0) {
+            _decoder = nullptr;
+            release();
+            throw std::runtime_error("snd_midi_event_new failed");
+        }
+        snd_midi_event_no_status(_decoder, 1);
+        _wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (_wakeup_fd < 0) {
+            release();
+            throw std::runtime_error("eventfd failed");
+        }
+    }
+
+    ~alsa_input_transport() override
+    {
+        stop();
+        release();
+    }
+
+    void start(const midi_receive_callback& callback) override
+    {
+        if (_is_running.exchange(true)) {
+            return;
+        }
+        _thread = std::thread([this, callback] {
+            // poll() sleeps until the sequencer has events or stop() signals the eventfd
+            const int _count = snd_seq_poll_descriptors_count(_sequencer, POLLIN);
+            std::vector<pollfd> _descriptors(static_cast<std::size_t>(_count) + 1);
+            _descriptors[0] = { _wakeup_fd, POLLIN, 0 };
+            snd_seq_poll_descriptors(_sequencer, _descriptors.data() + 1, static_cast<unsigned int>(_count), POLLIN);
+
+            midi_receive_arena _arena;
+            while (_is_running.load()) {
+                if (poll(_descriptors.data(), _descriptors.size(), -1) < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                if (_descriptors[0].revents & POLLIN) {
+                    // read so the eventfd is clear again when the transport is restarted
+                    std::uint64_t _value = 0;
+                    [[maybe_unused]] const ssize_t _read = read(_wakeup_fd, &_value, sizeof(_value));
+                    continue;
+                }
+                snd_seq_event_t* _event = nullptr;
+                while (snd_seq_event_input(_sequencer, &_event) >= 0) {
+                    const long _size = snd_midi_event_decode(_decoder, _arena.data(), static_cast<long>(_arena.capacity()), _event);
+                    if (_size > 0) {
+                        callback(_arena.data(), static_cast<std::size_t>(_size));
+                    }
+                }
+            }
+        });
+    }
+
+    void stop() override
+    {
+        if (!_is_running.exchange(false)) {
+            return;
+        }
+        const std::uint64_t _value = 1;
+        [[maybe_unused]] const ssize_t _written = write(_wakeup_fd, &_value, sizeof(_value));
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+private:
+    void release()
+    {
+        if (_decoder) {
+            snd_midi_event_free(_decoder);
+            _decoder = nullptr;
+        }
+        if (_sequencer) {
+            snd_seq_close(_sequencer);
+            _sequencer = nullptr;
+        }
+        if (_wakeup_fd >= 0) {
+            close(_wakeup_fd);
+            _wakeup_fd = -1;
+        }
+    }
+
+    snd_seq_t* _sequencer = nullptr;
+    snd_midi_event_t* _decoder = nullptr;
+    int _wakeup_fd = -1;
+    std::atomic<bool> _is_running = false;
+    std::thread _thread;
+};
+
+class alsa_output_transport : public midi_output_transport {
+public:
+    explicit alsa_output_transport(const std::string& port)
+    {
+        const std::size_t _max_sysex_size = 65535;
+        if (snd_seq_open(&_sequencer, "default", SND_SEQ_OPEN_OUTPUT, 0) < 0) {
+            _sequencer = nullptr;
+            throw std::runtime_error("snd_seq_open failed");
+        }
+        snd_seq_set_client_name(_sequencer, port.c_str());
+        const unsigned int _capabilities = SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ;
+        const unsigned int _type = SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION;
+        _port = snd_seq_create_simple_port(_sequencer, port.c_str(), _capabilities, _type);
+        if (_port < 0) {
+            release();
+            throw std::runtime_error("snd_seq_create_simple_port failed");
+        }
+        if (snd_midi_event_new(_max_sysex_size, &_encoder) < 0) {
+            _encoder = nullptr;
+            release();
+            throw std::runtime_error("snd_midi_event_new failed");
+        }
+    }
+
+    ~alsa_output_transport() override
+    {
+        release();
+    }
+
+    void send(const unsigned char* data, const std::size_t length) override
+    {
+        // every message is a complete one, so the encoder never keeps state from the previous send
+        snd_midi_event_reset_encode(_encoder);
+        snd_seq_event_t _event;
+        snd_seq_ev_clear(&_event);
+        if (snd_midi_event_encode(_encoder, data, static_cast<long>(length), &_event) <= 0 || _event.type == SND_SEQ_EVENT_NONE) {
+            return;
+        }
+        snd_seq_ev_set_source(&_event, _port);
+        snd_seq_ev_set_subs(&_event);
+        snd_seq_ev_set_direct(&_event);
+        snd_seq_event_output_direct(_sequencer, &_event);
+    }
+
+private:
+    void release()
+    {
+        if (_encoder) {
+            snd_midi_event_free(_encoder);
+            _encoder = nullptr;
+        }
+        if (_sequencer) {
+            snd_seq_close(_sequencer);
+            _sequencer = nullptr;
+        }
+    }
+
+    snd_seq_t* _sequencer = nullptr;
+    snd_midi_event_t* _encoder = nullptr;
+    int _port = -1;
+};
+
+}
+
+std::unique_ptr<midi_input_transport> create_virtual_input(const std::string& port)
+{
+    return std::make_unique<alsa_input_transport>(port);
+}
+
+std::unique_ptr<midi_output_transport> create_virtual_output(const std::string& port)
+{
+    return std::make_unique<alsa_output_transport>(port);
+}
+
+#elif !defined(_WIN32)
+
+#include "transport.hpp"
+
+#include <stdexcept>
+
+std::unique_ptr<midi_input_transport> create_virtual_input(const std::string& port)
+{
+    (void)port;
+    throw std::runtime_error("No virtual port backend, ALSA was not found at build time");
+}
+
+std::unique_ptr<midi_output_transport> create_virtual_output(const std::string& port)
+{
+    (void)port;
+    throw std::runtime_error("No virtual port backend, ALSA was not found at build time");
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include "transport.hpp"
+#include "ring.hpp"
+
+#include <atomic>
+#include <thread>
+
+namespace {
+
+static constexpr std::size_t loopback_ring_capacity = 1 << 18;
+
+struct loopback_state {
+    spsc_ring<loopback_ring_capacity> ring;
+    ring_wakeup wakeup;
+    std::atomic<bool> is_running = false;
+};
+
+class loopback_output_transport : public midi_output_transport {
+public:
+    explicit loopback_output_transport(const std::shared_ptr<loopback_state>& state)
+        : _state(state)
+    {
+    }
+
+    void send(const unsigned char* data, const std::size_t length) override
+    {
+        if (length && _state->ring.try_push(data, length)) {
+            _state->wakeup.notify();
+        }
+    }
+
+    [[nodiscard]] bool is_raw_byte_stream() const override
+    {
+        return true;
+    }
+
+private:
+    std::shared_ptr<loopback_state> _state;
+};
+
+class loopback_input_transport : public midi_input_transport {
+public:
+    explicit loopback_input_transport(const std::shared_ptr<loopback_state>& state)
+        : _state(state)
+    {
+    }
+
+    ~loopback_input_transport() override
+    {
+        stop();
+    }
+
+    void start(const midi_receive_callback& callback) override
+    {
+        if (_state->is_running.exchange(true)) {
+            return;
+        }
+        _thread = std::thread([this, callback] {
+            // packets can never be larger than the ring
+            midi_receive_arena _arena(loopback_ring_capacity);
+            std::size_t _length = 0;
+            std::int64_t _stamp = 0;
+            while (_state->is_running.load()) {
+                if (_state->ring.try_pop(_arena.data(), _arena.capacity(), _length, _stamp)) {
+                    callback(_arena.data(), _length);
+                } else {
+                    _state->wakeup.wait([this] { return !_state->is_running.load() || !_state->ring.empty(); });
+                }
+            }
+        });
+    }
+
+    void stop() override
+    {
+        if (!_state->is_running.exchange(false)) {
+            return;
+        }
+        _state->wakeup.notify();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+private:
+    std::shared_ptr<loopback_state> _state;
+    std::thread _thread;
+};
+
+}
+
+midi_loopback create_loopback()
+{
+    const std::shared_ptr<loopback_state> _state = std::make_shared<loopback_state>();
+    midi_loopback _loopback;
+    _loopback.output = std::make_unique<loopback_output_transport>(_state);
+    _loopback.input = std::make_unique<loopback_input_transport>(_state);
+    return _loopback;
+}
@@ -0,0 +1,135 @@
+#include "transport.hpp"
+
+#include <RtMidi.h>
+
+namespace {
+
+static void remove_last_word_inplace(std::string& s)
+{
+    const char* _whitespace = " \t\n\r\f\v";
+    const std::size_t _end = s.find_last_not_of(_whitespace);
+    if (_end == std::string::npos) {
+        s.clear();
+        return;
+    }
+    s.erase(_end + 1);
+    const std::size_t _separator = s.find_last_of(_whitespace);
+    if (_separator == std::string::npos) {
+        s.clear();
+        return;
+    }
+    s.erase(_separator);
+}
+
+class rtmidi_output_transport : public midi_output_transport {
+public:
+    explicit rtmidi_output_transport(const std::size_t index)
+    {
+        _midiout.openPort(static_cast<unsigned int>(index));
+        // midiOutShortMsg takes messages without status byte and the driver sends them as they are, the other APIs
+        // parse every message into an event of its own
+        _accepts_running_status = _midiout.getCurrentApi() == RtMidi::WINDOWS_MM;
+    }
+
+    void send(const unsigned char* data, const std::size_t length) override
+    {
+        try {
+            _midiout.sendMessage(data, length);
+        } catch (...) {
+        }
+    }
+
+    [[nodiscard]] bool accepts_running_status() const override
+    {
+        return _accepts_running_status;
+    }
+
+private:
+    RtMidiOut _midiout;
+    bool _accepts_running_status = false;
+};
+
+class rtmidi_input_transport : public midi_input_transport {
+public:
+    explicit rtmidi_input_transport(const std::size_t index)
+        : _index(index)
+    {
+        _midiin.ignoreTypes(false, false, false);
+    }
+
+    ~rtmidi_input_transport() override
+    {
+        stop();
+    }
+
+    void start(const midi_receive_callback& callback) override
+    {
+        if (_is_running) {
+            return;
+        }
+        // RtMidi owns the receive thread and hands every complete message to the callback as it arrives
+        _callback = callback;
+        _midiin.setCallback(receive, this);
+        _midiin.openPort(static_cast<unsigned int>(_index));
+        _is_running = true;
+    }
+
+    void stop() override
+    {
+        if (!_is_running) {
+            return;
+        }
+        _midiin.closePort();
+        _midiin.cancelCallback();
+        _is_running = false;
+    }
+
+private:
+    static void receive(double, std::vector<unsigned char>* message, void* user_data)
+    {
+        const rtmidi_input_transport& _transport = *static_cast<const rtmidi_input_transport*>(user_data);
+        if (message && !message->empty()) {
+            _transport._callback(message->data(), message->size());
+        }
+    }
+
+    RtMidiIn _midiin;
+    std::size_t _index = 0;
+    midi_receive_callback _callback;
+    bool _is_running = false;
+};
+
+template <typename Api>
+[[nodiscard]] static std::vector<std::string> get_rtmidi_ports()
+{
+    Api _midi;
+    std::vector<std::string> _ports;
+    _ports.resize(_midi.getPortCount());
+    for (unsigned int _index = 0; _index < _ports.size(); ++_index) {
+        _ports[_index] = _midi.getPortName(_index);
+        remove_last_word_inplace(_ports[_index]);
+    }
+    return _ports;
+}
+
+}
+
+std::vector<std::string> get_rtmidi_output_ports()
+{
+    return get_rtmidi_ports<RtMidiOut>();
+}
+
+std::vector<std::string> get_rtmidi_input_ports()
+{
+    return get_rtmidi_ports<RtMidiIn>();
+}
+
+std::unique_ptr<midi_output_transport> create_rtmidi_output(const std::size_t index)
+{
+    return std::make_unique<rtmidi_output_transport>(index);
+}
+
+std::unique_ptr<midi_input_transport> create_rtmidi_input(const std::size_t index)
+{
+    return std::make_unique<rtmidi_input_transport>(index);
+}
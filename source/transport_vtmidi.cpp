@@ -0,0 +1,232 @@
+#if defined(_WIN32)
+
+#include "transport.hpp"
+
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <teVirtualMIDI.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+using PFN_CreateEx2 = LPVM_MIDI_PORT(WINAPI*)(LPCWSTR, LPVM_MIDI_DATA_CB, LPVOID, DWORD, DWORD);
+using PFN_GetData = BOOL(WINAPI*)(LPVM_MIDI_PORT, PBYTE, PDWORD);
+using PFN_SendData = BOOL(WINAPI*)(LPVM_MIDI_PORT, PBYTE, DWORD);
+using PFN_Shutdown = BOOL(WINAPI*)(LPVM_MIDI_PORT);
+using PFN_Close = VOID(WINAPI*)(LPVM_MIDI_PORT);
+
+static HMODULE virtual_module = nullptr;
+static std::size_t virtual_module_users = 0; // open ports, the library is freed when the last one closes
+static PFN_CreateEx2 virtual_create_ex2 = nullptr;
+static PFN_GetData virtual_get_data = nullptr;
+static PFN_SendData virtual_send_data = nullptr;
+static PFN_Shutdown virtual_shutdown = nullptr;
+static PFN_Close virtual_close = nullptr;
+
+[[nodiscard]] static std::string to_string(const std::wstring& utf16)
+{
+    if (utf16.empty()) {
+        return {};
+    }
+
+    const int _size = WideCharToMultiByte(CP_UTF8, 0, utf16.data(), static_cast<int>(utf16.size()), nullptr, 0, nullptr, nullptr);
+    std::string _utf8(_size, 0);
+    WideCharToMultiByte(CP_UTF8, 0, utf16.data(), static_cast<int>(utf16.size()), _utf8.data(), _size, nullptr, nullptr);
+    return _utf8;
+}
+
+[[nodiscard]] static std::wstring to_wstring(const std::string& utf8)
+{
+    if (utf8.empty()) {
+        return {};
+    }
+
+    const int _size = MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), nullptr, 0);
+    std::wstring _utf16(_size, 0);
+    MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), _utf16.data(), _size);
+    return _utf16;
+}
+
+[[nodiscard]] static std::string get_last_error_message(DWORD error)
+{
+    LPWSTR _buffer = nullptr;
+    const DWORD _flags = FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS;
+    const DWORD _language_id = MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT);
+    const DWORD _result = FormatMessageW(_flags, nullptr, error, _language_id, (LPWSTR)&_buffer, 0, nullptr);
+    const std::wstring _message = _result ? std::wstring(_buffer, _result) : L"(unknown)";
+
+    if (_buffer) {
+        LocalFree(_buffer);
+    }
+
+    return to_string(_message);
+}
+
+static void unload_vtmidi_library()
+{
+    if (virtual_module_users > 1) {
+        --virtual_module_users;
+        return;
+    }
+    virtual_module_users = 0;
+    virtual_create_ex2 = nullptr;
+    virtual_get_data = nullptr;
+    virtual_send_data = nullptr;
+    virtual_shutdown = nullptr;
+    virtual_close = nullptr;
+
+    if (virtual_module) {
+        FreeLibrary(virtual_module);
+        virtual_module = nullptr;
+    }
+}
+
+static void load_vtmidi_library()
+{
+#if defined(_WIN64)
+    const wchar_t* _candidate_paths[] = { L".\\teVirtualMIDI64.dll", L"teVirtualMIDI64.dll" };
+#else
+    const wchar_t* _candidate_paths[] = { L".\\teVirtualMIDI32.dll", L"teVirtualMIDI32.dll" };
+#endif
+
+    if (virtual_module) {
+        ++virtual_module_users;
+        return;
+    }
+
+    for (const wchar_t* _path : _candidate_paths) {
+        virtual_module = LoadLibraryW(_path);
+        if (virtual_module) {
+            break;
+        }
+    }
+
+    if (!virtual_module) {
+        DWORD _error = GetLastError();
+        throw std::runtime_error(std::string("LoadLibrary failed: ") + get_last_error_message(_error).c_str());
+    }
+
+    virtual_create_ex2 = reinterpret_cast<PFN_CreateEx2>(GetProcAddress(virtual_module, "virtualMIDICreatePortEx2"));
+    virtual_get_data = reinterpret_cast<PFN_GetData>(GetProcAddress(virtual_module, "virtualMIDIGetData"));
+    virtual_send_data = reinterpret_cast<PFN_SendData>(GetProcAddress(virtual_module, "virtualMIDISendData"));
+    virtual_shutdown = reinterpret_cast<PFN_Shutdown>(GetProcAddress(virtual_module, "virtualMIDIShutdown"));
+    virtual_close = reinterpret_cast<PFN_Close>(GetProcAddress(virtual_module, "virtualMIDIClosePort"));
+
+    virtual_module_users = 1;
+    if (!virtual_create_ex2 || !virtual_get_data || !virtual_send_data || !virtual_shutdown || !virtual_close) {
+        unload_vtmidi_library();
+        throw std::runtime_error("GetProcAddress failed (missing exports)");
+    }
+}
+
+class vtmidi_input_transport : public midi_input_transport {
+public:
+    explicit vtmidi_input_transport(const std::string& port)
+    {
+        load_vtmidi_library();
+
+        const DWORD _flags = 0;
+        const DWORD _max_sysex_size = 65535;
+        _port = virtual_create_ex2(to_wstring(port).c_str(), nullptr, nullptr, _max_sysex_size, _flags);
+        if (!_port) {
+            const DWORD _error = GetLastError();
+            unload_vtmidi_library();
+            throw std::runtime_error(std::string("CreatePortEx2 failed: ") + get_last_error_message(_error).c_str());
+        }
+    }
+
+    ~vtmidi_input_transport() override
+    {
+        stop();
+        virtual_close(_port);
+        unload_vtmidi_library();
+    }
+
+    void start(const midi_receive_callback& callback) override
+    {
+        if (_is_running.exchange(true)) {
+            return;
+        }
+        _thread = std::thread([this, callback] {
+            // virtualMIDIGetData blocks until a packet arrives and fails once the port is shut down
+            midi_receive_arena _arena;
+            while (_is_running.load()) {
+                DWORD _size = static_cast<DWORD>(_arena.capacity());
+                if (virtual_get_data(_port, _arena.data(), &_size)) {
+                    callback(_arena.data(), _size);
+                } else if (GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
+                    _arena.reserve(_size);
+                } else {
+                    break;
+                }
+            }
+        });
+    }
+
+    void stop() override
+    {
+        if (!_is_running.exchange(false)) {
+            return;
+        }
+        virtual_shutdown(_port);
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+private:
+    LPVM_MIDI_PORT _port = nullptr;
+    std::atomic<bool> _is_running = false;
+    std::thread _thread;
+};
+
+class vtmidi_output_transport : public midi_output_transport {
+public:
+    explicit vtmidi_output_transport(const std::string& port)
+    {
+        load_vtmidi_library();
+
+        // only the side other applications read from is created
+        const DWORD _flags = TE_VM_FLAGS_INSTANTIATE_TX_ONLY;
+        const DWORD _max_sysex_size = 65535;
+        _port = virtual_create_ex2(to_wstring(port).c_str(), nullptr, nullptr, _max_sysex_size, _flags);
+        if (!_port) {
+            const DWORD _error = GetLastError();
+            unload_vtmidi_library();
+            throw std::runtime_error(std::string("CreatePortEx2 failed: ") + get_last_error_message(_error).c_str());
+        }
+    }
+
+    ~vtmidi_output_transport() override
+    {
+        virtual_shutdown(_port);
+        virtual_close(_port);
+        unload_vtmidi_library();
+    }
+
+    void send(const unsigned char* data, const std::size_t length) override
+    {
+        virtual_send_data(_port, const_cast<PBYTE>(data), static_cast<DWORD>(length));
+    }
+
+private:
+    LPVM_MIDI_PORT _port = nullptr;
+};
+
+}
+
+std::unique_ptr<midi_input_transport> create_virtual_input(const std::string& port)
+{
+    return std::make_unique<vtmidi_input_transport>(port);
+}
+
+std::unique_ptr<midi_output_transport> create_virtual_output(const std::string& port)
+{
+    return std::make_unique<vtmidi_output_transport>(port);
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "window.hpp"
 #include "dialog.hpp"
+#include "imgui_id.hpp"
+#include "library_view.hpp"
 #include "router.hpp"
 #include "sysex.hpp"
 
@@ -8,21 +10,16 @@
 #include <imgui.h>
 #include <misc/cpp/imgui_stdlib.h>
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <thread>
 
-// clang-format off
-#define IMGUID_CONCAT(lhs, rhs) lhs # rhs
-#define IMGUID_CONCAT_WRAPPER(lhs, rhs) IMGUID_CONCAT(lhs, rhs)
-#define IMGUID_UNIQUE IMGUID_CONCAT_WRAPPER(__FILE__, __LINE__)
-#define IMGUID(NAME) NAME "###" IMGUID_UNIQUE
-#define IMGUIDU "###" IMGUID_UNIQUE
-// clang-format on
-
 namespace {
 
 static std::size_t setup_selected_hardware_port;
+static std::size_t setup_selected_hardware_input_port;
+static bool is_setup_return_enabled = false;
 static std::string setup_virtual_port_name;
 static std::string setup_library_directory;
 
@@ -30,11 +27,8 @@ static bool is_setup_finished = false;
 static bool is_setup_modal_shown = false;
 static const char* setup_modal_id = IMGUID("Setup");
 static std::vector<std::string> setup_detected_hardware_ports;
-static std::vector<std::filesystem::path> library_banks;
-static std::vector<sysex_patch> library_patches;
-static int library_selected_bank_index = -1;
-static int library_selected_patch_index = -1;
-static int library_patches_cached_bank = -1;
+static std::vector<std::string> setup_detected_hardware_input_ports;
+static midi_clock_settings clock_settings;
 
 void draw_setup_text(const float modal_width)
 {
@@ -48,26 +42,43 @@ void draw_setup_text(const float modal_width)
     ImGui::Spacing();
 }
 
-void draw_setup_hardware_port_control()
+void draw_setup_port_combo(const char* label, const std::vector<std::string>& ports, std::size_t& selected_port)
 {
-    if (setup_detected_hardware_ports.empty()) {
-        setup_detected_hardware_ports = get_hardware_ports();
-    }
-    ImGui::Text("Hardware port");
+    ImGui::Text("%s", label);
     const float _full_width = ImGui::GetContentRegionAvail().x;
     ImGui::SetNextItemWidth(_full_width);
-    const std::string _combo_preview = setup_detected_hardware_ports.empty() ? "No hardware port detected" : setup_detected_hardware_ports[setup_selected_hardware_port];
+    const std::string _combo_preview = ports.empty() ? "No hardware port detected" : ports[std::min(selected_port, ports.size() - 1)];
+    ImGui::PushID(label);
     if (ImGui::BeginCombo(IMGUIDU, _combo_preview.c_str())) {
-        std::size_t _index = 0;
-        for (const std::string& _hardware_port : setup_detected_hardware_ports) {
-            if (ImGui::Selectable(setup_detected_hardware_ports[_index].c_str())) {
-                setup_selected_hardware_port = _index;
+        for (std::size_t _index = 0; _index < ports.size(); ++_index) {
+            if (ImGui::Selectable(ports[_index].c_str())) {
+                selected_port = _index;
             }
-            _index++;
         }
         ImGui::EndCombo();
     }
+    ImGui::PopID();
+    ImGui::Spacing();
+}
+
+void draw_setup_hardware_port_control()
+{
+    if (setup_detected_hardware_ports.empty()) {
+        setup_detected_hardware_ports = get_hardware_ports();
+    }
+    if (setup_detected_hardware_input_ports.empty()) {
+        setup_detected_hardware_input_ports = get_hardware_input_ports();
+    }
+    draw_setup_port_combo("Hardware port", setup_detected_hardware_ports, setup_selected_hardware_port);
+    ImGui::Checkbox("Return hardware input to the virtual port", &is_setup_return_enabled);
     ImGui::Spacing();
+    if (!is_setup_return_enabled) {
+        ImGui::BeginDisabled();
+    }
+    draw_setup_port_combo("Hardware input port", setup_detected_hardware_input_ports, setup_selected_hardware_input_port);
+    if (!is_setup_return_enabled) {
+        ImGui::EndDisabled();
+    }
 }
 
 void draw_setup_virtual_port_control()
@@ -101,16 +112,20 @@ void draw_setup_start_control()
         ImGui::BeginDisabled();
     }
     if (ImGui::Button(IMGUID("Start"), ImVec2(-FLT_MIN, 0.f))) {
-        open_hardware_output(setup_selected_hardware_port);
-        open_virtual_input(setup_virtual_port_name, [](const std::vector<unsigned char>& data) {
-            send_to_hardware_output(data);
-        });
-        library_banks = load_sysex_banks_recursive(setup_library_directory);
+        open_hardware_output(0, setup_selected_hardware_port);
+        open_virtual_input(0, setup_virtual_port_name);
+        if (is_setup_return_enabled && setup_selected_hardware_input_port < setup_detected_hardware_input_ports.size()) {
+            open_virtual_output(0, setup_virtual_port_name + " Return");
+            open_hardware_input(0, setup_selected_hardware_input_port);
+        }
+        start_library_scan(setup_library_directory, std::filesystem::current_path() / "library.idx");
         is_setup_finished = true;
         const std::filesystem::path _settings_path = std::filesystem::current_path() / "settings.json";
         std::ofstream _stream(_settings_path);
         cereal::JSONOutputArchive _archive(_stream);
         _archive(cereal::make_nvp("hardware_port_index", setup_selected_hardware_port));
+        _archive(cereal::make_nvp("hardware_input_port_index", setup_selected_hardware_input_port));
+        _archive(cereal::make_nvp("return_enabled", is_setup_return_enabled));
         _archive(cereal::make_nvp("virtual_port_name", setup_virtual_port_name));
         _archive(cereal::make_nvp("library_directory", setup_library_directory));
         ImGui::CloseCurrentPopup();
@@ -128,6 +143,8 @@ void draw_setup_modal()
             std::ofstream _stream(_settings_path);
             cereal::JSONOutputArchive _archive(_stream);
             _archive(cereal::make_nvp("hardware_port_index", 0));
+            _archive(cereal::make_nvp("hardware_input_port_index", 0));
+            _archive(cereal::make_nvp("return_enabled", false));
             _archive(cereal::make_nvp("virtual_port_name", std::string("DX7 MIDI Bridge")));
             _archive(cereal::make_nvp("library_directory", std::string("Path to the directory...")));
         }
@@ -136,6 +153,16 @@ void draw_setup_modal()
         _archive(cereal::make_nvp("hardware_port_index", setup_selected_hardware_port));
         _archive(cereal::make_nvp("virtual_port_name", setup_virtual_port_name));
         _archive(cereal::make_nvp("library_directory", setup_library_directory));
+        try {
+            _archive(cereal::make_nvp("hardware_input_port_index", setup_selected_hardware_input_port));
+        } catch (const cereal::Exception&) {
+            setup_selected_hardware_input_port = 0; // settings written before the return direction existed
+        }
+        try {
+            _archive(cereal::make_nvp("return_enabled", is_setup_return_enabled));
+        } catch (const cereal::Exception&) {
+            is_setup_return_enabled = false; // settings written before the return direction could be turned off
+        }
 
         ImGui::OpenPopup(setup_modal_id);
         is_setup_modal_shown = true;
@@ -169,79 +196,96 @@ void draw_library_window()
     if (ImGui::Begin(IMGUID("Library"), 0, _window_flags)) {
         
         if (is_setup_finished) {
-            const ImGuiTableFlags _table_flags = ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg;
-            const float _table_height = ImGui::GetContentRegionAvail().y;
-            if (ImGui::BeginTable(IMGUIDU, 1, _table_flags, ImVec2(-FLT_MIN, _table_height))) {
-                ImGui::TableSetupColumn(IMGUIDU, ImGuiTableColumnFlags_WidthStretch);
-
-                for (int _bank_index = 0; _bank_index < static_cast<int>(library_banks.size()); ++_bank_index) {
-                    ImGui::TableNextRow();
-                    ImGui::TableSetColumnIndex(0);
-
-                    const bool _is_bank_selected = (library_selected_bank_index == _bank_index);
-                    ImGuiTreeNodeFlags _tree_node_flags = ImGuiTreeNodeFlags_FramePadding | ImGuiTreeNodeFlags_SpanFullWidth | ImGuiTreeNodeFlags_OpenOnArrow;
-                    if (_is_bank_selected && library_selected_patch_index == -1) {
-                        _tree_node_flags |= ImGuiTreeNodeFlags_Selected;
-                    }
-
-                    ImGui::SetNextItemOpen(_is_bank_selected, ImGuiCond_Always);
-                    const std::string _bank_name = std::filesystem::relative(library_banks[_bank_index], setup_library_directory).string();
-                    const bool _is_bank_open = ImGui::TreeNodeEx(reinterpret_cast<void*>(static_cast<intptr_t>(_bank_index + 1)), _tree_node_flags, "%s", _bank_name.c_str());
-
-                    if (ImGui::IsItemToggledOpen()) {
-                        if (_is_bank_open) {
-                            library_selected_bank_index = _bank_index;
-                            library_selected_patch_index = -1;
-                        } else if (_is_bank_selected) {
-                            library_selected_bank_index = -1;
-                            library_selected_patch_index = -1;
-                        }
-                    } else if (ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
-                        if (!_is_bank_selected) {
-                            library_selected_bank_index = _bank_index;
-                            library_selected_patch_index = -1;
-                        } else {
-                            library_selected_bank_index = -1;
-                            library_selected_patch_index = -1;
-                        }
-                    }
-
-                    if (library_selected_bank_index != library_patches_cached_bank) {
-                        if (library_selected_bank_index >= 0) {
-                            library_patches = load_sysex_patches(library_banks[library_selected_bank_index]);
-                        } else {
-                            library_patches.clear();
-                        }
-                        library_patches_cached_bank = library_selected_bank_index;
-                    }
+            draw_library_view();
+        }
+        ImGui::End();
+    }
+}
 
-                    if (_is_bank_open) {
-                        for (int _patch_index = 0; _patch_index < static_cast<int>(library_patches.size()); ++_patch_index) {
-                            const sysex_patch& _patch = library_patches[_patch_index];
+void draw_latency_table(const latency_report& report)
+{
+    const ImGuiTableFlags _table_flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchSame;
+    if (ImGui::BeginTable(IMGUIDU, 6, _table_flags)) {
+        ImGui::TableSetupColumn("Class");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("p50 (us)");
+        ImGui::TableSetupColumn("p99 (us)");
+        ImGui::TableSetupColumn("p99.9 (us)");
+        ImGui::TableSetupColumn("Max (us)");
+        ImGui::TableHeadersRow();
+        for (std::size_t _class = 0; _class < report.size(); ++_class) {
+            const latency_snapshot& _snapshot = report[_class];
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(get_latency_class_name(static_cast<latency_class>(_class)));
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%llu", static_cast<unsigned long long>(_snapshot.total));
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.1f", _snapshot.get_percentile(0.5) / 1000.0);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.1f", _snapshot.get_percentile(0.99) / 1000.0);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::Text("%.1f", _snapshot.get_percentile(0.999) / 1000.0);
+            ImGui::TableSetColumnIndex(5);
+            ImGui::Text("%.1f", _snapshot.max_nanoseconds / 1000.0);
+        }
+        ImGui::EndTable();
+    }
+}
 
-                            ImGui::TableNextRow();
-                            ImGui::TableSetColumnIndex(0);
-                            ImGuiTreeNodeFlags _leaf_flags = ImGuiTreeNodeFlags_FramePadding | ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen | ImGuiTreeNodeFlags_SpanFullWidth;
-                            if (library_selected_bank_index == _bank_index && library_selected_patch_index == _patch_index) {
-                                _leaf_flags |= ImGuiTreeNodeFlags_Selected;
-                            }
+void draw_clock_controls()
+{
+    static const char* _mode_names[] = { "Through", "Master", "Follow" };
+    int _mode = static_cast<int>(clock_settings.mode);
+    bool _is_changed = ImGui::Combo(IMGUID("Mode"), &_mode, _mode_names, IM_ARRAYSIZE(_mode_names));
+    clock_settings.mode = static_cast<midi_clock_mode>(_mode);
+    if (clock_settings.mode == midi_clock_mode::master) {
+        _is_changed |= ImGui::InputDouble(IMGUID("Tempo"), &clock_settings.tempo, 1.0, 10.0, "%.1f");
+        clock_settings.tempo = std::clamp(clock_settings.tempo, 20.0, 300.0);
+    }
+    if (_is_changed) {
+        set_midi_clock(clock_settings);
+    }
+    if (clock_settings.mode != midi_clock_mode::through) {
+        const latency_snapshot _jitter = get_midi_clock_jitter();
+        ImGui::Text("%.1f BPM, tick interval error p50 %.1f us, p99 %.1f us, max %.1f us",
+            get_midi_clock_tempo(),
+            _jitter.get_percentile(0.5) / 1000.0,
+            _jitter.get_percentile(0.99) / 1000.0,
+            _jitter.max_nanoseconds / 1000.0);
+    }
+}
 
-                            const intptr_t leafId = (static_cast<intptr_t>(_bank_index + 1) << 16) | static_cast<intptr_t>(_patch_index);
-                            ImGui::TreeNodeEx(reinterpret_cast<void*>(leafId), _leaf_flags, "%s", _patch.name.c_str());
-                            if (ImGui::IsItemClicked()) {
-                                library_selected_bank_index = _bank_index;
-                                library_selected_patch_index = _patch_index;
-                                send_to_hardware_output(library_patches[library_selected_patch_index].data);
-                            }
-                        }
-                        ImGui::TreePop();
-                    }
-                }
-                ImGui::EndTable();
-            }
+void draw_latency_window()
+{
+    if (!is_setup_finished) {
+        return;
+    }
+    if (ImGui::Begin(IMGUID("Latency"))) {
+        const latency_report _report = get_latency_report(0);
+        draw_latency_table(_report);
+        const output_counters& _counters = get_hardware_output_counters(0);
+        ImGui::Text("Sent %llu messages, %llu bytes, %llu coalesced, %llu dropped, %llu notes released",
+            static_cast<unsigned long long>(_counters.sent_messages.load()),
+            static_cast<unsigned long long>(_counters.sent_bytes.load()),
+            static_cast<unsigned long long>(_counters.coalesced_messages.load()),
+            static_cast<unsigned long long>(_counters.dropped_messages.load()),
+            static_cast<unsigned long long>(_counters.released_notes.load()));
+        const double _queue_delay = std::chrono::duration<double, std::milli>(estimated_hardware_queue_delay(0)).count();
+        ImGui::Text("Queue delay %.1f ms%s", _queue_delay, is_hardware_output_congested(0) ? " (congested)" : "");
+        if (is_virtual_output_open(0)) {
+            ImGui::SeparatorText("Return");
+            ImGui::PushID("Return");
+            draw_latency_table(get_virtual_output_latency_report(0));
+            ImGui::PopID();
+        }
+        ImGui::SeparatorText("Clock");
+        draw_clock_controls();
+        if (ImGui::Button(IMGUID("Save report"), ImVec2(-FLT_MIN, 0.f))) {
+            save_latency_report(_report, std::filesystem::current_path() / "latency.json");
         }
-        ImGui::End();
     }
+    ImGui::End();
 }
 
 void draw_edit_window()
@@ -261,6 +305,7 @@ void draw_main_window()
     ImGui::PushStyleVar(ImGuiStyleVar_CellPadding, ImVec2(0, 0));
     draw_setup_modal();
     draw_library_window();
+    draw_latency_window();
     // draw_edit_window();
     ImGui::PopStyleVar(3);
 }
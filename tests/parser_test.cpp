@@ -0,0 +1,70 @@
+#include "parser.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+[[nodiscard]] static std::vector<std::vector<unsigned char>> parse_in_packets(const std::vector<unsigned char>& stream, const std::vector<std::size_t>& packet_sizes)
+{
+    midi_stream_parser _parser(256);
+    std::vector<std::vector<unsigned char>> _messages;
+    std::size_t _offset = 0;
+    for (std::size_t _packet = 0; _offset < stream.size(); ++_packet) {
+        const std::size_t _size = std::min(packet_sizes[_packet % packet_sizes.size()], stream.size() - _offset);
+        _parser.parse(stream.data() + _offset, _size, [&_messages](const unsigned char* data, const std::size_t length) {
+            _messages.emplace_back(data, data + length);
+        });
+        _offset += _size;
+    }
+    return _messages;
+}
+
+static void splits_the_same_in_any_packets()
+{
+    // channel messages with and without running status, realtime bytes anywhere, system common, SysEx and stray bytes
+    std::mt19937 _random(3);
+    std::vector<unsigned char> _stream;
+    for (int _index = 0; _index < 20000; ++_index) {
+        const unsigned int _kind = _random() % 16;
+        if (_kind < 6) {
+            _stream.push_back(static_cast<unsigned char>(0x80 | (_random() % 7) << 4 | _random() % 16));
+        } else if (_kind < 12) {
+            _stream.push_back(static_cast<unsigned char>(_random() % 128));
+        } else if (_kind == 12) {
+            _stream.push_back(static_cast<unsigned char>(0xF8 + _random() % 8));
+        } else if (_kind == 13) {
+            _stream.push_back(static_cast<unsigned char>(0xF1 + _random() % 7));
+        } else if (_kind == 14) {
+            _stream.push_back(0xF0);
+            for (unsigned int _byte = _random() % 300; _byte > 0; --_byte) {
+                _stream.push_back(static_cast<unsigned char>(_random() % 128));
+            }
+            _stream.push_back(0xF7);
+        } else {
+            _stream.push_back(0xF0);
+        }
+    }
+    const std::vector<std::vector<unsigned char>> _expected = parse_in_packets(_stream, { 1 });
+    MIDIBRIDGE_CHECK(_expected.size() > 5000);
+    MIDIBRIDGE_CHECK(parse_in_packets(_stream, { _stream.size() }) == _expected);
+    MIDIBRIDGE_CHECK(parse_in_packets(_stream, { 2, 3, 5, 7, 64 }) == _expected);
+    MIDIBRIDGE_CHECK(parse_in_packets(_stream, { 3 }) == _expected);
+
+    // running status expanded on both sides of a packet boundary, a clock byte inside a note comes out first
+    const std::vector<unsigned char> _notes = { 0x90, 60, 100, 61, 100, 62, 0xF8, 100, 0xC0, 5, 6 };
+    const std::vector<std::vector<unsigned char>> _split = parse_in_packets(_notes, { 4 });
+    const std::vector<std::vector<unsigned char>> _messages = { { 0x90, 60, 100 }, { 0x90, 61, 100 }, { 0xF8 }, { 0x90, 62, 100 }, { 0xC0, 5 }, { 0xC0, 6 } };
+    MIDIBRIDGE_CHECK(_split == _messages);
+    MIDIBRIDGE_CHECK(parse_in_packets(_notes, { _notes.size() }) == _messages);
+}
+
+}
+
+int main()
+{
+    MIDIBRIDGE_RUN(splits_the_same_in_any_packets);
+    return 0;
+}
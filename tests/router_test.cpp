@@ -0,0 +1,285 @@
+#include "router.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/// @brief Output transport recording what it sends, sends wait while it is held
+struct recording_state {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<unsigned char> bytes;
+    bool is_held = false;
+    bool is_sending = false;
+    bool is_raw = false; // takes SysEx in chunks like a serial port
+};
+
+class recording_output_transport : public midi_output_transport {
+public:
+    explicit recording_output_transport(const std::shared_ptr<recording_state>& state)
+        : _state(state)
+    {
+    }
+
+    void send(const unsigned char* data, const std::size_t length) override
+    {
+        std::unique_lock<std::mutex> _lock(_state->mutex);
+        _state->is_sending = true;
+        _state->condition.notify_all();
+        _state->condition.wait(_lock, [this] { return !_state->is_held; });
+        _state->bytes.insert(_state->bytes.end(), data, data + length);
+    }
+
+    [[nodiscard]] bool is_raw_byte_stream() const override
+    {
+        return _state->is_raw;
+    }
+
+private:
+    std::shared_ptr<recording_state> _state;
+};
+
+[[nodiscard]] static std::size_t get_sent_size(recording_state& state)
+{
+    std::lock_guard<std::mutex> _lock_guard(state.mutex);
+    return state.bytes.size();
+}
+
+static void drops_queued_packets_when_closed()
+{
+    const std::shared_ptr<recording_state> _first = std::make_shared<recording_state>();
+    _first->is_held = true;
+    open_hardware_output(0, std::make_unique<recording_output_transport>(_first));
+    const unsigned char _note_on[] = { 0x90, 60, 100 };
+    MIDIBRIDGE_CHECK(send_to_hardware_output(0, _note_on, sizeof(_note_on)));
+    {
+        // the output thread is now stuck in the transport and everything sent next stays in the rings
+        std::unique_lock<std::mutex> _lock(_first->mutex);
+        _first->condition.wait(_lock, [&_first] { return _first->is_sending; });
+    }
+    const unsigned char _control[] = { 0xB0, 7, 100 };
+    for (int _index = 0; _index < 100; ++_index) {
+        MIDIBRIDGE_CHECK(send_to_hardware_output(0, _control, 2));
+    }
+    const midi_message_blob _blob = std::make_shared<const std::vector<unsigned char>>(std::vector<unsigned char> { 0xF0, 0x43, 0x00, 0xF7 });
+    MIDIBRIDGE_CHECK(send_to_hardware_output(0, _blob));
+    MIDIBRIDGE_CHECK(_blob.use_count() == 2);
+    std::thread _closer([] { close_hardware_output(0); });
+    while (is_hardware_output_open(0)) {
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> _lock_guard(_first->mutex);
+        _first->is_held = false;
+        _first->condition.notify_all();
+    }
+    _closer.join();
+    MIDIBRIDGE_CHECK(_blob.use_count() == 1);
+    MIDIBRIDGE_CHECK(estimated_hardware_queue_delay(0) == std::chrono::steady_clock::duration::zero());
+
+    // the half message left in the parser must not complete with the first bytes of the next port
+    const std::shared_ptr<recording_state> _second = std::make_shared<recording_state>();
+    open_hardware_output(0, std::make_unique<recording_output_transport>(_second));
+    MIDIBRIDGE_CHECK(send_to_hardware_output(0, _control + 2, 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    MIDIBRIDGE_CHECK(get_sent_size(*_second) == 0);
+    MIDIBRIDGE_CHECK(send_to_hardware_output(0, _note_on, sizeof(_note_on)));
+    const std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (get_sent_size(*_second) < sizeof(_note_on) && std::chrono::steady_clock::now() < _deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    MIDIBRIDGE_CHECK(get_sent_size(*_second) == sizeof(_note_on));
+    close_hardware_output(0);
+}
+
+static void drops_incoming_ticks_in_master_mode()
+{
+    const std::shared_ptr<recording_state> _state = std::make_shared<recording_state>();
+    open_hardware_output(0, std::make_unique<recording_output_transport>(_state));
+    midi_loopback _loopback = create_loopback();
+    set_midi_routes({ midi_route() });
+    open_virtual_input(0, std::move(_loopback.input));
+    // slow enough that the engine sends none of its own ticks during the test
+    midi_clock_settings _settings;
+    _settings.mode = midi_clock_mode::master;
+    _settings.tempo = 1.0;
+    set_midi_clock(_settings);
+    const unsigned char _ticks[] = { 0xF8, 0xF8, 0xF8, 0xF8 };
+    _loopback.output->send(_ticks, sizeof(_ticks));
+    const unsigned char _note_on[] = { 0x90, 60, 100 };
+    _loopback.output->send(_note_on, sizeof(_note_on));
+    const std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (get_sent_size(*_state) < sizeof(_note_on) && std::chrono::steady_clock::now() < _deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    {
+        std::lock_guard<std::mutex> _lock_guard(_state->mutex);
+        const std::vector<unsigned char> _expected { 0x90, 60, 100 };
+        MIDIBRIDGE_CHECK(_state->bytes == _expected);
+    }
+    set_midi_clock(midi_clock_settings());
+    close_virtual_input(0);
+    close_hardware_output(0);
+}
+
+static void ends_a_cut_sysex_on_the_port_switched_away_from()
+{
+    // at the DIN rate a 1000 byte dump takes 320 ms, the transport is switched once it started
+    const std::shared_ptr<recording_state> _old = std::make_shared<recording_state>();
+    const std::shared_ptr<recording_state> _new = std::make_shared<recording_state>();
+    _old->is_raw = true;
+    _new->is_raw = true;
+    set_hardware_output_pacing(0, output_pacing());
+    open_hardware_output(0, std::make_unique<recording_output_transport>(_old));
+    std::vector<unsigned char> _dump(1000, 0x10);
+    _dump.front() = 0xF0;
+    _dump.back() = 0xF7;
+    MIDIBRIDGE_CHECK(send_to_hardware_output(0, _dump.data(), _dump.size()));
+    const std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (get_sent_size(*_old) == 0 && std::chrono::steady_clock::now() < _deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    open_hardware_output(0, std::make_unique<recording_output_transport>(_new));
+    const unsigned char _note_on[] = { 0x90, 60, 100 };
+    MIDIBRIDGE_CHECK(send_to_hardware_output(0, _note_on, sizeof(_note_on)));
+    while (get_sent_size(*_new) < sizeof(_note_on) && std::chrono::steady_clock::now() < _deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    {
+        std::lock_guard<std::mutex> _old_guard(_old->mutex);
+        std::lock_guard<std::mutex> _new_guard(_new->mutex);
+        MIDIBRIDGE_CHECK(_old->bytes.size() < _dump.size() && _old->bytes.front() == 0xF0 && _old->bytes.back() == 0xF7);
+        MIDIBRIDGE_CHECK(_new->bytes == std::vector<unsigned char>(_note_on, _note_on + sizeof(_note_on)));
+    }
+    close_hardware_output(0);
+}
+
+static void stops_the_followed_clock_with_its_input()
+{
+    const std::shared_ptr<recording_state> _state = std::make_shared<recording_state>();
+    open_hardware_output(0, std::make_unique<recording_output_transport>(_state));
+    midi_loopback _loopback = create_loopback();
+    set_midi_routes({ midi_route() });
+    open_virtual_input(0, std::move(_loopback.input));
+    midi_clock_settings _settings;
+    _settings.mode = midi_clock_mode::follow;
+    set_midi_clock(_settings);
+    // 120 BPM, stopped right after the last tick, long before the loop would predict the next one
+    const unsigned char _start = 0xFA;
+    _loopback.output->send(&_start, 1);
+    const std::chrono::steady_clock::time_point _begin = std::chrono::steady_clock::now();
+    for (int _tick = 0; _tick < 20; ++_tick) {
+        std::this_thread::sleep_until(_begin + std::chrono::microseconds(20833) * _tick);
+        const unsigned char _clock = 0xF8;
+        _loopback.output->send(&_clock, 1);
+    }
+    const unsigned char _stop = 0xFC;
+    _loopback.output->send(&_stop, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    {
+        std::lock_guard<std::mutex> _lock_guard(_state->mutex);
+        const std::vector<unsigned char>& _bytes = _state->bytes;
+        MIDIBRIDGE_CHECK(!_bytes.empty() && _bytes.front() == 0xFA && _bytes.back() == 0xFC);
+        MIDIBRIDGE_CHECK(std::count(_bytes.begin(), _bytes.end(), 0xF8) == 20);
+        MIDIBRIDGE_CHECK(std::count(_bytes.begin(), _bytes.end(), 0xFC) == 1);
+    }
+    set_midi_clock(midi_clock_settings());
+    close_virtual_input(0);
+    close_hardware_output(0);
+}
+
+static void keeps_order_on_plain_and_transformed_outputs()
+{
+    const std::shared_ptr<recording_state> _plain = std::make_shared<recording_state>();
+    const std::shared_ptr<recording_state> _transformed = std::make_shared<recording_state>();
+    output_pacing _pacing;
+    _pacing.bytes_per_millisecond = 1e6;
+    set_hardware_output_pacing(0, _pacing);
+    set_hardware_output_pacing(1, _pacing);
+    open_hardware_output(0, std::make_unique<recording_output_transport>(_plain));
+    open_hardware_output(1, std::make_unique<recording_output_transport>(_transformed));
+    midi_route _route;
+    _route.output = 1;
+    for (midi_channel_transform& _transform : _route.transforms) {
+        _transform.transpose = 1;
+    }
+    set_midi_routes({ midi_route(), _route });
+    midi_loopback _loopback = create_loopback();
+    open_virtual_input(0, std::move(_loopback.input));
+    std::vector<unsigned char> _packet;
+    std::vector<unsigned char> _expected;
+    for (unsigned char _note = 0; _note < 100; ++_note) {
+        _packet.insert(_packet.end(), { 0x90, _note, 100 });
+        _expected.insert(_expected.end(), { 0x90, static_cast<unsigned char>(_note + 1), 100 });
+    }
+    _loopback.output->send(_packet.data(), _packet.size());
+    const std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while ((get_sent_size(*_plain) < _packet.size() || get_sent_size(*_transformed) < _expected.size()) && std::chrono::steady_clock::now() < _deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    close_virtual_input(0);
+    {
+        std::lock_guard<std::mutex> _lock_guard(_plain->mutex);
+        MIDIBRIDGE_CHECK(_plain->bytes == _packet);
+    }
+    {
+        std::lock_guard<std::mutex> _lock_guard(_transformed->mutex);
+        MIDIBRIDGE_CHECK(_transformed->bytes == _expected);
+    }
+    close_hardware_output(0);
+    close_hardware_output(1);
+    set_midi_routes({ midi_route() });
+}
+
+static void passes_sysex_through_transformed_outputs()
+{
+    const std::shared_ptr<recording_state> _transformed = std::make_shared<recording_state>();
+    output_pacing _pacing;
+    _pacing.bytes_per_millisecond = 1e6;
+    set_hardware_output_pacing(0, _pacing);
+    open_hardware_output(0, std::make_unique<recording_output_transport>(_transformed));
+    midi_route _route;
+    for (midi_channel_transform& _transform : _route.transforms) {
+        _transform.transpose = 1;
+    }
+    set_midi_routes({ _route });
+    midi_loopback _loopback = create_loopback();
+    open_virtual_input(0, std::move(_loopback.input));
+    // the shortest SysEx fits the 3 bytes of a transformed message but is not one
+    const std::vector<unsigned char> _packet = { 0xF0, 0xF7, 0x90, 60, 100, 0xF0, 0x43, 0xF7, 0xF0, 0x43, 0x10, 0xF7 };
+    const std::vector<unsigned char> _expected = { 0xF0, 0xF7, 0x90, 61, 100, 0xF0, 0x43, 0xF7, 0xF0, 0x43, 0x10, 0xF7 };
+    _loopback.output->send(_packet.data(), _packet.size());
+    const std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (get_sent_size(*_transformed) < _expected.size() && std::chrono::steady_clock::now() < _deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    close_virtual_input(0);
+    {
+        std::lock_guard<std::mutex> _lock_guard(_transformed->mutex);
+        MIDIBRIDGE_CHECK(_transformed->bytes == _expected);
+    }
+    close_hardware_output(0);
+    set_midi_routes({ midi_route() });
+}
+
+}
+
+int main()
+{
+    MIDIBRIDGE_RUN(drops_queued_packets_when_closed);
+    MIDIBRIDGE_RUN(drops_incoming_ticks_in_master_mode);
+    MIDIBRIDGE_RUN(ends_a_cut_sysex_on_the_port_switched_away_from);
+    MIDIBRIDGE_RUN(stops_the_followed_clock_with_its_input);
+    MIDIBRIDGE_RUN(keeps_order_on_plain_and_transformed_outputs);
+    MIDIBRIDGE_RUN(passes_sysex_through_transformed_outputs);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include "routing.hpp"
+#include "test.hpp"
+
+#include <array>
+#include <limits>
+
+namespace {
+
+static void keeps_velocities_in_range_for_any_exponent()
+{
+    for (const double _exponent : { 0.0, -1.0, -0.0, std::numeric_limits<double>::quiet_NaN(), 1e-300, 0.5, 4.0 }) {
+        std::array<midi_channel_transform, 16> _transforms = {};
+        _transforms[0].velocity_exponent = _exponent;
+        _transforms[0].velocity_min = 20;
+        _transforms[0].velocity_max = 100;
+        const midi_transform _transform(_transforms);
+        unsigned char _previous = 0;
+        for (int _velocity = 1; _velocity < 128; ++_velocity) {
+            const unsigned char _message[3] = { 0x90, 60, static_cast<unsigned char>(_velocity) };
+            unsigned char _output[3] = {};
+            MIDIBRIDGE_CHECK(_transform.apply(_message, sizeof(_message), _output) == sizeof(_message));
+            MIDIBRIDGE_CHECK(_output[2] >= 20 && _output[2] <= 100);
+            MIDIBRIDGE_CHECK(_output[2] >= _previous);
+            _previous = _output[2];
+        }
+        const unsigned char _note_off[3] = { 0x90, 60, 0 };
+        unsigned char _output[3] = {};
+        MIDIBRIDGE_CHECK(_transform.apply(_note_off, sizeof(_note_off), _output) == sizeof(_note_off) && _output[2] == 0);
+    }
+}
+
+}
+
+int main()
+{
+    MIDIBRIDGE_RUN(keeps_velocities_in_range_for_any_exponent);
+    return 0;
+}
@@ -0,0 +1,325 @@
+#include "scheduler.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace {
+
+using clock = output_scheduler::clock;
+
+/// @brief Output transport keeping every send, like a message based backend unless told otherwise
+class recording_output_transport : public midi_output_transport {
+public:
+    recording_output_transport(const bool is_raw, const bool accepts_running_status)
+        : _is_raw(is_raw)
+        , _accepts_running_status(accepts_running_status)
+    {
+    }
+
+    void send(const unsigned char* data, const std::size_t length) override
+    {
+        sends.emplace_back(data, data + length);
+        bytes += length;
+    }
+
+    [[nodiscard]] bool is_raw_byte_stream() const override
+    {
+        return _is_raw;
+    }
+
+    [[nodiscard]] bool accepts_running_status() const override
+    {
+        return _accepts_running_status;
+    }
+
+    std::vector<std::vector<unsigned char>> sends;
+    std::size_t bytes = 0;
+
+private:
+    bool _is_raw;
+    bool _accepts_running_status;
+};
+
+[[nodiscard]] static output_pacing get_unlimited_pacing()
+{
+    output_pacing _pacing;
+    _pacing.bytes_per_millisecond = 1e12;
+    _pacing.burst_bytes = std::size_t(1) << 30;
+    _pacing.sysex_gap = std::chrono::microseconds(0);
+    _pacing.coalesce_latency = std::chrono::hours(1);
+    return _pacing;
+}
+
+static void uses_running_status_where_the_transport_accepts_it()
+{
+    // a driver keeping the running status, such as WinMM, still gets every SysEx whole
+    const clock::time_point _now = clock::time_point(std::chrono::seconds(1));
+    for (const bool _accepts : { false, true }) {
+        output_scheduler _scheduler(get_unlimited_pacing());
+        recording_output_transport _transport(false, _accepts);
+        for (unsigned char _note = 60; _note < 64; ++_note) {
+            const unsigned char _note_on[] = { 0x90, _note, 100 };
+            _scheduler.push(_note_on, sizeof(_note_on), _now);
+        }
+        _scheduler.push(std::make_shared<const std::vector<unsigned char>>(std::vector<unsigned char> { 0xF0, 0x43, 0x01, 0xF7 }), _now);
+        const unsigned char _note_off[] = { 0x90, 60, 0 };
+        _scheduler.push(_note_off, sizeof(_note_off), _now);
+        _scheduler.flush(_now, _transport);
+        MIDIBRIDGE_CHECK(_transport.sends.size() == 6);
+        MIDIBRIDGE_CHECK(_transport.sends[0].size() == 3);
+        for (std::size_t _send = 1; _send < 4; ++_send) {
+            MIDIBRIDGE_CHECK(_transport.sends[_send].size() == (_accepts ? 2u : 3u));
+        }
+        // notes go before the bulk lane, the SysEx is last and whole
+        MIDIBRIDGE_CHECK(_transport.sends[4].size() == (_accepts ? 2u : 3u));
+        MIDIBRIDGE_CHECK(_transport.sends[5].size() == 4);
+    }
+}
+
+static void ends_a_cut_sysex_on_the_transport_it_was_sent_to()
+{
+    // default DIN pacing, the burst lets the first 32 bytes of a 163 byte dump out
+    const clock::time_point _now = clock::time_point(std::chrono::seconds(1));
+    output_scheduler _scheduler;
+    recording_output_transport _old(true, true);
+    std::vector<unsigned char> _dump(163, 0x10);
+    _dump.front() = 0xF0;
+    _dump.back() = 0xF7;
+    _scheduler.push(std::make_shared<const std::vector<unsigned char>>(_dump), _now);
+    _scheduler.flush(_now, _old);
+    MIDIBRIDGE_CHECK(_old.bytes > 0 && _old.bytes < _dump.size());
+    MIDIBRIDGE_CHECK(_scheduler.terminate_sysex(_old));
+    MIDIBRIDGE_CHECK(_old.sends.back() == std::vector<unsigned char> { 0xF7 });
+    MIDIBRIDGE_CHECK(!_scheduler.terminate_sysex(_old));
+
+    // the rest of the message is dropped, the next transport starts on a clean message
+    recording_output_transport _new(true, true);
+    const unsigned char _note_on[] = { 0x90, 60, 100 };
+    _scheduler.push(_note_on, sizeof(_note_on), _now);
+    _scheduler.flush(_now + std::chrono::seconds(1), _new);
+    MIDIBRIDGE_CHECK(_new.sends.size() == 1 && _new.sends[0] == std::vector<unsigned char>(_note_on, _note_on + sizeof(_note_on)));
+    MIDIBRIDGE_CHECK(_scheduler.empty() && _scheduler.get_counters().queued_bytes.load() == 0);
+}
+
+static void keeps_the_byte_rate_within_budget_during_an_upload()
+{
+    // 8 voice dumps queued at once while a note or note off arrives every 5 ms, on a clock stepped by 100 us
+    std::vector<unsigned char> _dump(163, 0);
+    _dump.front() = 0xF0;
+    _dump.back() = 0xF7;
+    const midi_message_blob _blob = std::make_shared<const std::vector<unsigned char>>(_dump);
+    for (const bool _is_raw : { true, false }) {
+        output_pacing _pacing;
+        _pacing.use_running_status = false;
+        output_scheduler _scheduler(_pacing);
+        recording_output_transport _transport(_is_raw, false);
+        const clock::time_point _start = clock::time_point(std::chrono::seconds(1));
+        for (int _index = 0; _index < 8; ++_index) {
+            _scheduler.push(_blob, _start);
+        }
+
+        // the wire is modeled as a bucket filled at the byte rate up to the burst, a send may overdraw it by its own size
+        const double _overdraft = _is_raw ? 3.0 : static_cast<double>(_dump.size());
+        double _credit = static_cast<double>(_pacing.burst_bytes);
+        std::deque<clock::time_point> _note_times;
+        clock::duration _max_note_delay = clock::duration::zero();
+        std::size_t _notes_during_upload = 0;
+        std::size_t _sysex_bytes = 0;
+        bool _is_inside_sysex = false;
+        clock::time_point _sysex_end = {};
+        std::size_t _sent = 0;
+        const clock::duration _step = std::chrono::microseconds(100);
+        for (clock::time_point _now = _start; _now < _start + std::chrono::seconds(2); _now += _step) {
+            const clock::duration _elapsed = _now - _start;
+            if (_elapsed < std::chrono::milliseconds(800) && _elapsed % std::chrono::milliseconds(5) == clock::duration::zero()) {
+                const unsigned char _note[] = { 0x90, 60, static_cast<unsigned char>(_note_times.size() % 2 ? 0 : 100) };
+                _scheduler.push(_note, sizeof(_note), _now);
+                _note_times.push_back(_now);
+            }
+            _scheduler.flush(_now, _transport);
+            _credit = std::min(_credit + _pacing.bytes_per_millisecond * 0.1, static_cast<double>(_pacing.burst_bytes));
+            for (; _sent < _transport.sends.size(); ++_sent) {
+                const std::vector<unsigned char>& _bytes = _transport.sends[_sent];
+                _credit -= static_cast<double>(_bytes.size());
+                MIDIBRIDGE_CHECK(_credit >= -_overdraft);
+                if (!_is_inside_sysex && _bytes.front() == 0x90) {
+                    MIDIBRIDGE_CHECK(!_note_times.empty());
+                    _max_note_delay = std::max(_max_note_delay, _now - _note_times.front());
+                    _note_times.pop_front();
+                    _notes_during_upload += _sysex_bytes < 8 * _dump.size() ? 1 : 0;
+                    continue;
+                }
+                if (!_is_inside_sysex) {
+                    // the receiver gets the sysex gap to store the previous dump
+                    MIDIBRIDGE_CHECK(_bytes.front() == 0xF0);
+                    MIDIBRIDGE_CHECK(_sysex_bytes == 0 || _now - _sysex_end >= _pacing.sysex_gap);
+                }
+                _sysex_bytes += _bytes.size();
+                _is_inside_sysex = _bytes.back() != 0xF7;
+                _sysex_end = _now;
+            }
+        }
+        MIDIBRIDGE_CHECK(_note_times.empty());
+        MIDIBRIDGE_CHECK(_sysex_bytes == 8 * _dump.size());
+        // notes go out between the dumps and wait at most for the one on the wire, 52 ms at 31250 baud
+        MIDIBRIDGE_CHECK(_notes_during_upload > 50);
+        MIDIBRIDGE_CHECK(_max_note_delay < std::chrono::milliseconds(60));
+    }
+}
+
+static void keeps_the_queue_delay_of_a_pitch_bend_stream_bounded()
+{
+    // 2 kHz of pitch bend is twice what the wire carries, every value is numbered so a send tells which pushes it covers
+    output_pacing _pacing;
+    _pacing.use_running_status = false;
+    output_scheduler _scheduler(_pacing);
+    recording_output_transport _transport(true, false);
+    const clock::time_point _start = clock::time_point(std::chrono::seconds(1));
+    std::vector<clock::time_point> _push_times;
+    std::size_t _covered = 0;
+    std::size_t _sent = 0;
+    clock::duration _max_delay = clock::duration::zero();
+    const clock::duration _step = std::chrono::microseconds(100);
+    for (clock::time_point _now = _start; _now < _start + std::chrono::seconds(3); _now += _step) {
+        const clock::duration _elapsed = _now - _start;
+        if (_elapsed < std::chrono::seconds(2) && _elapsed % std::chrono::microseconds(500) == clock::duration::zero()) {
+            const std::size_t _value = _push_times.size();
+            const unsigned char _bend[] = { 0xE0, static_cast<unsigned char>(_value & 0x7F), static_cast<unsigned char>(_value >> 7 & 0x7F) };
+            _scheduler.push(_bend, sizeof(_bend), _now);
+            _push_times.push_back(_now);
+        }
+        _scheduler.flush(_now, _transport);
+        for (; _sent < _transport.sends.size(); ++_sent) {
+            const std::vector<unsigned char>& _bytes = _transport.sends[_sent];
+            MIDIBRIDGE_CHECK(_bytes.size() == 3 && _bytes[0] == 0xE0);
+            const std::size_t _value = static_cast<std::size_t>(_bytes[1]) | static_cast<std::size_t>(_bytes[2]) << 7;
+            MIDIBRIDGE_CHECK(_value >= _covered);
+            for (; _covered <= _value; ++_covered) {
+                _max_delay = std::max(_max_delay, _now - _push_times[_covered]);
+            }
+        }
+    }
+    // the coalesce latency plus the message already on the wire
+    MIDIBRIDGE_CHECK(_max_delay < _pacing.coalesce_latency + std::chrono::milliseconds(2));
+    MIDIBRIDGE_CHECK(_covered == _push_times.size());
+    MIDIBRIDGE_CHECK(_scheduler.get_counters().coalesced_messages.load() > 1000);
+}
+
+static void never_coalesces_past_a_note()
+{
+    // once through the coalesce latency and once through the overflow policy
+    const clock::time_point _now = clock::time_point(std::chrono::seconds(1));
+    for (const bool _is_overflowing : { false, true }) {
+        output_pacing _pacing;
+        _pacing.use_running_status = false;
+        _pacing.coalesce_latency = _is_overflowing ? std::chrono::hours(1) : std::chrono::microseconds(0);
+        _pacing.high_water_delay = _is_overflowing ? std::chrono::milliseconds(0) : std::chrono::hours(1);
+        output_scheduler _scheduler(_pacing);
+        recording_output_transport _transport(false, false);
+        const std::vector<std::vector<unsigned char>> _pushed = {
+            { 0xB0, 123, 0 }, // all notes off
+            { 0x90, 60, 100 },
+            { 0xB0, 64, 127 }, // sustain
+            { 0x90, 61, 100 },
+            { 0xB0, 123, 0 },
+            { 0xB0, 7, 10 },
+            { 0x90, 62, 100 },
+            { 0xB0, 64, 0 },
+            { 0xB0, 7, 20 },
+            { 0xB0, 7, 30 },
+        };
+        for (const std::vector<unsigned char>& _message : _pushed) {
+            _scheduler.push(_message.data(), _message.size(), _now);
+        }
+        for (clock::time_point _time = _now; !_scheduler.empty(); _time += std::chrono::milliseconds(1)) {
+            _scheduler.flush(_time, _transport);
+        }
+        // only the volume queued after the last note takes the later value
+        std::vector<std::vector<unsigned char>> _expected(_pushed.begin(), _pushed.end() - 2);
+        _expected.push_back(_pushed.back());
+        MIDIBRIDGE_CHECK(_transport.sends == _expected);
+        MIDIBRIDGE_CHECK(_scheduler.get_counters().coalesced_messages.load() == 1);
+    }
+}
+
+static void plays_notes_during_a_32_voice_upload()
+{
+    // the library sends a voice dump for each of 32 voices while a note comes every 50 ms and the clock runs at 120 BPM
+    std::vector<unsigned char> _dump(163, 0);
+    _dump.front() = 0xF0;
+    _dump.back() = 0xF7;
+    for (const bool _is_raw : { true, false }) {
+        output_pacing _pacing;
+        _pacing.use_running_status = false;
+        output_scheduler _scheduler(_pacing);
+        recording_output_transport _transport(_is_raw, false);
+        const clock::time_point _start = clock::time_point(std::chrono::seconds(1));
+        std::vector<unsigned char> _upload;
+        for (unsigned char _voice = 0; _voice < 32; ++_voice) {
+            _dump[1] = _voice;
+            _scheduler.push(std::make_shared<const std::vector<unsigned char>>(_dump), _start);
+            _upload.insert(_upload.end(), _dump.begin(), _dump.end());
+        }
+        std::deque<clock::time_point> _note_times;
+        std::deque<clock::time_point> _tick_times;
+        clock::duration _max_note_delay = clock::duration::zero();
+        clock::duration _max_tick_delay = clock::duration::zero();
+        std::vector<unsigned char> _received;
+        clock::time_point _upload_end = {};
+        std::size_t _sent = 0;
+        const clock::duration _step = std::chrono::microseconds(100);
+        for (clock::time_point _now = _start; _now < _start + std::chrono::seconds(4); _now += _step) {
+            const clock::duration _elapsed = _now - _start;
+            if (_elapsed < std::chrono::seconds(3) && _elapsed % std::chrono::milliseconds(50) == clock::duration::zero()) {
+                const unsigned char _note[] = { 0x90, 60, static_cast<unsigned char>(_note_times.size() % 2 ? 0 : 100) };
+                _scheduler.push(_note, sizeof(_note), _now);
+                _note_times.push_back(_now);
+            }
+            if (_elapsed < std::chrono::seconds(3) && _elapsed % std::chrono::microseconds(20800) == clock::duration::zero()) {
+                const unsigned char _tick = 0xF8;
+                _scheduler.push(&_tick, 1, _now);
+                _tick_times.push_back(_now);
+            }
+            _scheduler.flush(_now, _transport);
+            for (; _sent < _transport.sends.size(); ++_sent) {
+                const std::vector<unsigned char>& _bytes = _transport.sends[_sent];
+                if (_bytes.size() == 1 && _bytes[0] == 0xF8) {
+                    _max_tick_delay = std::max(_max_tick_delay, _now - _tick_times.front());
+                    _tick_times.pop_front();
+                } else if (_bytes.size() == 3 && _bytes[0] == 0x90) {
+                    _max_note_delay = std::max(_max_note_delay, _now - _note_times.front());
+                    _note_times.pop_front();
+                } else {
+                    _received.insert(_received.end(), _bytes.begin(), _bytes.end());
+                    _upload_end = _now;
+                }
+            }
+        }
+        MIDIBRIDGE_CHECK(_note_times.empty() && _tick_times.empty());
+        MIDIBRIDGE_CHECK(_received == _upload);
+        // the upload takes about 2 s on the wire, a note waits at most for the dump in flight
+        MIDIBRIDGE_CHECK(_upload_end - _start > std::chrono::milliseconds(1900));
+        MIDIBRIDGE_CHECK(_max_note_delay < std::chrono::milliseconds(60));
+        if (_is_raw) {
+            // clock ticks go inside the dump, only behind the chunk already sent
+            MIDIBRIDGE_CHECK(_max_tick_delay < std::chrono::milliseconds(2));
+        }
+    }
+}
+
+}
+
+int main()
+{
+    MIDIBRIDGE_RUN(uses_running_status_where_the_transport_accepts_it);
+    MIDIBRIDGE_RUN(ends_a_cut_sysex_on_the_transport_it_was_sent_to);
+    MIDIBRIDGE_RUN(keeps_the_byte_rate_within_budget_during_an_upload);
+    MIDIBRIDGE_RUN(keeps_the_queue_delay_of_a_pitch_bend_stream_bounded);
+    MIDIBRIDGE_RUN(never_coalesces_past_a_note);
+    MIDIBRIDGE_RUN(plays_notes_during_a_32_voice_upload);
+    return 0;
+}
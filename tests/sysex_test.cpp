@@ -0,0 +1,123 @@
+#include "sysex.hpp"
+#include "test.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+namespace {
+
+[[nodiscard]] static std::vector<unsigned char> make_bank_dump(const unsigned int seed)
+{
+    // F0 43 00 09 20 00 [32 packed voices] checksum F7, every packed field kept within its bits
+    std::mt19937 _random(seed);
+    std::vector<unsigned char> _dump = { 0xF0, 0x43, 0x00, 0x09, 0x20, 0x00 };
+    for (int _voice = 0; _voice < 32; ++_voice) {
+        unsigned char _packed[128];
+        for (unsigned char& _byte : _packed) {
+            _byte = static_cast<unsigned char>(_random() % 100);
+        }
+        for (int _operator = 0; _operator < 6; ++_operator) {
+            _packed[_operator * 17 + 11] &= 0x0F;
+            _packed[_operator * 17 + 12] &= 0x7F;
+            _packed[_operator * 17 + 13] &= 0x1F;
+            _packed[_operator * 17 + 15] &= 0x3F;
+        }
+        _packed[110] &= 0x1F;
+        _packed[111] &= 0x0F;
+        _packed[116] &= 0x7F;
+        for (int _index = 118; _index < 128; ++_index) {
+            _packed[_index] = static_cast<unsigned char>('A' + _random() % 26);
+        }
+        _dump.insert(_dump.end(), _packed, _packed + 128);
+    }
+    unsigned int _sum = 0;
+    for (std::size_t _index = 6; _index < _dump.size(); ++_index) {
+        _sum += _dump[_index];
+    }
+    _dump.push_back(static_cast<unsigned char>((128 - (_sum & 0x7F)) & 0x7F));
+    _dump.push_back(0xF7);
+    return _dump;
+}
+
+static void write_file(const std::filesystem::path& path, const std::vector<unsigned char>& bytes)
+{
+    std::ofstream _stream(path, std::ios::binary | std::ios::trunc);
+    _stream.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+static void survives_a_bank_file_changed_on_disk()
+{
+    const std::filesystem::path _path = std::filesystem::temp_directory_path() / "midibridge_sysex_test.syx";
+    std::vector<unsigned char> _dump = make_bank_dump(1);
+    const std::vector<unsigned char> _message = { 0xF0, 0x7D, 0x01, 0x02, 0xF7 };
+    _dump.insert(_dump.end(), _message.begin(), _message.end());
+    write_file(_path, _dump);
+    const sysex_bank _bank = load_sysex_bank(_path);
+    MIDIBRIDGE_CHECK(_bank.size() == 33);
+    const midi_message_blob _voice = _bank.make_data(5);
+    MIDIBRIDGE_CHECK(_voice && _voice->size() == 163);
+    MIDIBRIDGE_CHECK(_bank.make_data(32) && *_bank.make_data(32) == _message);
+
+    // a status byte written in the middle of the other message, then in the packed bytes of the voice
+    std::vector<unsigned char> _rewritten = _dump;
+    _rewritten[_rewritten.size() - 2] = 0x90;
+    write_file(_path, _rewritten);
+    MIDIBRIDGE_CHECK(!_bank.make_data(32));
+    MIDIBRIDGE_CHECK(_bank.make_data(5) && *_bank.make_data(5) == *_voice);
+    _rewritten[6 + 5 * dx7_voice_bank::packed_size] = 0x90;
+    write_file(_path, _rewritten);
+    MIDIBRIDGE_CHECK(!_bank.make_data(5));
+    MIDIBRIDGE_CHECK(_bank.make_data(4));
+
+    // the mapping now reaches past the end of the file, reading it there faults and the patches are refused
+    std::filesystem::resize_file(_path, 100);
+    MIDIBRIDGE_CHECK(!_bank.make_data(32));
+    MIDIBRIDGE_CHECK(!_bank.make_data(5));
+    MIDIBRIDGE_CHECK(load_sysex_bank(_path).size() == 0);
+
+    // a voice is only sent from a complete dump where it was found
+    write_file(_path, _dump);
+    sysex_bank _changed(std::make_shared<const mapped_file>(_path));
+    _changed.add_patch({ "voice", { 0, static_cast<std::uint32_t>(_dump.size() - _message.size()), 5 } });
+    MIDIBRIDGE_CHECK(_changed.make_data(0) && *_changed.make_data(0) == *_voice);
+    write_file(_path, std::vector<unsigned char>(_dump.begin() + 1, _dump.end()));
+    sysex_bank _broken(std::make_shared<const mapped_file>(_path));
+    _broken.add_patch({ "voice", { 0, static_cast<std::uint32_t>(_dump.size() - _message.size()), 5 } });
+    MIDIBRIDGE_CHECK(!_broken.make_data(0));
+    std::filesystem::remove(_path);
+}
+
+static void round_trips_packed_voices()
+{
+    const std::vector<unsigned char> _dump = make_bank_dump(2);
+    dx7_voice_bank _bank;
+    MIDIBRIDGE_CHECK(_bank.add_message(_dump.data(), _dump.size()));
+    MIDIBRIDGE_CHECK(_bank.size() == 32);
+    for (std::size_t _voice = 0; _voice < 32; ++_voice) {
+        const unsigned char* _packed = _dump.data() + 6 + _voice * dx7_voice_bank::packed_size;
+        MIDIBRIDGE_CHECK(std::equal(_packed, _packed + dx7_voice_bank::packed_size, _bank.get_packed(_voice)));
+
+        // unpacked to the 155 parameters of a single voice message, the same as built from the dump, then packed again
+        const midi_message_blob _message = _bank.make_data(_voice);
+        sysex_patch_location _location;
+        _location.length = static_cast<std::uint32_t>(_dump.size());
+        _location.voice = static_cast<std::uint8_t>(_voice);
+        MIDIBRIDGE_CHECK(*make_sysex_patch_data(_location, _dump.data()) == *_message);
+        dx7_voice_bank _single;
+        MIDIBRIDGE_CHECK(_single.add_message(_message->data(), _message->size()));
+        MIDIBRIDGE_CHECK(std::equal(_packed, _packed + dx7_voice_bank::packed_size, _single.get_packed(0)));
+        MIDIBRIDGE_CHECK(_single.get_name(0) == _bank.get_name(_voice));
+    }
+}
+
+}
+
+int main()
+{
+    MIDIBRIDGE_RUN(survives_a_bank_file_changed_on_disk);
+    MIDIBRIDGE_RUN(round_trips_packed_voices);
+    return 0;
+}
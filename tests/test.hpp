@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+/// @brief Stops the test with the failed condition and its location
+#define MIDIBRIDGE_CHECK(CONDITION)                                                                 \
+    do {                                                                                            \
+        if (!(CONDITION)) {                                                                         \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #CONDITION);     \
+            std::exit(1);                                                                           \
+        }                                                                                           \
+    } while (false)
+
+/// @brief Runs one case of a test executable and prints its name
+#define MIDIBRIDGE_RUN(CASE)                \
+    do {                                    \
+        std::printf("%s\n", #CASE);         \
+        CASE();                             \
+    } while (false)
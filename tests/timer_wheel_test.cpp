@@ -0,0 +1,106 @@
+#include "test.hpp"
+#include "timer_wheel.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace {
+
+using clock = timer_wheel<int>::clock;
+
+[[nodiscard]] static clock::time_point at(const std::int64_t nanoseconds)
+{
+    return clock::time_point(std::chrono::duration_cast<clock::duration>(std::chrono::nanoseconds(nanoseconds)));
+}
+
+struct released_timer {
+    clock::time_point due;
+    clock::time_point now;
+    int value = 0;
+};
+
+static void releases_across_the_last_level_boundary()
+{
+    // 2^32 ticks of 65.536 us, where the last level used to park values for another 78 hours
+    const std::int64_t _boundary = std::int64_t(1) << 48;
+    timer_wheel<int> _wheel;
+    std::vector<released_timer> _released;
+    const auto _sink = [&](const clock::time_point due, int&& value) { _released.push_back({ due, clock::time_point(), value }); };
+    _wheel.advance(at(_boundary - 1000000), _sink);
+    // one value due before the boundary keeps the wheel there, an empty wheel would jump to the next value
+    _wheel.insert(at(_boundary - 500000), 0);
+    _wheel.insert(at(_boundary + 200000), 1);
+    _wheel.insert(at(_boundary + 60000000), 2);
+    for (std::int64_t _now = _boundary - 1000000; _now <= _boundary + 100000000; _now += 50000) {
+        const std::size_t _count = _released.size();
+        _wheel.advance(at(_now), _sink);
+        for (std::size_t _index = _count; _index < _released.size(); ++_index) {
+            MIDIBRIDGE_CHECK(_released[_index].due <= at(_now));
+            MIDIBRIDGE_CHECK(_released[_index].due > at(_now - 50000));
+        }
+    }
+    MIDIBRIDGE_CHECK(_released.size() == 3);
+    MIDIBRIDGE_CHECK(_released[0].value == 0 && _released[1].value == 1 && _released[2].value == 2);
+    MIDIBRIDGE_CHECK(_wheel.size() == 0);
+}
+
+static void releases_beyond_the_reach_of_the_last_level()
+{
+    // 100 hours ahead waits in the overflow list until the last level can hold it
+    const std::int64_t _hour = std::int64_t(3600) * 1000000000;
+    const std::int64_t _start = std::int64_t(5) * _hour;
+    timer_wheel<int> _wheel;
+    std::vector<released_timer> _released;
+    const auto _sink = [&](const clock::time_point due, int&& value) { _released.push_back({ due, clock::time_point(), value }); };
+    _wheel.advance(at(_start), _sink);
+    _wheel.insert(at(_start + 1000000), 2);
+    _wheel.insert(at(_start + 100 * _hour), 1);
+    _wheel.advance(at(_start + 2000000), _sink);
+    MIDIBRIDGE_CHECK(_released.size() == 1 && _released[0].value == 2);
+    MIDIBRIDGE_CHECK(_wheel.next_deadline() <= at(_start + 100 * _hour));
+    _wheel.advance(at(_start + 100 * _hour - 1000000), _sink);
+    MIDIBRIDGE_CHECK(_released.size() == 1);
+    _wheel.advance(at(_start + 100 * _hour + 1000), _sink);
+    MIDIBRIDGE_CHECK(_released.size() == 2 && _released[1].value == 1);
+}
+
+static void releases_every_timer_on_time_in_tick_order()
+{
+    std::mt19937_64 _random(7);
+    const std::int64_t _start = std::int64_t(1) << 40;
+    timer_wheel<int> _wheel;
+    std::vector<released_timer> _released;
+    std::int64_t _now = _start;
+    const auto _sink = [&](const clock::time_point due, int&& value) { _released.push_back({ due, at(_now), value }); };
+    _wheel.advance(at(_now), _sink);
+    int _inserted = 0;
+    for (int _step = 0; _step < 20000; ++_step) {
+        if (_random() % 2 == 0) {
+            // from the past to a few minutes ahead, so values land on every level
+            const std::int64_t _offset = static_cast<std::int64_t>(_random() % 200000000000ull) - 1000000;
+            _wheel.insert(at(_now + (_random() % 4 == 0 ? _offset : _offset % 50000000)), _inserted++);
+        }
+        _now += static_cast<std::int64_t>(_random() % 2000000);
+        _wheel.advance(at(_now), _sink);
+        MIDIBRIDGE_CHECK(_wheel.size() == 0 || _wheel.next_deadline() > at(_now));
+    }
+    _now += std::int64_t(300) * 1000000000;
+    _wheel.advance(at(_now), _sink);
+    MIDIBRIDGE_CHECK(static_cast<int>(_released.size()) == _inserted);
+    MIDIBRIDGE_CHECK(_wheel.size() == 0);
+    for (const released_timer& _timer : _released) {
+        MIDIBRIDGE_CHECK(_timer.due <= _timer.now);
+    }
+}
+
+}
+
+int main()
+{
+    MIDIBRIDGE_RUN(releases_across_the_last_level_boundary);
+    MIDIBRIDGE_RUN(releases_beyond_the_reach_of_the_last_level);
+    MIDIBRIDGE_RUN(releases_every_timer_on_time_in_tick_order);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "latency.hpp"
+#include "test.hpp"
+#include "transport.hpp"
+
+#if defined(MIDIBRIDGE_HAS_ALSA)
+#include <alsa/asoundlib.h>
+#endif
+
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/// @brief Records the time from each numbered packet being sent to the callback receiving it
+struct latency_recorder {
+    void operator()(const unsigned char* data, const std::size_t length)
+    {
+        const std::chrono::steady_clock::time_point _now = std::chrono::steady_clock::now();
+        if (length == 3) {
+            const std::size_t _index = static_cast<std::size_t>(data[1]) | static_cast<std::size_t>(data[2]) << 7;
+            histograms.record(latency_class::voice, _now - send_times[_index]);
+        }
+    }
+
+    std::vector<std::chrono::steady_clock::time_point> send_times;
+    latency_histograms histograms;
+};
+
+static void delivers_packets_to_the_callback_quickly()
+{
+    // 1 ms apart so the receive thread is asleep every time a packet arrives
+    midi_loopback _loopback = create_loopback();
+    latency_recorder _recorder;
+    _recorder.send_times.resize(2000);
+    _loopback.input->start(make_midi_receive_callback(_recorder));
+    for (std::size_t _index = 0; _index < _recorder.send_times.size(); ++_index) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        const unsigned char _note[] = { 0x90, static_cast<unsigned char>(_index & 0x7F), static_cast<unsigned char>(_index >> 7 & 0x7F) };
+        _recorder.send_times[_index] = std::chrono::steady_clock::now();
+        _loopback.output->send(_note, sizeof(_note));
+    }
+    const std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (_recorder.histograms.get_snapshot(latency_class::voice).total < _recorder.send_times.size() && std::chrono::steady_clock::now() < _deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    _loopback.input->stop();
+    const latency_snapshot _snapshot = _recorder.histograms.get_snapshot(latency_class::voice);
+    MIDIBRIDGE_CHECK(_snapshot.total == _recorder.send_times.size());
+    // polling every millisecond puts the p99 above 1 ms, waking on the packet takes tens of microseconds
+    MIDIBRIDGE_CHECK(_snapshot.get_percentile(0.99) < 500000);
+}
+
+#if defined(MIDIBRIDGE_HAS_ALSA)
+
+[[nodiscard]] static int find_sequencer_client(snd_seq_t* sequencer, const std::string& name)
+{
+    snd_seq_client_info_t* _info = nullptr;
+    snd_seq_client_info_alloca(&_info);
+    snd_seq_client_info_set_client(_info, -1);
+    while (snd_seq_query_next_client(sequencer, _info) >= 0) {
+        if (name == snd_seq_client_info_get_name(_info)) {
+            return snd_seq_client_info_get_client(_info);
+        }
+    }
+    return -1;
+}
+
+static void delivers_packets_to_a_restarted_virtual_input()
+{
+    // skipped where there is no sequencer, as in most containers
+    const std::string _name = "midibridge transport test";
+    std::unique_ptr<midi_input_transport> _input;
+    try {
+        _input = create_virtual_input(_name);
+    } catch (const std::runtime_error&) {
+        std::printf("no ALSA sequencer, skipped\n");
+        return;
+    }
+    snd_seq_t* _sender = nullptr;
+    MIDIBRIDGE_CHECK(snd_seq_open(&_sender, "default", SND_SEQ_OPEN_OUTPUT, 0) >= 0);
+    const int _port = snd_seq_create_simple_port(_sender, "sender", SND_SEQ_PORT_CAP_READ, SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+    const int _client = find_sequencer_client(_sender, _name);
+    MIDIBRIDGE_CHECK(_port >= 0 && _client >= 0);
+    MIDIBRIDGE_CHECK(snd_seq_connect_to(_sender, _port, _client, 0) >= 0);
+
+    // the stop leaves nothing behind that wakes or ends the thread of the next start
+    latency_recorder _recorder;
+    _recorder.send_times.resize(1000);
+    _input->start(make_midi_receive_callback(_recorder));
+    _input->stop();
+    _input->start(make_midi_receive_callback(_recorder));
+    const std::clock_t _idle_start = std::clock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    MIDIBRIDGE_CHECK(std::clock() - _idle_start < CLOCKS_PER_SEC / 20);
+
+    for (std::size_t _index = 0; _index < _recorder.send_times.size(); ++_index) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        snd_seq_event_t _event;
+        snd_seq_ev_clear(&_event);
+        snd_seq_ev_set_noteon(&_event, 0, static_cast<unsigned char>(_index & 0x7F), static_cast<unsigned char>(_index >> 7 & 0x7F));
+        snd_seq_ev_set_source(&_event, _port);
+        snd_seq_ev_set_subs(&_event);
+        snd_seq_ev_set_direct(&_event);
+        _recorder.send_times[_index] = std::chrono::steady_clock::now();
+        snd_seq_event_output_direct(_sender, &_event);
+    }
+    const std::chrono::steady_clock::time_point _deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (_recorder.histograms.get_snapshot(latency_class::voice).total < _recorder.send_times.size() && std::chrono::steady_clock::now() < _deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    _input->stop();
+    snd_seq_close(_sender);
+    const latency_snapshot _snapshot = _recorder.histograms.get_snapshot(latency_class::voice);
+    MIDIBRIDGE_CHECK(_snapshot.total == _recorder.send_times.size());
+    MIDIBRIDGE_CHECK(_snapshot.get_percentile(0.99) < 500000);
+}
+
+#endif
+
+}
+
+int main()
+{
+    MIDIBRIDGE_RUN(delivers_packets_to_the_callback_quickly);
+#if defined(MIDIBRIDGE_HAS_ALSA)
+    MIDIBRIDGE_RUN(delivers_packets_to_a_restarted_virtual_input);
+#endif
+    return 0;
+}